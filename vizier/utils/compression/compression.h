@@ -0,0 +1,277 @@
+#ifndef VIZIER_COMPRESSION_H
+#define VIZIER_COMPRESSION_H
+
+#include <zlib.h>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+/*
+Codecs that can be applied to a payload.  The value is written into the frame header, so existing values must not change
+*/
+enum class Codec : uint8_t {
+    NONE = 0,
+    DEFLATE = 1,
+};
+
+/*
+PoD for per-link compression settings
+*/
+struct CompressionOptions {
+    Codec codec = Codec::NONE;
+    // Payloads shorter than this are sent as is
+    size_t threshold = 256;
+    // zlib compression level, 0-9
+    int level = Z_DEFAULT_COMPRESSION;
+    // Optional preset dictionary.  Receivers must have registered the same dictionary to decode the payload
+    std::shared_ptr<const std::string> dictionary;
+};
+
+/*
+Compressed payloads are framed with a fixed header:
+
+    bytes 0-2   magic "\0VZ".  No text payload starts with a NUL byte
+    byte  3     codec
+    bytes 4-7   uncompressed length, little endian
+    bytes 8-11  Adler-32 of the preset dictionary, little endian, or 0 if none was used
+
+followed by the raw deflate stream.  Binary payloads may start with the magic too, so payloads sent as is that do are framed with
+codec NONE, see frame_uncompressed.
+*/
+constexpr char COMPRESSION_MAGIC[3] = {'\0', 'V', 'Z'};
+constexpr size_t COMPRESSION_HEADER_SIZE = 12;
+
+// Refuse to inflate payloads claiming to be larger than this
+constexpr uint32_t MAX_DECOMPRESSED_SIZE = uint32_t(1) << 28;
+
+namespace {
+    void write_u32(char* out, const uint32_t value) {
+        for (size_t i = 0; i < 4; ++i) {
+            out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+        }
+    }
+
+    uint32_t read_u32(const char* in) {
+        uint32_t value = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            value |= uint32_t(static_cast<unsigned char>(in[i])) << (8 * i);
+        }
+        return value;
+    }
+} // namespace
+
+/*
+Returns:
+    The identifier of a preset dictionary, as written into the frame header
+*/
+inline uint32_t dictionary_id(const std::string& dictionary) {
+    return adler32(adler32(0, Z_NULL, 0), reinterpret_cast<const Bytef*>(dictionary.data()), dictionary.size());
+}
+
+/*
+Returns:
+    True if the payload starts with a compression frame header
+*/
+inline bool is_compressed(const char* data, const size_t length) {
+    return length >= COMPRESSION_HEADER_SIZE && std::memcmp(data, COMPRESSION_MAGIC, sizeof(COMPRESSION_MAGIC)) == 0;
+}
+
+/*
+Frames a payload as is, with codec NONE, so that receivers do not take an uncompressed payload starting with the magic for a
+compressed one.  Needed only for payloads that satisfy is_compressed
+
+Args:
+    payload: payload to frame, in place
+*/
+inline void frame_uncompressed(std::string& payload) {
+    char header[COMPRESSION_HEADER_SIZE];
+    std::memcpy(header, COMPRESSION_MAGIC, sizeof(COMPRESSION_MAGIC));
+    header[3] = static_cast<char>(Codec::NONE);
+    write_u32(&header[4], static_cast<uint32_t>(payload.size()));
+    write_u32(&header[8], 0);
+
+    payload.insert(0, header, COMPRESSION_HEADER_SIZE);
+}
+
+/*
+Compresses and frames a payload.
+
+Args:
+    payload: payload to compress
+    options: codec, threshold, level and dictionary to use
+
+Returns:
+    The framed payload, or nothing if the payload should be sent as is: no codec was selected, the payload is shorter than the
+    threshold, or compression did not make it smaller
+*/
+inline std::optional<std::string> compress(const std::string& payload, const CompressionOptions& options) {
+    if (options.codec != Codec::DEFLATE || payload.size() < options.threshold || payload.size() > MAX_DECOMPRESSED_SIZE) {
+        return std::nullopt;
+    }
+
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+
+    // Negative window bits select a raw deflate stream.  The frame header already carries the length and dictionary
+    if (deflateInit2(&stream, options.level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return std::nullopt;
+    }
+
+    uint32_t dict_id = 0;
+    if (options.dictionary && !options.dictionary->empty()) {
+        dict_id = dictionary_id(*options.dictionary);
+        deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(options.dictionary->data()), options.dictionary->size());
+    }
+
+    std::string out(COMPRESSION_HEADER_SIZE + deflateBound(&stream, payload.size()), '\0');
+    std::memcpy(&out[0], COMPRESSION_MAGIC, sizeof(COMPRESSION_MAGIC));
+    out[3] = static_cast<char>(options.codec);
+    write_u32(&out[4], static_cast<uint32_t>(payload.size()));
+    write_u32(&out[8], dict_id);
+
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(payload.data()));
+    stream.avail_in = payload.size();
+    stream.next_out = reinterpret_cast<Bytef*>(&out[COMPRESSION_HEADER_SIZE]);
+    stream.avail_out = out.size() - COMPRESSION_HEADER_SIZE;
+
+    int rc = deflate(&stream, Z_FINISH);
+    size_t written = stream.total_out;
+    deflateEnd(&stream);
+
+    if (rc != Z_STREAM_END || COMPRESSION_HEADER_SIZE + written >= payload.size()) {
+        return std::nullopt;
+    }
+
+    out.resize(COMPRESSION_HEADER_SIZE + written);
+    return out;
+}
+
+/*
+Thread-safe registry of the preset dictionaries a receiver can decode with, keyed by dictionary_id
+*/
+class CompressionDictionaries {
+private:
+    std::unordered_map<uint32_t, std::shared_ptr<const std::string>> dictionaries;
+    mutable std::mutex m;
+
+public:
+    /*
+    Registers a dictionary.
+
+    Returns:
+        The dictionary's identifier
+    */
+    uint32_t add(std::shared_ptr<const std::string> dictionary) {
+        uint32_t id = dictionary_id(*dictionary);
+
+        std::lock_guard<std::mutex> lock(this->m);
+        this->dictionaries[id] = std::move(dictionary);
+
+        return id;
+    }
+
+    /*
+    Returns:
+        The dictionary with the given identifier, or nullptr if it has not been registered
+    */
+    std::shared_ptr<const std::string> find(const uint32_t id) const {
+        std::lock_guard<std::mutex> lock(this->m);
+        auto it = this->dictionaries.find(id);
+
+        return (it == this->dictionaries.end()) ? nullptr : it->second;
+    }
+};
+
+/*
+Decodes a payload produced by compress or frame_uncompressed into an existing string, reusing its capacity.
+
+Args:
+    data: framed payload.  Must satisfy is_compressed
+    length: length of the framed payload
+    dictionaries: dictionaries that the payload may have been compressed with
+    out: receives the original payload.  Unspecified if decoding fails
+
+Returns:
+    False if the frame is malformed, uses an unknown codec, or needs a dictionary that is not registered
+*/
+inline bool decompress(const char* data, const size_t length, const CompressionDictionaries& dictionaries, std::string& out) {
+    if (!is_compressed(data, length)) {
+        return false;
+    }
+
+    Codec codec = static_cast<Codec>(data[3]);
+    uint32_t size = read_u32(data + 4);
+    uint32_t dict_id = read_u32(data + 8);
+
+    if (codec == Codec::NONE) {
+        if (size != length - COMPRESSION_HEADER_SIZE || dict_id != 0) {
+            return false;
+        }
+
+        out.assign(data + COMPRESSION_HEADER_SIZE, size);
+        return true;
+    }
+
+    if (codec != Codec::DEFLATE || size > MAX_DECOMPRESSED_SIZE) {
+        return false;
+    }
+
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+
+    if (inflateInit2(&stream, -15) != Z_OK) {
+        return false;
+    }
+
+    if (dict_id != 0) {
+        auto dictionary = dictionaries.find(dict_id);
+
+        if (!dictionary) {
+            inflateEnd(&stream);
+            return false;
+        }
+
+        inflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(dictionary->data()), dictionary->size());
+    }
+
+    // The header tells us the exact size, so inflate straight into the final buffer
+    out.resize(size);
+
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data + COMPRESSION_HEADER_SIZE));
+    stream.avail_in = length - COMPRESSION_HEADER_SIZE;
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = size;
+
+    int rc = inflate(&stream, Z_FINISH);
+    size_t written = stream.total_out;
+    inflateEnd(&stream);
+
+    return rc == Z_STREAM_END && written == size;
+}
+
+/*
+Decodes a payload produced by compress or frame_uncompressed.
+
+Args:
+    data: framed payload.  Must satisfy is_compressed
+    length: length of the framed payload
+    dictionaries: dictionaries that the payload may have been compressed with
+
+Returns:
+    The original payload, or nothing if the frame is malformed, uses an unknown codec, or needs a dictionary that is not registered
+*/
+inline std::optional<std::string> decompress(const char* data, const size_t length, const CompressionDictionaries& dictionaries) {
+    std::string out;
+
+    if (!decompress(data, length, dictionaries, out)) {
+        return std::nullopt;
+    }
+
+    return out;
+}
+
+#endif
@@ -0,0 +1,90 @@
+#include "vizier/utils/compression/compression.h"
+#include <string>
+#include "gtest/gtest.h"
+
+namespace {
+    std::string status_message(int i) {
+        return "{\"battery\": " + std::to_string(i % 100) + ", \"charging\": false, \"pose\": [0.1, 0.2, 0.3], \"status\": \"nominal\"}";
+    }
+}
+
+TEST(Compression, RoundTrip) {
+    CompressionOptions options;
+    options.codec = Codec::DEFLATE;
+    options.threshold = 0;
+
+    std::string payload;
+    for (int i = 0; i < 100; ++i) {
+        payload += status_message(i);
+    }
+
+    auto compressed = compress(payload, options);
+    ASSERT_TRUE(bool(compressed));
+    EXPECT_LT(compressed->size(), payload.size());
+    EXPECT_TRUE(is_compressed(compressed->data(), compressed->size()));
+
+    CompressionDictionaries dictionaries;
+    EXPECT_EQ(payload, decompress(compressed->data(), compressed->size(), dictionaries).value());
+}
+
+TEST(Compression, SkipsSmallAndUnselected) {
+    CompressionOptions options;
+    options.codec = Codec::DEFLATE;
+    options.threshold = 1024;
+
+    EXPECT_FALSE(bool(compress(status_message(0), options)));
+
+    options.codec = Codec::NONE;
+    options.threshold = 0;
+    EXPECT_FALSE(bool(compress(status_message(0) + status_message(1), options)));
+    EXPECT_FALSE(is_compressed(status_message(0).data(), status_message(0).size()));
+}
+
+TEST(Compression, Dictionary) {
+    CompressionOptions options;
+    options.codec = Codec::DEFLATE;
+    options.threshold = 0;
+    options.dictionary = std::make_shared<const std::string>(status_message(0) + status_message(50));
+
+    std::string payload = status_message(42);
+    auto compressed = compress(payload, options);
+    ASSERT_TRUE(bool(compressed));
+
+    // The receiver needs the dictionary to decode
+    CompressionDictionaries dictionaries;
+    EXPECT_FALSE(bool(decompress(compressed->data(), compressed->size(), dictionaries)));
+
+    dictionaries.add(options.dictionary);
+    EXPECT_EQ(payload, decompress(compressed->data(), compressed->size(), dictionaries).value());
+}
+
+TEST(Compression, RejectsCorruptFrames) {
+    CompressionOptions options;
+    options.codec = Codec::DEFLATE;
+    options.threshold = 0;
+
+    std::string payload(4096, 'a');
+    std::string compressed = compress(payload, options).value();
+    CompressionDictionaries dictionaries;
+
+    EXPECT_FALSE(bool(decompress(compressed.data(), compressed.size() - 1, dictionaries)));
+
+    compressed[4] = 0x01;
+    EXPECT_FALSE(bool(decompress(compressed.data(), compressed.size(), dictionaries)));
+}
+
+TEST(Compression, FramesCollidingPayloads) {
+    CompressionDictionaries dictionaries;
+
+    // A binary payload that happens to start with the magic
+    std::string payload("\0VZ\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b", 14);
+    ASSERT_TRUE(is_compressed(payload.data(), payload.size()));
+    EXPECT_FALSE(bool(decompress(payload.data(), payload.size(), dictionaries)));
+
+    std::string framed = payload;
+    frame_uncompressed(framed);
+    EXPECT_EQ(payload, decompress(framed.data(), framed.size(), dictionaries).value());
+
+    framed.pop_back();
+    EXPECT_FALSE(bool(decompress(framed.data(), framed.size(), dictionaries)));
+}
@@ -0,0 +1,147 @@
+#ifndef VIZIER_LANEQUEUE_H
+#define VIZIER_LANEQUEUE_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+/*
+Thread-safe queue with several lanes, ordered from most to least urgent.  Items within a lane come out in FIFO order.  Across lanes:
+
+    - Lanes with weight zero are strict: an item in a strict lane comes out before any item in a later lane
+    - The other lanes share what is left in proportion to their weights, by smooth weighted round-robin, so a busy lane cannot starve
+      a less urgent one
+*/
+template <class T>
+class LaneQueue {
+private:
+    std::vector<std::deque<T>> lanes;
+    std::vector<int64_t> weights;
+    // Running credit of each weighted lane for the round-robin
+    std::vector<int64_t> credit;
+    size_t count = 0;
+
+    std::mutex m;
+    std::condition_variable c;
+
+    // Pops the next item.  Called with the lock held and at least one item queued
+    T pop() {
+        size_t lane = this->lanes.size();
+
+        for (size_t i = 0; i < this->lanes.size() && lane == this->lanes.size(); ++i) {
+            if (this->weights[i] == 0 && !this->lanes[i].empty()) {
+                lane = i;
+            }
+        }
+
+        // No strict lane has an item.  Every waiting lane earns its weight, and the lane with the most credit pays for its turn
+        if (lane == this->lanes.size()) {
+            int64_t total = 0;
+
+            for (size_t i = 0; i < this->lanes.size(); ++i) {
+                if (this->weights[i] == 0 || this->lanes[i].empty()) {
+                    continue;
+                }
+
+                this->credit[i] += this->weights[i];
+                total += this->weights[i];
+
+                if (lane == this->lanes.size() || this->credit[i] > this->credit[lane]) {
+                    lane = i;
+                }
+            }
+
+            this->credit[lane] -= total;
+        }
+
+        T item = std::move(this->lanes[lane].front());
+        this->lanes[lane].pop_front();
+        --this->count;
+
+        return item;
+    }
+
+public:
+    /*
+    Args:
+        weights: weight of each lane, most urgent first.  Zero makes a lane strict
+    */
+    explicit LaneQueue(const std::vector<size_t>& weights)
+        : lanes(weights.size()), weights(weights.begin(), weights.end()), credit(weights.size(), 0) {}
+
+    LaneQueue(const LaneQueue&) = delete;
+    LaneQueue& operator=(const LaneQueue&) = delete;
+
+    /*
+    Appends an item to a lane.  Thread safe
+
+    Args:
+        lane: index of the lane.  Out-of-range lanes are clamped to the last one
+        item: item to append
+    */
+    void enqueue(const size_t lane, T&& item) {
+        {
+            std::lock_guard<std::mutex> lock(this->m);
+            this->lanes[std::min(lane, this->lanes.size() - 1)].push_back(std::move(item));
+            ++this->count;
+        }
+
+        this->c.notify_one();
+    }
+
+    /*
+    Waits for the next item.  Thread safe
+    */
+    T dequeue() {
+        std::unique_lock<std::mutex> lock(this->m);
+
+        // Protects against spurious wake-ups
+        while (this->count == 0) {
+            this->c.wait(lock);
+        }
+
+        return this->pop();
+    }
+
+    /*
+    Waits for the next item for at most timeout.  Thread safe
+
+    Returns:
+        The item, or nothing on timeout
+    */
+    std::optional<T> dequeue(const std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(this->m);
+
+        if (!this->c.wait_for(lock, timeout, [this]() { return this->count > 0; })) {
+            return std::nullopt;
+        }
+
+        return this->pop();
+    }
+
+    /*
+    Returns:
+        The next item, or nothing if the queue is empty.  Thread safe
+    */
+    std::optional<T> try_dequeue() {
+        std::lock_guard<std::mutex> lock(this->m);
+
+        if (this->count == 0) {
+            return std::nullopt;
+        }
+
+        return this->pop();
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(this->m);
+        return this->count;
+    }
+};
+
+#endif
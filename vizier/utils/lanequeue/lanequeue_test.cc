@@ -0,0 +1,76 @@
+#include "vizier/utils/lanequeue/lanequeue.h"
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+
+TEST(LaneQueue, FifoWithinLane) {
+    LaneQueue<int> q({1});
+
+    for (int i = 0; i < 5; ++i) {
+        q.enqueue(0, int(i));
+    }
+
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, q.dequeue());
+    }
+}
+
+TEST(LaneQueue, StrictLanesGoFirst) {
+    LaneQueue<std::string> q({0, 1, 1});
+
+    q.enqueue(2, "telemetry 0");
+    q.enqueue(1, "response");
+    q.enqueue(2, "telemetry 1");
+    q.enqueue(0, "stop");
+
+    EXPECT_EQ("stop", q.dequeue());
+    EXPECT_EQ(3, q.size());
+}
+
+TEST(LaneQueue, WeightedLanesShare) {
+    LaneQueue<int> q({3, 1});
+
+    for (int i = 0; i < 100; ++i) {
+        q.enqueue(0, 0);
+        q.enqueue(1, 1);
+    }
+
+    // Three items of the first lane for every item of the second, and the second is never starved
+    int counts[2] = {0, 0};
+    for (int i = 0; i < 40; ++i) {
+        ++counts[q.dequeue()];
+    }
+
+    EXPECT_EQ(30, counts[0]);
+    EXPECT_EQ(10, counts[1]);
+}
+
+TEST(LaneQueue, OutOfRangeLanesAreClamped) {
+    LaneQueue<int> q({0, 1});
+
+    q.enqueue(7, 1);
+    q.enqueue(0, 0);
+
+    EXPECT_EQ(0, q.dequeue());
+    EXPECT_EQ(1, q.dequeue());
+}
+
+TEST(LaneQueue, Timeout) {
+    LaneQueue<int> q({1});
+
+    EXPECT_FALSE(bool(q.dequeue(std::chrono::milliseconds(50))));
+    EXPECT_FALSE(bool(q.try_dequeue()));
+
+    std::thread producer([&q]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        q.enqueue(0, 42);
+    });
+
+    auto item = q.dequeue(std::chrono::milliseconds(1000));
+    producer.join();
+
+    ASSERT_TRUE(bool(item));
+    EXPECT_EQ(42, item.value());
+}
@@ -0,0 +1,181 @@
+#ifndef VIZIER_LOGGING_H
+#define VIZIER_LOGGING_H
+
+#include <spdlog/spdlog.h>
+#include <spdlog/async.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*
+Logging for code on hot paths, i.e. anything that runs per message.  Everything goes through spdlog's default logger, which
+configure_logging replaces with an asynchronous one so that callers pay for formatting and a queue push rather than for the sink.
+
+    VIZIER_LOG_DEBUG(...), VIZIER_LOG_INFO(...), ...
+        Like spdlog::debug and friends, but compiled out entirely below VIZIER_LOG_ACTIVE_LEVEL, arguments included
+
+    VIZIER_LOG_WARN_LIMITED(...), VIZIER_LOG_ERROR_LIMITED(...), ...
+        Allow at most LogOptions::rate_limit_burst messages per call site every LogOptions::rate_limit_period.  The number of messages
+        suppressed is reported with the next message the call site logs.  For anything a misbehaving peer can trigger at wire rate
+*/
+
+// Lowest level kept by the VIZIER_LOG_* macros.  Override with e.g. --copt=-DVIZIER_LOG_ACTIVE_LEVEL=SPDLOG_LEVEL_WARN
+#ifndef VIZIER_LOG_ACTIVE_LEVEL
+#define VIZIER_LOG_ACTIVE_LEVEL SPDLOG_LEVEL_INFO
+#endif
+
+/*
+PoD for the options of the library's logger
+*/
+struct LogOptions {
+    // Write to the sinks on a background thread
+    bool async = true;
+    // Number of messages the background thread may fall behind by
+    size_t queue_size = 8192;
+    // When the queue is full, wait for room instead of overwriting the oldest message
+    bool block_when_full = false;
+    // Messages below this level are discarded at runtime
+    spdlog::level::level_enum level = spdlog::level::info;
+    // Messages at or above this level are flushed right away
+    spdlog::level::level_enum flush_level = spdlog::level::err;
+    // Where messages go.  Colored stdout if empty
+    std::vector<spdlog::sink_ptr> sinks;
+    // Rate limit of the VIZIER_LOG_*_LIMITED call sites: at most burst messages per period, each
+    size_t rate_limit_burst = 10;
+    std::chrono::milliseconds rate_limit_period = std::chrono::milliseconds(1000);
+};
+
+namespace vizier_logging {
+    inline std::atomic<size_t> rate_limit_burst{10};
+    inline std::atomic<int64_t> rate_limit_period_ms{1000};
+}
+
+/*
+Rate limit of a single call site.  Counts messages in fixed windows of LogOptions::rate_limit_period.  Thread safe
+*/
+class LogLimiter {
+private:
+    std::atomic<int64_t> window_start{INT64_MIN / 2};
+    std::atomic<size_t> count{0};
+    std::atomic<size_t> suppressed{0};
+
+public:
+    /*
+    Args:
+        suppressed_before: set to the number of messages suppressed since the last one allowed
+
+    Returns:
+        True if the message may be logged
+    */
+    bool allow(size_t& suppressed_before) {
+        const int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t start = this->window_start.load(std::memory_order_relaxed);
+
+        // Only the thread that moves the window resets the count
+        if (now - start >= vizier_logging::rate_limit_period_ms.load(std::memory_order_relaxed)
+            && this->window_start.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+            this->count.store(0, std::memory_order_relaxed);
+        }
+
+        if (this->count.fetch_add(1, std::memory_order_relaxed) < vizier_logging::rate_limit_burst.load(std::memory_order_relaxed)) {
+            suppressed_before = this->suppressed.exchange(0, std::memory_order_relaxed);
+            return true;
+        }
+
+        this->suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+};
+
+/*
+Replaces spdlog's default logger, which the library logs to, with one named "vizier".  Not thread safe: call it once at startup, before
+creating any node or client.  An asynchronous logger writes out what is still queued when spdlog::shutdown() is called
+
+Args:
+    options: logger options
+
+Returns:
+    The new logger
+*/
+inline std::shared_ptr<spdlog::logger> configure_logging(const LogOptions& options = LogOptions()) {
+    std::vector<spdlog::sink_ptr> sinks = options.sinks;
+    if (sinks.empty()) {
+        sinks.push_back(std::make_shared<spdlog::sinks::stdout_color_sink_mt>());
+    }
+
+    std::shared_ptr<spdlog::logger> logger;
+
+    if (options.async) {
+        spdlog::init_thread_pool(options.queue_size, 1);
+
+        auto policy = options.block_when_full ? spdlog::async_overflow_policy::block : spdlog::async_overflow_policy::overrun_oldest;
+        logger = std::make_shared<spdlog::async_logger>("vizier", sinks.begin(), sinks.end(), spdlog::thread_pool(), policy);
+    } else {
+        logger = std::make_shared<spdlog::logger>("vizier", sinks.begin(), sinks.end());
+    }
+
+    logger->set_level(options.level);
+    logger->flush_on(options.flush_level);
+
+    vizier_logging::rate_limit_burst = options.rate_limit_burst;
+    vizier_logging::rate_limit_period_ms = options.rate_limit_period.count();
+
+    spdlog::set_default_logger(logger);
+
+    return logger;
+}
+
+#define VIZIER_LOG_CALL_(level, ...) SPDLOG_LOGGER_CALL(spdlog::default_logger_raw(), level, __VA_ARGS__)
+
+#define VIZIER_LOG_LIMITED_(level, ...)                                                                                       \
+    do {                                                                                                                      \
+        static LogLimiter vizier_log_limiter_;                                                                                \
+        size_t vizier_log_suppressed_ = 0;                                                                                    \
+        if (spdlog::default_logger_raw()->should_log(level) && vizier_log_limiter_.allow(vizier_log_suppressed_)) {           \
+            if (vizier_log_suppressed_ > 0) {                                                                                 \
+                VIZIER_LOG_CALL_(level, "Suppressed {0} messages like the next one", vizier_log_suppressed_);                 \
+            }                                                                                                                 \
+            VIZIER_LOG_CALL_(level, __VA_ARGS__);                                                                             \
+        }                                                                                                                     \
+    } while (0)
+
+#if VIZIER_LOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_TRACE
+#define VIZIER_LOG_TRACE(...) VIZIER_LOG_CALL_(spdlog::level::trace, __VA_ARGS__)
+#else
+#define VIZIER_LOG_TRACE(...) (void) 0
+#endif
+
+#if VIZIER_LOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
+#define VIZIER_LOG_DEBUG(...) VIZIER_LOG_CALL_(spdlog::level::debug, __VA_ARGS__)
+#else
+#define VIZIER_LOG_DEBUG(...) (void) 0
+#endif
+
+#if VIZIER_LOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_INFO
+#define VIZIER_LOG_INFO(...) VIZIER_LOG_CALL_(spdlog::level::info, __VA_ARGS__)
+#define VIZIER_LOG_INFO_LIMITED(...) VIZIER_LOG_LIMITED_(spdlog::level::info, __VA_ARGS__)
+#else
+#define VIZIER_LOG_INFO(...) (void) 0
+#define VIZIER_LOG_INFO_LIMITED(...) (void) 0
+#endif
+
+#if VIZIER_LOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_WARN
+#define VIZIER_LOG_WARN(...) VIZIER_LOG_CALL_(spdlog::level::warn, __VA_ARGS__)
+#define VIZIER_LOG_WARN_LIMITED(...) VIZIER_LOG_LIMITED_(spdlog::level::warn, __VA_ARGS__)
+#else
+#define VIZIER_LOG_WARN(...) (void) 0
+#define VIZIER_LOG_WARN_LIMITED(...) (void) 0
+#endif
+
+#if VIZIER_LOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_ERROR
+#define VIZIER_LOG_ERROR(...) VIZIER_LOG_CALL_(spdlog::level::err, __VA_ARGS__)
+#define VIZIER_LOG_ERROR_LIMITED(...) VIZIER_LOG_LIMITED_(spdlog::level::err, __VA_ARGS__)
+#else
+#define VIZIER_LOG_ERROR(...) (void) 0
+#define VIZIER_LOG_ERROR_LIMITED(...) (void) 0
+#endif
+
+#endif
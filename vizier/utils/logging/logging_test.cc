@@ -0,0 +1,90 @@
+#include "vizier/utils/logging/logging.h"
+#include <spdlog/sinks/ostream_sink.h>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "gtest/gtest.h"
+
+namespace {
+    LogOptions options_for(std::ostringstream& out) {
+        LogOptions options;
+        options.async = false;
+        options.level = spdlog::level::trace;
+        options.sinks.push_back(std::make_shared<spdlog::sinks::ostream_sink_mt>(out));
+        return options;
+    }
+
+    size_t count_lines(const std::string& text) {
+        size_t lines = 0;
+        for (char c : text) {
+            lines += c == '\n';
+        }
+        return lines;
+    }
+
+    int evaluated(int& count) {
+        return ++count;
+    }
+}
+
+TEST(Logging, LevelsBelowActiveLevelAreCompiledOut) {
+    std::ostringstream out;
+    configure_logging(options_for(out));
+
+    int count = 0;
+    VIZIER_LOG_DEBUG("Evaluated {0} times", evaluated(count));
+    VIZIER_LOG_TRACE("Evaluated {0} times", evaluated(count));
+    VIZIER_LOG_INFO("Evaluated {0} times", evaluated(count));
+
+    // The runtime level lets everything through, but only INFO survives compilation
+    EXPECT_EQ(1, count);
+    EXPECT_EQ(1, count_lines(out.str()));
+}
+
+TEST(Logging, CallSitesAreRateLimited) {
+    std::ostringstream out;
+    LogOptions options = options_for(out);
+    options.rate_limit_burst = 3;
+    options.rate_limit_period = std::chrono::milliseconds(50);
+    configure_logging(options);
+
+    auto flood = []() {
+        for (int i = 0; i < 10; ++i) {
+            VIZIER_LOG_ERROR_LIMITED("Got request for invalid link: {0}", i);
+        }
+    };
+
+    flood();
+    EXPECT_EQ(3, count_lines(out.str()));
+
+    // Another call site has its own budget
+    VIZIER_LOG_WARN_LIMITED("Something else");
+    EXPECT_EQ(4, count_lines(out.str()));
+
+    // The next window reports what was suppressed in the last one
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    out.str("");
+
+    flood();
+    EXPECT_NE(std::string::npos, out.str().find("Suppressed 7 messages like the next one"));
+    EXPECT_EQ(4, count_lines(out.str()));
+}
+
+TEST(Logging, Async) {
+    std::ostringstream out;
+    LogOptions options = options_for(out);
+    options.async = true;
+    options.block_when_full = true;
+    options.queue_size = 16;
+    configure_logging(options);
+
+    for (int i = 0; i < 100; ++i) {
+        VIZIER_LOG_INFO("Message {0}", i);
+    }
+
+    // Writes out what is still queued
+    spdlog::shutdown();
+
+    EXPECT_EQ(100, count_lines(out.str()));
+}
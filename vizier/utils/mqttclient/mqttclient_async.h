@@ -4,14 +4,29 @@
 #include <mosquitto.h>
 #include <spdlog/spdlog.h>
 #include <tsqueue.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <functional>
 #include <future>
 #include <iostream>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include "vizier/vizier_node/utils.h"
+#include "vizier/utils/compression/compression.h"
+#include "vizier/utils/lanequeue/lanequeue.h"
+#include "vizier/utils/logging/logging.h"
+#include "vizier/utils/slotqueue/slotqueue.h"
+#include "vizier/utils/spool/spool.h"
+#include "vizier/utils/tracing/tracing.h"
+#include "vizier/utils/trafficlog/trafficlog.h"
 #include <memory>
 
 using string = std::string;
@@ -25,6 +40,96 @@ using shared_ptr = std::shared_ptr<T>;
 template <class T>
 using unique_ptr = std::unique_ptr<T>;
 
+/*
+Urgency of outgoing messages.  Each priority has its own lane in the publish queue, so urgent messages overtake messages that are
+already queued
+*/
+enum class Priority {CRITICAL, HIGH, NORMAL, LOW};
+
+/*
+PoD for options applied to outgoing messages on the publish thread
+*/
+struct PublishOptions {
+    CompressionOptions compression;
+    // Sustained rate limit in messages per second, enforced with a token bucket.  Zero disables rate limiting
+    double max_rate = 0;
+    // Number of messages that may be sent back-to-back after the topic has been idle
+    size_t burst = 1;
+    // Only every decimation-th message is published
+    size_t decimation = 1;
+    // Latest-wins: a message replaces any message on the same topic that has not been sent yet, instead of queueing behind it.
+    // Conflated messages held back by the rate limit are delayed.  Other messages exceeding the rate limit are dropped
+    bool conflate = false;
+    // The broker keeps the message and hands it to every client that subscribes to the topic later
+    bool retain = false;
+    // Messages that cannot be sent because the broker is unreachable are kept in the client's spool, if it has one, and sent once the
+    // connection is back.  Spooled messages are not retained
+    bool spool = false;
+    // Spooled messages older than this are dropped instead of sent.  Zero keeps them until they are sent
+    std::chrono::milliseconds spool_max_age = std::chrono::milliseconds(0);
+    // When the spool is full, drop its oldest messages to make room for this one, instead of dropping this one
+    bool spool_evict = true;
+    // QoS of published messages.  The broker only queues messages of QoS 1 and up for persistent sessions that are disconnected
+    int qos = 0;
+    // Lane of the publish queue the message waits in
+    Priority priority = Priority::NORMAL;
+    // Prefix the message with the time it was handed to the client and the time it was handed to the network, so that subscribers can
+    // tell where its latency comes from.  See TraceStamps
+    bool trace = false;
+};
+
+/*
+PoD for options applied to the connection to the broker
+*/
+struct MqttClientOptions {
+    // Identifies the client to the broker.  Empty for a random id.  Persistent sessions need an id that is stable across restarts
+    string client_id;
+    // Ask the broker to keep the client's subscriptions, and its QoS 1 and up messages, while the client is disconnected.  On
+    // reconnecting to a broker that kept the session, nothing is resubscribed.  Requires a client_id
+    bool persistent_session = false;
+    // QoS of subscriptions
+    int subscribe_qos = 0;
+    // Seconds between pings of an otherwise idle connection
+    int keepalive = 20;
+    // Return from the constructor without waiting for the connection, which is retried in the background until the broker accepts
+    // it, see is_connected.  Messages published meanwhile are dropped unless their topic is spooled
+    bool connect_async = false;
+    // Seconds to wait before reconnecting to the broker, doubled after every failed attempt up to reconnect_delay_max
+    unsigned int reconnect_delay = 1;
+    unsigned int reconnect_delay_max = 30;
+    // Last will, published by the broker if the client disconnects without saying goodbye, e.g. because it crashed.  Empty topic for none
+    string will_topic;
+    string will_payload;
+    bool will_retain = false;
+    // Ring file buffering messages of spooled topics while the broker is unreachable.  Empty for no spool
+    string spool_path;
+    // Size of the ring file in bytes
+    size_t spool_capacity = 64 << 20;
+    // Messages per second sent from the spool once the connection is back, so that the backlog does not crowd out live messages
+    double spool_drain_rate = 1000;
+    // Weight of the lane of each Priority, most urgent first.  A lane with weight zero is strict: its messages go before those of any
+    // later lane.  The other lanes share the rest in proportion to their weights, so that low priorities are slowed but never starved
+    std::vector<size_t> lane_weights = {0, 8, 4, 1};
+    // Number of messages handed to mosquitto and not yet written to the socket, or acknowledged for QoS 1 and up.  Messages beyond this
+    // wait in the lanes, where urgent ones can still overtake them, instead of in mosquitto's FIFO.  Zero for no limit
+    size_t max_in_flight = 16;
+    // Log every message published and received is appended to, as the application published it and as subscribers received it, for
+    // replaying the traffic later.  Replaced if it exists.  Empty for no recording
+    string record_path;
+    // Size of the log in bytes.  Messages beyond it are not recorded
+    size_t record_capacity = size_t(256) << 20;
+};
+
+/*
+Callback for messages on a subscribed topic.  The payload may be moved from
+*/
+using MessageCallback = std::function<void(const string&, string&&)>;
+
+/*
+Callback for the timestamps of traced messages on a subscribed topic, called right before the message's callback
+*/
+using TraceListener = std::function<void(const string&, const TraceStamps&)>;
+
 /*
 TODO: Make templated with queue type
 */
@@ -42,34 +147,160 @@ private:
     string host;
     int port;
 
-    std::pair<string, string> empty;
-    ThreadSafeQueue<std::pair<string, string>> q;
+    /*
+    Message waiting for the publish thread.  If options is empty, the options registered for the topic are used.  Conflated messages
+    carry no payload; the publish thread takes the latest payload from the topic's state when it gets to them
+    */
+    struct OutgoingMessage {
+        string topic;
+        string payload;
+        optional<PublishOptions> options;
+        bool conflated = false;
+        // Piece of a large message.  Sent behind other messages, with at most BULK_WINDOW pieces in mosquitto's hands at a time
+        bool bulk = false;
+        // Wakes the publish thread to send more bulk pieces
+        bool wake = false;
+        // When the message was handed to the client, for traced messages
+        int64_t enqueued = 0;
+    };
+
+    // Number of bulk pieces handed to mosquitto and not yet written to the socket.  One piece waiting behind the one being
+    // written keeps the socket busy, and every other message waits behind at most these
+    static constexpr size_t BULK_WINDOW = 2;
+
+    // Message ids of the bulk pieces in flight.  Cleared by the network thread as they are written
+    std::unordered_set<int> bulk_in_flight;
+    std::mutex bulk_mutex;
+
+    /*
+    Publishing state of a topic with registered options
+    */
+    struct TopicState {
+        PublishOptions options;
+        // Number of messages submitted, for decimation
+        size_t submitted = 0;
+        // Token bucket for rate limiting
+        double tokens = 0;
+        std::chrono::steady_clock::time_point refilled;
+        // Latest conflated message not yet sent, and whether the publish thread already knows about it
+        optional<string> pending;
+        bool scheduled = false;
+    };
+
+    LaneQueue<OutgoingMessage> q;
     std::thread publish_thread;
 
-    ThreadSafeQueue<std::function<void()>> modifications;
+    // Messages handed to mosquitto and not yet reported written.  Counted by the publish thread and the network thread
+    size_t max_in_flight;
+    size_t in_flight = 0;
+    std::mutex window_mutex;
+    std::condition_variable window_cv;
+
+    std::unordered_map<string, TopicState> topics;
+    std::mutex topics_mutex;
+    CompressionDictionaries dictionaries;
+
+    /*
+    Work for the modification thread.  Events live in the slots of a SlotQueue and are overwritten in place, so the strings keep their
+    capacity between messages and dispatching a message does not allocate
+    */
+    struct Event {
+        enum class Type {MESSAGE, SUBSCRIBE, UNSUBSCRIBE, RESUBSCRIBE, TRACE, BIRTH, FLUSH, STOP};
+
+        Type type = Type::STOP;
+        string topic;
+        string payload;
+        MessageCallback callback;
+        // Fulfilled once a (un)subscription has been made, if anyone waits for it.  Owned by the waiting caller
+        std::promise<bool>* done = nullptr;
+        // For RESUBSCRIBE: the broker kept the session, subscriptions included
+        bool session_present = false;
+        // For MESSAGE: the message was traced, with these timestamps
+        bool traced = false;
+        TraceStamps trace;
+        // For TRACE: the new trace listener
+        TraceListener listener;
+        // For BIRTH: options of the birth message, whose topic and payload are in topic and payload
+        optional<PublishOptions> options;
+    };
+
+    // Maximum number of topics per SUBSCRIBE packet when restoring subscriptions
+    static constexpr size_t SUBSCRIBE_BATCH = 256;
+
+    int subscribe_qos;
+    // Set by the modification thread when a (un)subscription could not be sent, in which case the broker's copy of the session is
+    // out of date and is replaced on the next reconnect
+    bool subscriptions_dirty = false;
+
+    // Number of events allocated up front.  The queue grows if the callbacks fall further behind than this
+    static constexpr size_t EVENT_SLOTS = 64;
+
+    SlotQueue<Event> events = SlotQueue<Event>(EVENT_SLOTS);
     std::thread modification_thread;
 
-    std::unordered_map<string, std::function<void(string, string)>> subscriptions;
+    std::unordered_map<string, MessageCallback> subscriptions;
+    // Only touched by the modification thread
+    TraceListener trace_listener;
+    OutgoingMessage birth;
+
+    std::vector<std::function<void()>> connect_listeners;
+    std::mutex connect_listeners_mutex;
+
+    std::atomic<bool> connected{false};
+
+    // Only touched by the publish thread, except for construction
+    unique_ptr<RingSpool> spool;
+    double spool_drain_rate;
+    // Reused for the topics of spooled messages, which are not null-terminated in the ring
+    string spool_topic;
+    // Messages dropped since the connection was lost
+    size_t dropped = 0;
+    // Identifies this client in the messages it traces
+    uint64_t trace_id = 0;
+    // Number of traced messages sent on each topic.  Only touched by the publish thread
+    std::unordered_map<string, uint64_t> trace_sequences;
+    // Reused for framing traced messages
+    string trace_buffer;
+    // Appended to by publishing threads and the network thread
+    unique_ptr<TrafficLog> recorder;
 
     std::unique_ptr<mosquitto, MosqDeleter> mosq = std::unique_ptr<mosquitto, MosqDeleter>(nullptr, MosqDeleter());
 
 public:
     /*
-    TODO: Doc
+    Connects to the broker and starts the publish and modification threads
+
+    Args:
+        host: host of the MQTT broker
+        port: port of the MQTT broker
+        options: connection options
 
     Throws:
         std::runtime_error if the MQTT broker connection fails
     */
-    MqttClientAsync(const string& host, const int port)
-        : host(host), port(port) {
+    MqttClientAsync(const string& host, const int port, const MqttClientOptions& options = MqttClientOptions())
+        : host(host), port(port), q(options.lane_weights.empty() ? std::vector<size_t>{1} : options.lane_weights),
+          max_in_flight(options.max_in_flight), subscribe_qos(options.subscribe_qos), spool_drain_rate(options.spool_drain_rate) {
+
+        if (options.persistent_session && options.client_id.empty()) {
+            std::string er = "Persistent sessions require a client id";
+            spdlog::error(er);
+
+            throw std::runtime_error(er);
+        }
 
         mosquitto_lib_init();
 
-        // TODO: Make these optional arguments
-        int keepalive = 20;
-        bool clean_session = true;
+        // 23 characters, the longest client id every MQTT 3.1 broker accepts
+        string client_id = options.client_id;
+        if (client_id.empty()) {
+            client_id = "vizier-0000000000000000";
+            vizier::random_id(&client_id[7], 16);
+        }
+
+        this->trace_id = vizier::id_engine()();
 
-        mosq = std::unique_ptr<mosquitto, MosqDeleter>(mosquitto_new(("mqtt_client_async" + vizier::random_string(64, vizier::rand_char)).c_str(), clean_session, this), MosqDeleter());
+        mosq = std::unique_ptr<mosquitto, MosqDeleter>(mosquitto_new(client_id.c_str(), !options.persistent_session, this), MosqDeleter());
 
         if (mosq == nullptr) {
             std::string er = "Could not allocate memory for Mosquitto MQTT client";
@@ -80,19 +311,50 @@ public:
             throw std::runtime_error(er);
         }
 
-        if (mosquitto_connect_bind(&(*mosq), host.c_str(), port, keepalive, NULL)) {
+        if (!options.spool_path.empty()) {
+            // Throws if the file cannot be mapped
+            this->spool = std::make_unique<RingSpool>(options.spool_path, options.spool_capacity);
+
+            if (!this->spool->empty()) {
+                spdlog::info("Found {0} spooled messages in {1}", this->spool->size(), options.spool_path);
+            }
+        }
+
+        if (!options.record_path.empty()) {
+            // Throws if the file cannot be mapped
+            this->recorder = std::make_unique<TrafficLog>(options.record_path, options.record_capacity);
+            spdlog::info("Recording traffic to {0}", options.record_path);
+        }
+
+        // The will has to be registered before connecting
+        if (!options.will_topic.empty()) {
+            mosquitto_will_set(&(*mosq), options.will_topic.c_str(), options.will_payload.length(), options.will_payload.c_str(), 0, options.will_retain);
+        }
+
+        mosquitto_reconnect_delay_set(&(*mosq), options.reconnect_delay, options.reconnect_delay_max, true);
+
+        if (options.connect_async) {
+            // Failures are retried by mosquitto's network thread
+            if (mosquitto_connect_bind_async(&(*mosq), host.c_str(), port, options.keepalive, NULL)) {
+                spdlog::warn("MQTT broker at host {0} port {1} is unreachable.  Retrying in the background", host, port);
+            } else {
+                spdlog::info("Connecting to MQTT broker at host: {0}, port: {1}", host, port);
+            }
+        } else if (mosquitto_connect_bind(&(*mosq), host.c_str(), port, options.keepalive, NULL)) {
             // Destroy memory that we allocated so far
             mosquitto_lib_cleanup();
 
             spdlog::error("Unable to connect to MQTT broker at host {0} port {1}", host, port);
             throw std::runtime_error("Unable to connect to MQTT broker");
+        } else {
+            spdlog::info("Connected to MQTT broker at host: {0}, port: {1}", host, port);
         }
 
-        spdlog::info("Connected to MQTT broker at host: {0}, port: {1}", host, port);
-
         //  Set message callback and start the loop!
         mosquitto_message_callback_set(&(*mosq), &MqttClientAsync::message_callback_static);
-        mosquitto_connect_callback_set(&(*mosq), &MqttClientAsync::reconnect_callback_static);
+        mosquitto_connect_with_flags_callback_set(&(*mosq), &MqttClientAsync::reconnect_callback_static);
+        mosquitto_disconnect_callback_set(&(*mosq), &MqttClientAsync::disconnect_callback_static);
+        mosquitto_publish_callback_set(&(*mosq), &MqttClientAsync::publish_callback_static);
         mosquitto_loop_start(&(*mosq));
 
         this->publish_thread = std::thread(&MqttClientAsync::publish_loop, this);
@@ -113,15 +375,17 @@ public:
     TODO: Doc
     */
     ~MqttClientAsync() {
-        //  Enqueue poison pill for modifications thread
-        this->q.enqueue(this->empty);
+        //  Enqueue poison pill for publication thread.  Messages queued before it are still sent
+        this->q.enqueue(0, OutgoingMessage());
 
         if (this->publish_thread.joinable()) {
             this->publish_thread.join();
         }
 
         //  Enqueue poison pill for modifications thread
-        this->modifications.enqueue(NULL);
+        this->events.produce([](Event& event) {
+            event.type = Event::Type::STOP;
+        });
 
         if (this->modification_thread.joinable()) {
             this->modification_thread.join();
@@ -141,23 +405,35 @@ public:
     Returns:
         A boolean indicating if the subscription was successful
     */
-    bool subscribe_with_callback(const string& topic, const std::function<void(string, string)>& f) {
-        auto prom = std::make_shared<std::promise<bool>>();
-        auto mod = [this, topic, f, prom]() {
-            //  Can move b.c. don't care about f anymore, and we copied it to the function
-            this->subscriptions[topic] = std::move(f);
-            //  Struct, ?, topic string, QOS
-            mosquitto_subscribe(&(*this->mosq), NULL, topic.c_str(), 0);
-
-            prom->set_value(true);
-        };
+    bool subscribe_with_callback(const string& topic, MessageCallback f) {
+        // The caller blocks until the subscription is made, so the promise can live on its stack
+        std::promise<bool> prom;
+        auto fut = prom.get_future();
+
+        this->events.produce([&](Event& event) {
+            event.type = Event::Type::SUBSCRIBE;
+            event.topic = topic;
+            event.callback = std::move(f);
+            event.done = &prom;
+        });
 
-        this->modifications.enqueue(std::move(mod));
+        return fut.get();
+    }
 
-        auto fut = prom->get_future();
-        fut.wait();
+    /*
+    Version of subscribe_with_callback that does not wait for the subscription to be made.  Subscriptions are made in the order they
+    are requested, so many can be issued at once and then waited for by making the last one with subscribe_with_callback.  Thread safe
 
-        return fut.get();
+    Args:
+        topic: see subscribe_with_callback
+        f: see subscribe_with_callback
+    */
+    void async_subscribe_with_callback(const string& topic, MessageCallback f) {
+        this->events.produce([&](Event& event) {
+            event.type = Event::Type::SUBSCRIBE;
+            event.topic = topic;
+            event.callback = std::move(f);
+        });
     }
 
     /*
@@ -172,8 +448,8 @@ public:
     optional<shared_ptr<ThreadSafeQueue<string>>> subscribe(const string& topic) {
         shared_ptr<ThreadSafeQueue<string>> q_ptr = std::make_shared<ThreadSafeQueue<string>>();
 
-        auto f = [q_ptr](string t, string msg) {
-            q_ptr->enqueue(msg);
+        auto f = [q_ptr](const string& t, string&& msg) {
+            q_ptr->enqueue(std::move(msg));
         };
 
         bool ok = this->subscribe_with_callback(topic, std::move(f));
@@ -195,20 +471,29 @@ public:
         A bool indicating if the unsubscription was successful
     */
     bool unsubscribe(const string& topic) {
-        auto prom = std::make_shared<std::promise<bool>>();
-        auto mod = [this, topic, prom]() {
-            this->subscriptions.erase(topic.c_str());
-            mosquitto_unsubscribe(&(*this->mosq), NULL, topic.c_str());
+        std::promise<bool> prom;
+        auto fut = prom.get_future();
 
-            prom->set_value(true);
-        };
+        this->events.produce([&](Event& event) {
+            event.type = Event::Type::UNSUBSCRIBE;
+            event.topic = topic;
+            event.done = &prom;
+        });
 
-        this->modifications.enqueue(std::move(mod));
+        return fut.get();
+    }
 
-        auto fut = prom->get_future();
-        fut.wait();
+    /*
+    Version of unsubscribe that does not wait for the unsubscription to be made.  Thread safe
 
-        return fut.get();
+    Args:
+        topic: topic from which the MQTT client unsubscribes
+    */
+    void async_unsubscribe(const string& topic) {
+        this->events.produce([&](Event& event) {
+            event.type = Event::Type::UNSUBSCRIBE;
+            event.topic = topic;
+        });
     }
 
     /*  
@@ -223,18 +508,296 @@ public:
     }
 
     void async_publish(const string& topic, string&& message) {
-        std::pair<string, string> data = {topic, message};
+        this->enqueue_publish(topic, std::move(message), std::nullopt, std::nullopt);
+    }
 
-        if (data == this->empty) {
-            spdlog::warn("Cannot publish empty message");
-            return;
+    /*
+    Version of async_publish that overrides the priority registered for the topic for this message only.  Thread safe
+
+    Args:
+        topic: topic on which the message is published
+        message: message to be published on the topic
+        priority: lane the message waits in
+    */
+    void async_publish(const string& topic, string&& message, const Priority priority) {
+        this->enqueue_publish(topic, std::move(message), std::nullopt, priority);
+    }
+
+    /*
+    Version of async_publish that overrides the options registered for the topic for this message only.  Thread safe
+
+    Args:
+        topic: topic on which the message is published
+        message: message to be published on the topic
+        options: options applied to this message
+    */
+    void async_publish(const string& topic, string&& message, const PublishOptions& options) {
+        this->enqueue_publish(topic, std::move(message), options, std::nullopt);
+    }
+
+    /*
+    Publishes the pieces of a large message without holding up other messages.  A piece is handed to mosquitto only once the ones
+    before it have been written to the socket, and messages published meanwhile go ahead of the remaining pieces.  Pieces are dropped
+    if the connection is lost.  Thread safe
+
+    Args:
+        topic: topic on which the pieces are published
+        pieces: pieces, published in order
+        options: options applied to every piece, instead of the options registered for the topic
+    */
+    void async_publish_bulk(const string& topic, std::vector<string>&& pieces, const optional<PublishOptions>& options = std::nullopt) {
+        const size_t lane = this->lane(topic, options);
+
+        for (string& piece : pieces) {
+            OutgoingMessage message{topic, std::move(piece), options};
+            message.bulk = true;
+            this->q.enqueue(lane, std::move(message));
         }
+    }
+
+    /*
+    Sets the options applied to every message subsequently published on a topic.  Thread safe
+
+    Args:
+        topic: topic to which the options apply
+        options: options applied on the publish thread
+    */
+    void set_publish_options(const string& topic, const PublishOptions& options) {
+        std::lock_guard<std::mutex> lock(this->topics_mutex);
+        TopicState& state = this->topics[topic];
+
+        state.options = options;
+        state.options.burst = std::max<size_t>(state.options.burst, 1);
+        state.options.decimation = std::max<size_t>(state.options.decimation, 1);
+        state.tokens = state.options.burst;
+        state.refilled = std::chrono::steady_clock::now();
+    }
+
+    /*
+    Forgets the options of a topic, so that its messages are sent as they are.  A conflated message still waiting is dropped.  Thread safe
+
+    Args:
+        topic: topic whose options to clear
+    */
+    void clear_publish_options(const string& topic) {
+        std::lock_guard<std::mutex> lock(this->topics_mutex);
+        this->topics.erase(topic);
+    }
+
+    /*
+    Registers a preset dictionary that incoming compressed messages may refer to.  Thread safe
+
+    Args:
+        dictionary: dictionary shared with the publishers
+
+    Returns:
+        The identifier of the dictionary
+    */
+    uint32_t add_compression_dictionary(std::shared_ptr<const string> dictionary) {
+        return this->dictionaries.add(std::move(dictionary));
+    }
+
+    /*
+    Returns:
+        True if the client is connected to the broker, as far as it knows.  Thread safe
+    */
+    bool is_connected() const {
+        return this->connected;
+    }
+
+    /*
+    Registers a function called whenever the client (re)connects to the broker, after the resubscriptions have been queued.  Called on
+    mosquitto's network thread, so it must return quickly and must not wait for subscriptions or messages.  Thread safe
+
+    Args:
+        listener: function to call
+    */
+    void add_connect_listener(std::function<void()> listener) {
+        std::lock_guard<std::mutex> lock(this->connect_listeners_mutex);
+        this->connect_listeners.push_back(std::move(listener));
+    }
 
-        // We can just move this in b.c. we don't care about dt in this scope anymore
-        q.enqueue(std::move(data));
+    /*
+    Sets the function called with the timestamps of every traced message on a subscribed topic.  Called on the modification thread.
+    Once this returns, the previous listener is no longer called.  Thread safe
+
+    Args:
+        listener: function to call, or nullptr for none
+    */
+    void set_trace_listener(TraceListener listener) {
+        std::promise<bool> prom;
+        auto fut = prom.get_future();
+
+        this->events.produce([&](Event& event) {
+            event.type = Event::Type::TRACE;
+            event.listener = std::move(listener);
+            event.done = &prom;
+        });
+
+        fut.get();
+    }
+
+    /*
+    Sets the birth message, the counterpart of the last will: published whenever the client (re)connects, right after its subscriptions
+    have been restored, so that a retained status overwrites the will the broker may have published meanwhile.  Published at once if
+    the client is already connected.  Thread safe
+
+    Args:
+        topic: topic of the message.  Empty for no birth message
+        payload: the message
+        options: options of the message, e.g. to retain it
+    */
+    void set_birth(const string& topic, const string& payload, const PublishOptions& options = PublishOptions()) {
+        std::promise<bool> prom;
+        auto fut = prom.get_future();
+
+        this->events.produce([&](Event& event) {
+            event.type = Event::Type::BIRTH;
+            event.topic = topic;
+            event.payload = payload;
+            event.options = options;
+            event.done = &prom;
+        });
+
+        fut.get();
+    }
+
+    /*
+    Waits until the modification thread has handled everything queued before the call.  Once the client is connected, that includes
+    restoring the subscriptions and publishing the birth message.  Thread safe
+    */
+    void flush() {
+        std::promise<bool> prom;
+        auto fut = prom.get_future();
+
+        this->events.produce([&](Event& event) {
+            event.type = Event::Type::FLUSH;
+            event.done = &prom;
+        });
+
+        fut.get();
+    }
+
+    /*
+    Hands a message to the callback of its topic as if it had arrived from the broker, e.g. to replay recorded traffic.  Dropped if the
+    topic is not subscribed to.  Not recorded.  Thread safe
+
+    Args:
+        topic: topic of the message
+        payload: message, uncompressed
+    */
+    void inject(const string& topic, const std::string_view payload) {
+        this->events.produce([&](Event& event) {
+            event.type = Event::Type::MESSAGE;
+            event.topic.assign(topic);
+            event.payload.assign(payload.data(), payload.size());
+            event.traced = false;
+        });
+    }
+
+    /*
+    Returns:
+        The number of messages the traffic log had no room for, or 0 if the client is not recording
+    */
+    size_t record_dropped() const {
+        return this->recorder ? this->recorder->dropped() : 0;
     }
 
 private:
+    /*
+    Returns:
+        The lane of messages on a topic: that of the options given, or else of the options registered for the topic
+    */
+    size_t lane(const string& topic, const optional<PublishOptions>& options) {
+        if (options) {
+            return static_cast<size_t>(options->priority);
+        }
+
+        std::lock_guard<std::mutex> lock(this->topics_mutex);
+        auto it = this->topics.find(topic);
+
+        return static_cast<size_t>(it != this->topics.end() ? it->second.options.priority : Priority::NORMAL);
+    }
+
+    void enqueue_publish(const string& topic, string&& message, optional<PublishOptions> options, const optional<Priority> priority) {
+        if (topic.empty() && message.empty()) {
+            VIZIER_LOG_WARN_LIMITED("Cannot publish empty message");
+            return;
+        }
+
+        if (this->recorder) {
+            this->recorder->append(TrafficDirection::PUBLISHED, topic, message);
+        }
+
+        size_t lane = static_cast<size_t>(priority ? priority.value() : options ? options->priority : Priority::NORMAL);
+        bool traced = options && options->trace;
+
+        // Decimation and conflation happen here, so that dropped and superseded messages never occupy the queue
+        if (!options) {
+            std::unique_lock<std::mutex> lock(this->topics_mutex);
+            auto it = this->topics.find(topic);
+
+            if (it != this->topics.end()) {
+                TopicState& state = it->second;
+
+                if (!priority) {
+                    lane = static_cast<size_t>(state.options.priority);
+                }
+
+                traced = state.options.trace;
+
+                if (state.submitted++ % state.options.decimation != 0) {
+                    return;
+                }
+
+                if (state.options.conflate) {
+                    state.pending = std::move(message);
+
+                    if (state.scheduled) {
+                        return;
+                    }
+
+                    state.scheduled = true;
+                    lock.unlock();
+
+                    q.enqueue(lane, OutgoingMessage{topic, string(), std::nullopt, true});
+                    return;
+                }
+            }
+        }
+
+        // We can just move this in b.c. we don't care about the message in this scope anymore
+        OutgoingMessage outgoing{topic, std::move(message), std::move(options)};
+        if (traced) {
+            outgoing.enqueued = trace_now();
+        }
+
+        q.enqueue(lane, std::move(outgoing));
+    }
+
+    /*
+    Refills a topic's token bucket and takes a token from it if one is available.  Must be called with topics_mutex held
+
+    Returns:
+        True if the message may be sent now
+    */
+    static bool take_token(TopicState& state, const std::chrono::steady_clock::time_point& now) {
+        if (state.options.max_rate <= 0) {
+            return true;
+        }
+
+        double elapsed = std::chrono::duration<double>(now - state.refilled).count();
+        state.tokens = std::min<double>(state.options.burst, state.tokens + elapsed * state.options.max_rate);
+        state.refilled = now;
+
+        if (state.tokens < 1) {
+            return false;
+        }
+
+        state.tokens -= 1;
+        return true;
+    }
+
     /*  
     Callback for handling MQTT reconnection messages.  The subscriptions are not preserved by the server if it dies, so the client resubscribes to any existing
     topics on reconnect.
@@ -242,18 +805,27 @@ private:
     Args:
         mosq: pointer to Mosquitto MQTT client
         rc: int indicating success of connection.
+        flags: CONNACK flags.  Bit 0 is set if the broker kept the client's session
     */
-    void reconnect_callback(struct mosquitto* mosq, const int rc) {
+    void reconnect_callback(struct mosquitto* mosq, const int rc, const int flags) {
         spdlog::info("Connected to broker with code {0}", rc);
 
-        auto mod = [this] {
-            for (const auto& sub : this->subscriptions) {
-                spdlog::info("Resubscribing to topic {0}", sub.first);
-                mosquitto_subscribe(&(*this->mosq), NULL, sub.first.c_str(), 0);
-            }
-        };
+        if (rc != 0) {
+            return;
+        }
+
+        this->connected = true;
+        this->reset_window();
 
-        this->modifications.enqueue(std::move(mod));
+        this->events.produce([flags](Event& event) {
+            event.type = Event::Type::RESUBSCRIBE;
+            event.session_present = (flags & 1) != 0;
+        });
+
+        std::lock_guard<std::mutex> lock(this->connect_listeners_mutex);
+        for (const auto& listener : this->connect_listeners) {
+            listener();
+        }
     }
 
     /* 
@@ -264,9 +836,126 @@ private:
         mosq: c-implemented MQTT client
         userdata: always "this" passed in
         rc: indicates success of connection
+        flags: CONNACK flags
+    */
+    static void reconnect_callback_static(struct mosquitto* mosq, void* userdata, const int rc, const int flags) {
+        static_cast<MqttClientAsync*>(userdata)->reconnect_callback(mosq, rc, flags);
+    }
+
+    /*
+    Static callback to be passed to C-implemented MQTT client.  Is called when the connection to the broker is lost or closed
+
+    Args:
+        mosq: c-implemented MQTT client
+        userdata: always "this" passed in
+        rc: zero if the client disconnected on purpose
+    */
+    static void disconnect_callback_static(struct mosquitto* mosq, void* userdata, const int rc) {
+        auto client = static_cast<MqttClientAsync*>(userdata);
+        client->connected = false;
+
+        // Bulk pieces in flight are lost along with the connection
+        {
+            std::lock_guard<std::mutex> lock(client->bulk_mutex);
+            client->bulk_in_flight.clear();
+        }
+
+        client->reset_window();
+
+        spdlog::warn("Disconnected from broker with code {0}", rc);
+    }
+
+    /*
+    Static callback to be passed to C-implemented MQTT client.  Is called once a message has been written to the socket, for QoS 0
+
+    Args:
+        mosq: c-implemented MQTT client
+        userdata: always "this" passed in
+        mid: id of the message
     */
-    static void reconnect_callback_static(struct mosquitto* mosq, void* userdata, const int rc) {
-        static_cast<MqttClientAsync*>(userdata)->reconnect_callback(mosq, rc);
+    static void publish_callback_static(struct mosquitto* mosq, void* userdata, const int mid) {
+        auto client = static_cast<MqttClientAsync*>(userdata);
+
+        {
+            std::lock_guard<std::mutex> lock(client->window_mutex);
+
+            // Messages resent after a reconnect were forgotten when the window was reset
+            if (client->in_flight > 0) {
+                --client->in_flight;
+            }
+        }
+        client->window_cv.notify_one();
+
+        std::unique_lock<std::mutex> lock(client->bulk_mutex);
+        if (client->bulk_in_flight.erase(mid) == 0) {
+            return;
+        }
+        lock.unlock();
+
+        OutgoingMessage wake;
+        wake.wake = true;
+        client->q.enqueue(0, std::move(wake));
+    }
+
+    /*
+    Forgets the messages in flight, which mosquitto no longer reports once the connection is lost.  Called from the network thread
+    */
+    void reset_window() {
+        {
+            std::lock_guard<std::mutex> lock(this->window_mutex);
+            this->in_flight = 0;
+        }
+        this->window_cv.notify_one();
+    }
+
+    /*
+    Waits for room in the window of messages in flight, for at most until.  The window only applies while connected, as mosquitto
+    reports nothing otherwise.  Only called from the publish thread
+
+    Returns:
+        True if there is room
+    */
+    bool wait_for_window(const optional<std::chrono::steady_clock::time_point>& until) {
+        if (this->max_in_flight == 0) {
+            return true;
+        }
+
+        // Checked again every so often, as a lost connection does not wake us
+        auto limit = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+        if (until && until.value() < limit) {
+            limit = until.value();
+        }
+
+        std::unique_lock<std::mutex> lock(this->window_mutex);
+        return this->window_cv.wait_until(lock, limit, [this]() {
+            return this->in_flight < this->max_in_flight || !this->connected;
+        });
+    }
+
+    /*
+    Hands a message to mosquitto, counting it against the window.  Only called from the publish thread
+
+    Returns:
+        The return code of mosquitto_publish
+    */
+    int send(int* mid, const char* topic, const size_t length, const void* payload, const int qos, const bool retain) {
+        // Counted before the network thread can report it written
+        {
+            std::lock_guard<std::mutex> lock(this->window_mutex);
+            ++this->in_flight;
+        }
+
+        int rc = mosquitto_publish(&(*mosq), mid, topic, length, payload, qos, retain);
+
+        if (rc != MOSQ_ERR_SUCCESS) {
+            std::lock_guard<std::mutex> lock(this->window_mutex);
+
+            if (this->in_flight > 0) {
+                --this->in_flight;
+            }
+        }
+
+        return rc;
     }
 
     /* 
@@ -277,18 +966,45 @@ private:
         message: message on received
     */
     void message_callback(const mosquitto* mosq, const mosquitto_message* message) {
-        // I'm not thrilled that we essentially copy the message here, but the issue is that we may have to anyway, since we're
-        // delaying the processing of the message.  So we have to copy it eventually anyway.  Thus, we might as well just do it here.
-        string topic((char*) message->topic);
-        string payload((char*) message->payload);
-
-        auto mod = [this, topic = std::move(topic), payload = std::move(payload)] {
-            if (this->subscriptions.find(topic) != this->subscriptions.end()) {
-                this->subscriptions[topic](std::move(topic), std::move(payload));
+        // Mosquitto frees the message once we return, so it is copied into a slot.  The slot's topic is reused in place; the payload is
+        // handed over to the subscriber's callback, so it is the one allocation left per message
+        bool ok = true;
+
+        this->events.produce([&](Event& event) {
+            event.type = Event::Type::MESSAGE;
+            event.topic.assign(message->topic);
+
+            std::string_view payload((char*) message->payload, message->payloadlen);
+
+            // The trace header wraps the payload as it was sent, compressed or not
+            auto traced = parse_trace_frame(payload, event.trace);
+            event.traced = bool(traced);
+
+            if (traced) {
+                event.trace.received = trace_now();
+                payload = traced.value();
             }
-        };
 
-        this->modifications.enqueue(std::move(mod));
+            // Compressed payloads are decoded here, so the modification thread and callbacks only ever see the original message
+            if (is_compressed(payload.data(), payload.size())) {
+                ok = decompress(payload.data(), payload.size(), this->dictionaries, event.payload);
+
+                // Leave the slot for the modification thread to skip
+                if (!ok) {
+                    event.topic.clear();
+                }
+            } else {
+                event.payload.assign(payload.data(), payload.size());
+            }
+
+            if (ok && this->recorder) {
+                this->recorder->append(TrafficDirection::RECEIVED, event.topic, event.payload);
+            }
+        });
+
+        if (!ok) {
+            VIZIER_LOG_ERROR_LIMITED("Could not decompress message on topic {0}", message->topic);
+        }
     }
 
     /*  
@@ -305,29 +1021,403 @@ private:
 
     // Passed to a thread on construction.  Stopped when destructed.
     void modify_loop(void) {
-        while (true) {
-            auto mod = modifications.dequeue();
+        bool running = true;
+
+        while (running) {
+            this->events.consume([this, &running](Event& event) {
+                switch (event.type) {
+                    case Event::Type::MESSAGE: {
+                        auto it = this->subscriptions.find(event.topic);
+
+                        if (it != this->subscriptions.end()) {
+                            if (event.traced && this->trace_listener) {
+                                event.trace.dispatched = trace_now();
+                                this->trace_listener(event.topic, event.trace);
+                            }
+
+                            it->second(event.topic, std::move(event.payload));
+                        }
+                        break;
+                    }
+                    case Event::Type::SUBSCRIBE:
+                        //  Can move b.c. the slot doesn't need the callback anymore
+                        this->subscriptions[event.topic] = std::move(event.callback);
+                        //  Struct, ?, topic string, QOS
+                        if (mosquitto_subscribe(&(*this->mosq), NULL, event.topic.c_str(), this->subscribe_qos) != MOSQ_ERR_SUCCESS) {
+                            // Made on the next reconnect
+                            this->subscriptions_dirty = true;
+                        }
+                        if (event.done != nullptr) {
+                            event.done->set_value(true);
+                        }
+                        break;
+                    case Event::Type::UNSUBSCRIBE:
+                        this->subscriptions.erase(event.topic);
+                        if (mosquitto_unsubscribe(&(*this->mosq), NULL, event.topic.c_str()) != MOSQ_ERR_SUCCESS) {
+                            this->subscriptions_dirty = true;
+                        }
+                        if (event.done != nullptr) {
+                            event.done->set_value(true);
+                        }
+                        break;
+                    case Event::Type::RESUBSCRIBE:
+                        if (event.session_present && !this->subscriptions_dirty) {
+                            spdlog::info("Broker kept the session.  Not resubscribing");
+                        } else {
+                            this->resubscribe();
+                        }
+
+                        // Behind the subscriptions in mosquitto's queue, so that they are in place once the birth message is seen
+                        this->publish_birth();
+                        break;
+                    case Event::Type::BIRTH:
+                        this->birth = OutgoingMessage{std::move(event.topic), std::move(event.payload), std::move(event.options)};
+                        if (this->connected) {
+                            this->publish_birth();
+                        }
+                        event.done->set_value(true);
+                        break;
+                    case Event::Type::TRACE:
+                        this->trace_listener = std::move(event.listener);
+                        event.done->set_value(true);
+                        break;
+                    case Event::Type::FLUSH:
+                        event.done->set_value(true);
+                        break;
+                    case Event::Type::STOP:
+                        spdlog::info("Stopping modification thread");
+                        running = false;
+                        break;
+                }
+
+                // A moved-from callback is unspecified, so clear it rather than keep whatever it holds
+                event.callback = nullptr;
+                event.listener = nullptr;
+                event.options.reset();
+                event.done = nullptr;
+            });
+        }
+    }
 
-            if (mod == NULL) {
-                spdlog::info("Stopping modification thread");
-                break;
-            }
+    /*
+    Publishes the birth message, if there is one.  Only called from the modification thread
+    */
+    void publish_birth() {
+        if (!this->birth.topic.empty()) {
+            this->enqueue_publish(this->birth.topic, string(this->birth.payload), this->birth.options, std::nullopt);
+        }
+    }
+
+    /*
+    Restores every subscription after a reconnect, packing as many topics into each SUBSCRIBE packet as allowed.  Only called from
+    the modification thread
+    */
+    void resubscribe() {
+        spdlog::info("Resubscribing to {0} topics", this->subscriptions.size());
 
-            mod();
+        std::vector<char*> batch;
+        batch.reserve(std::min(this->subscriptions.size(), SUBSCRIBE_BATCH));
+        bool ok = true;
+
+        for (auto it = this->subscriptions.begin(); it != this->subscriptions.end();) {
+            // mosquitto does not modify the topics, despite the signature
+            batch.push_back(const_cast<char*>(it->first.c_str()));
+            ++it;
+
+            if (batch.size() == SUBSCRIBE_BATCH || it == this->subscriptions.end()) {
+                ok = ok && mosquitto_subscribe_multiple(&(*this->mosq), NULL, batch.size(), batch.data(), this->subscribe_qos, 0, NULL) == MOSQ_ERR_SUCCESS;
+                batch.clear();
+            }
         }
+
+        this->subscriptions_dirty = !ok;
     }
 
-    // Passed to a thread when the class is initialized.  Handles publication of messages from queue.  Always publishes with QoS 0
+    // Passed to a thread when the class is initialized.  Handles publication of messages from queue
     void publish_loop(void) {
+        // Conflated topics held back by their rate limit, with the time at which they have a token again
+        std::vector<std::pair<std::chrono::steady_clock::time_point, string>> deferred;
+        // When the next spooled message may be sent
+        auto next_drain = std::chrono::steady_clock::now();
+        // Bulk pieces waiting for room in the window
+        std::deque<OutgoingMessage> bulk;
+
         while (true) {
-            auto message = q.dequeue();
+            optional<OutgoingMessage> message;
+            optional<std::chrono::steady_clock::time_point> wake;
+
+            if (!deferred.empty()) {
+                wake = std::min_element(deferred.begin(), deferred.end())->first;
+            }
+
+            // While disconnected, check back every so often for the connection to return
+            if (this->spool && !this->spool->empty()) {
+                auto drain = this->connected ? next_drain : std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+                wake = wake ? std::min(wake.value(), drain) : drain;
+            }
+
+            // Messages stay in the lanes until mosquitto has room for them, so that urgent ones can overtake the rest
+            if (!this->wait_for_window(wake)) {
+                // Still full
+            } else if (!wake) {
+                message = q.dequeue();
+            } else {
+                auto wait = std::chrono::ceil<std::chrono::milliseconds>(wake.value() - std::chrono::steady_clock::now());
+
+                if (wait.count() > 0) {
+                    message = q.dequeue(wait);
+                }
+            }
+
+            this->drain_spool(next_drain);
+
+            if (!deferred.empty()) {
+                auto now = std::chrono::steady_clock::now();
+                auto due = std::partition(deferred.begin(), deferred.end(), [&now](const auto& d) { return d.first > now; });
+
+                std::vector<string> due_topics;
+                for (auto it = due; it != deferred.end(); ++it) {
+                    due_topics.push_back(std::move(it->second));
+                }
+                deferred.erase(due, deferred.end());
+
+                for (auto& topic : due_topics) {
+                    OutgoingMessage retry{std::move(topic), string(), std::nullopt, true};
+                    this->publish_message(retry, deferred);
+                }
+            }
+
+            if (!message) {
+                continue;
+            }
+
+            if (message->bulk) {
+                bulk.push_back(std::move(message.value()));
+            } else if (message->wake) {
+                // Room in the window.  Handled below
+            } else if (message->topic.empty() && message->payload.empty() && !message->conflated) {
+                // The pill overtook what is left in the other lanes
+                while (auto rest = q.try_dequeue()) {
+                    if (!rest->bulk && !rest->wake && !(rest->topic.empty() && rest->payload.empty() && !rest->conflated)) {
+                        this->publish_message(rest.value(), deferred);
+                    }
+                }
 
-            if (message == this->empty) {
                 spdlog::info("Stopping publication thread");
                 break;
+            } else {
+                this->publish_message(message.value(), deferred);
+            }
+
+            this->send_bulk(bulk, deferred);
+        }
+    }
+
+    /*
+    Hands bulk pieces to mosquitto while there is room in the window.  Only called from the publish thread
+    */
+    void send_bulk(std::deque<OutgoingMessage>& bulk, std::vector<std::pair<std::chrono::steady_clock::time_point, string>>& deferred) {
+        while (!bulk.empty()) {
+            // Held across the publish, so that the network thread cannot report the piece written before it is in the window
+            std::lock_guard<std::mutex> lock(this->bulk_mutex);
+
+            if (this->bulk_in_flight.size() >= BULK_WINDOW) {
+                return;
+            }
+
+            int mid = 0;
+            if (this->publish_message(bulk.front(), deferred, &mid)) {
+                this->bulk_in_flight.insert(mid);
+            }
+
+            bulk.pop_front();
+        }
+    }
+
+    /*
+    Applies the topic's rate limit and options to a message and hands it to mosquitto.  Only called from the publish thread
+
+    Args:
+        message: message to publish
+        deferred: conflated topics waiting for a token.  The message's topic is added if it has to wait
+        mid: set to the id mosquitto gives the message, if it was handed over
+
+    Returns:
+        True if the message was handed to mosquitto
+    */
+    bool publish_message(OutgoingMessage& message, std::vector<std::pair<std::chrono::steady_clock::time_point, string>>& deferred, int* mid = nullptr) {
+        if (!message.options) {
+            std::lock_guard<std::mutex> lock(this->topics_mutex);
+            auto it = this->topics.find(message.topic);
+
+            if (it != this->topics.end()) {
+                TopicState& state = it->second;
+                auto now = std::chrono::steady_clock::now();
+
+                if (!take_token(state, now)) {
+                    if (message.conflated) {
+                        auto until_token = std::chrono::duration<double>((1 - state.tokens) / state.options.max_rate);
+                        deferred.emplace_back(now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(until_token), std::move(message.topic));
+                    }
+
+                    return false;
+                }
+
+                if (message.conflated) {
+                    state.scheduled = false;
+
+                    if (!state.pending) {
+                        return false;
+                    }
+
+                    message.payload = std::move(state.pending.value());
+                    state.pending.reset();
+                }
+
+                message.options = state.options;
+            } else if (message.conflated) {
+                // The topic's options were cleared, along with its pending message
+                return false;
+            }
+        }
+
+        optional<string> compressed;
+        if (message.options) {
+            compressed = compress(message.payload, message.options->compression);
+        }
+
+        if (compressed) {
+            message.payload = std::move(compressed.value());
+        } else if (is_compressed(message.payload.data(), message.payload.size())) {
+            // A payload sent as is that looks like a compression frame, e.g. a binary one.  Receivers would otherwise drop it
+            frame_uncompressed(message.payload);
+        }
+
+        if (message.options && message.options->trace) {
+            this->trace(message);
+        }
+
+        bool spooled = this->spool && message.options && message.options->spool;
+
+        // Spooled topics stay in order: while a backlog is waiting, new messages queue up behind it
+        if (spooled && (!this->connected || !this->spool->empty())) {
+            this->spool_message(message);
+            return false;
+        }
+
+        bool retain = message.options && message.options->retain;
+        int qos = message.options ? message.options->qos : 0;
+        int rc = this->send(mid, message.topic.c_str(), message.payload.length(), message.payload.c_str(), qos, retain);
+
+        if (rc != MOSQ_ERR_SUCCESS) {
+            if (spooled) {
+                this->spool_message(message);
+                return false;
             }
 
-            mosquitto_publish(&(*mosq), NULL, message.first.c_str(), message.second.length(), message.second.c_str(), 0, false);
+            if (this->dropped++ == 0) {
+                spdlog::warn("Could not publish on topic {0}: {1}.  Dropping messages until the connection is back", message.topic, mosquitto_strerror(rc));
+            }
+
+            return false;
+        }
+
+        if (this->dropped > 0) {
+            spdlog::warn("Dropped {0} messages while the broker was unreachable", this->dropped);
+            this->dropped = 0;
+        }
+
+        return true;
+    }
+
+    /*
+    Prefixes a message with its trace header, stamped with the current time as the time it is handed to the network.  Only called from
+    the publish thread
+    */
+    void trace(OutgoingMessage& message) {
+        TraceStamps stamps;
+        stamps.trace_id = this->trace_id;
+        stamps.sequence = this->trace_sequences[message.topic]++;
+        stamps.enqueued = message.enqueued;
+        stamps.published = trace_now();
+
+        encode_trace_frame(stamps, message.payload, this->trace_buffer);
+        std::swap(message.payload, this->trace_buffer);
+    }
+
+    /*
+    Appends a message that could not be sent to the spool.  Only called from the publish thread
+    */
+    void spool_message(const OutgoingMessage& message) {
+        const PublishOptions& options = message.options.value();
+        int64_t expires = 0;
+
+        if (options.spool_max_age.count() > 0) {
+            auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
+            expires = (now + options.spool_max_age).count();
+        }
+
+        if (!this->spool->push(message.topic, message.payload, expires, options.spool_evict, options.qos, options.retain)) {
+            VIZIER_LOG_WARN_LIMITED("Spool full.  Dropping message on topic {0}", message.topic);
+        }
+    }
+
+    /*
+    Sends spooled messages at the drain rate while connected.  Stale messages are dropped without counting against the rate.  Only
+    called from the publish thread
+
+    Args:
+        next_drain: when the next message may be sent.  Advanced for every message sent
+    */
+    void drain_spool(std::chrono::steady_clock::time_point& next_drain) {
+        if (!this->spool || !this->connected) {
+            return;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1 / this->spool_drain_rate));
+
+        // An idle spool does not save up a burst
+        if (next_drain + interval < now) {
+            next_drain = now;
+        }
+
+        auto wall = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        while (next_drain <= now) {
+            // The spool counts against the window like any other message
+            {
+                std::lock_guard<std::mutex> lock(this->window_mutex);
+
+                if (this->max_in_flight > 0 && this->in_flight >= this->max_in_flight) {
+                    return;
+                }
+            }
+
+            bool sent = false;
+            bool stale = false;
+
+            bool found = this->spool->peek([&](const std::string_view topic, const std::string_view payload, const int64_t expires, const int qos,
+                const bool retain) {
+                if (expires != 0 && expires < wall) {
+                    stale = true;
+                    return;
+                }
+
+                this->spool_topic.assign(topic.data(), topic.size());
+                sent = this->send(NULL, this->spool_topic.c_str(), payload.size(), payload.data(), qos, retain) == MOSQ_ERR_SUCCESS;
+            });
+
+            // Lost the connection again.  The message stays at the front of the spool
+            if (!found || (!sent && !stale)) {
+                return;
+            }
+
+            this->spool->pop();
+
+            if (sent) {
+                next_drain += interval;
+            }
         }
     }
 };
@@ -0,0 +1,329 @@
+#ifndef VIZIER_SHMRING_H
+#define VIZIER_SHMRING_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+/*
+Location of a payload in a shared-memory ring
+*/
+struct ShmSlice {
+    // Position of the payload in the stream of bytes written to the ring.  Its offset in the ring is position modulo the capacity
+    uint64_t position = 0;
+    uint32_t length = 0;
+    // Number of payloads written to the ring before this one, so that readers can tell how many they missed
+    uint64_t sequence = 0;
+};
+
+namespace shmring_detail {
+    /*
+    Layout of the start of a segment
+    */
+    struct Header {
+        char magic[8];
+        uint64_t capacity;
+        // Bytes written to the ring so far.  Only grows
+        std::atomic<uint64_t> written;
+        // Bytes before this position may have been overwritten.  Raised by the writer before it overwrites them
+        std::atomic<uint64_t> overwritten;
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared-memory rings need lock-free 64-bit atomics");
+
+    constexpr char MAGIC[8] = {'V', 'Z', 'S', 'H', 'R', 'N', 'G', '1'};
+}
+
+/*
+Single-writer ring of payloads in a POSIX shared-memory segment, for handing large payloads to processes on the same host without
+copying them through sockets.  The writer copies each payload into the ring once and passes its ShmSlice to readers by other means;
+readers map the segment read-only and copy the payload out.
+
+Payloads are never split across the end of the ring.  The ring does not wait for readers: a payload that has been overwritten by the
+time a reader gets to it is reported as lost.  The segment is unlinked when the writer is destroyed.  Thread safe
+*/
+class ShmRing {
+private:
+    std::string segment;
+    char* map = nullptr;
+    size_t map_size = 0;
+    shmring_detail::Header* header = nullptr;
+    char* data = nullptr;
+
+    uint64_t sequence = 0;
+    std::mutex m;
+
+public:
+    /*
+    Creates a segment, replacing any segment with the same name
+
+    Args:
+        name: name of the segment, starting with a slash and containing no other, e.g. "/vizier-frames"
+        capacity: number of bytes available for payloads
+
+    Throws:
+        std::runtime_error if the segment cannot be created or mapped
+    */
+    ShmRing(const std::string& name, const size_t capacity) : segment(name) {
+        ::shm_unlink(name.c_str());
+
+        int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Could not create shared-memory segment " + name);
+        }
+
+        this->map_size = sizeof(shmring_detail::Header) + capacity;
+
+        if (::ftruncate(fd, this->map_size) != 0) {
+            ::close(fd);
+            ::shm_unlink(name.c_str());
+            throw std::runtime_error("Could not size shared-memory segment " + name);
+        }
+
+        void* addr = ::mmap(nullptr, this->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (addr == MAP_FAILED) {
+            ::shm_unlink(name.c_str());
+            throw std::runtime_error("Could not map shared-memory segment " + name);
+        }
+
+        this->map = static_cast<char*>(addr);
+        this->data = this->map + sizeof(shmring_detail::Header);
+
+        // A fresh segment is zero-filled, which is a valid state for the atomics
+        this->header = reinterpret_cast<shmring_detail::Header*>(this->map);
+        this->header->capacity = capacity;
+        std::memcpy(this->header->magic, shmring_detail::MAGIC, sizeof(shmring_detail::MAGIC));
+    }
+
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    ~ShmRing() {
+        if (this->map != nullptr) {
+            ::munmap(this->map, this->map_size);
+            ::shm_unlink(this->segment.c_str());
+        }
+    }
+
+    /*
+    Copies a payload into the ring.  Thread safe
+
+    Returns:
+        Where readers find the payload, or nothing if it is larger than the ring
+    */
+    std::optional<ShmSlice> write(const std::string_view payload) {
+        std::lock_guard<std::mutex> lock(this->m);
+        const uint64_t capacity = this->header->capacity;
+
+        if (payload.size() > capacity) {
+            return std::nullopt;
+        }
+
+        uint64_t start = this->header->written.load(std::memory_order_relaxed);
+        uint64_t offset = start % capacity;
+
+        // Skip the rest of the ring rather than split the payload
+        if (capacity - offset < payload.size()) {
+            start += capacity - offset;
+            offset = 0;
+        }
+
+        const uint64_t end = start + payload.size();
+
+        // Readers check this after copying, so they notice if the bytes changed under them
+        if (end > capacity) {
+            this->header->overwritten.store(end - capacity, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        std::memcpy(this->data + offset, payload.data(), payload.size());
+        this->header->written.store(end, std::memory_order_release);
+
+        ShmSlice slice;
+        slice.position = start;
+        slice.length = static_cast<uint32_t>(payload.size());
+        slice.sequence = this->sequence++;
+
+        return slice;
+    }
+
+    const std::string& name() const {
+        return this->segment;
+    }
+
+    size_t capacity() const {
+        return this->header->capacity;
+    }
+};
+
+/*
+Read-only view of a ShmRing created by another process, or the same one.  Thread safe
+*/
+class ShmRingReader {
+private:
+    const char* map = nullptr;
+    size_t map_size = 0;
+    const shmring_detail::Header* header = nullptr;
+    const char* data = nullptr;
+
+public:
+    /*
+    Args:
+        name: name of the segment
+
+    Throws:
+        std::runtime_error if the segment does not exist or is not a ring
+    */
+    explicit ShmRingReader(const std::string& name) {
+        int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open shared-memory segment " + name);
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(shmring_detail::Header)) {
+            ::close(fd);
+            throw std::runtime_error("Shared-memory segment " + name + " is not a ring");
+        }
+
+        this->map_size = st.st_size;
+        void* addr = ::mmap(nullptr, this->map_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (addr == MAP_FAILED) {
+            throw std::runtime_error("Could not map shared-memory segment " + name);
+        }
+
+        this->map = static_cast<const char*>(addr);
+        this->header = reinterpret_cast<const shmring_detail::Header*>(this->map);
+        this->data = this->map + sizeof(shmring_detail::Header);
+
+        if (std::memcmp(this->header->magic, shmring_detail::MAGIC, sizeof(shmring_detail::MAGIC)) != 0
+            || this->header->capacity != this->map_size - sizeof(shmring_detail::Header)) {
+            ::munmap(const_cast<char*>(this->map), this->map_size);
+            throw std::runtime_error("Shared-memory segment " + name + " is not a ring");
+        }
+    }
+
+    ShmRingReader(const ShmRingReader&) = delete;
+    ShmRingReader& operator=(const ShmRingReader&) = delete;
+
+    ~ShmRingReader() {
+        if (this->map != nullptr) {
+            ::munmap(const_cast<char*>(this->map), this->map_size);
+        }
+    }
+
+    /*
+    Copies a payload out of the ring, reusing the capacity of out
+
+    Returns:
+        False if the payload is not in the ring, or was overwritten before or while it was copied.  out is then unspecified
+    */
+    bool read(const ShmSlice& slice, std::string& out) const {
+        const uint64_t capacity = this->header->capacity;
+        const uint64_t offset = slice.position % capacity;
+
+        if (slice.length > capacity - offset || this->header->written.load(std::memory_order_acquire) < slice.position + slice.length) {
+            return false;
+        }
+
+        if (this->header->overwritten.load(std::memory_order_acquire) > slice.position) {
+            return false;
+        }
+
+        out.assign(this->data + offset, slice.length);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return this->header->overwritten.load(std::memory_order_relaxed) <= slice.position;
+    }
+};
+
+/*
+Message standing in for a payload written to a shared-memory ring.  Starts with a NUL byte, so it cannot be mistaken for text or JSON
+*/
+struct ShmFrame {
+    // Host of the writer.  The segment is only reachable from there
+    std::string host;
+    std::string segment;
+    ShmSlice slice;
+};
+
+namespace shmring_detail {
+    // Distinct from the "\0VZ" prefix of compressed payloads
+    constexpr char FRAME_MAGIC[8] = {'\0', 'S', 'H', 'M', 'V', 'Z', '1', '\0'};
+    // Magic, position, sequence, length, host length, segment length
+    constexpr size_t FRAME_HEADER_SIZE = 8 + 8 + 8 + 4 + 2 + 2;
+}
+
+/*
+Returns:
+    True if a message looks like an encoded ShmFrame.  Cheap enough to check on every message
+*/
+inline bool is_shm_frame(const std::string_view message) {
+    return message.size() >= shmring_detail::FRAME_HEADER_SIZE
+        && std::memcmp(message.data(), shmring_detail::FRAME_MAGIC, sizeof(shmring_detail::FRAME_MAGIC)) == 0;
+}
+
+/*
+Encodes a frame into out, reusing its capacity.  Integers are in host byte order, as both ends share the host
+*/
+inline void encode_shm_frame(const std::string_view host, const std::string_view segment, const ShmSlice& slice, std::string& out) {
+    const uint16_t host_length = static_cast<uint16_t>(host.size());
+    const uint16_t segment_length = static_cast<uint16_t>(segment.size());
+
+    out.resize(shmring_detail::FRAME_HEADER_SIZE + host_length + segment_length);
+    char* p = &out[0];
+
+    std::memcpy(p, shmring_detail::FRAME_MAGIC, 8);
+    std::memcpy(p + 8, &slice.position, 8);
+    std::memcpy(p + 16, &slice.sequence, 8);
+    std::memcpy(p + 24, &slice.length, 4);
+    std::memcpy(p + 28, &host_length, 2);
+    std::memcpy(p + 30, &segment_length, 2);
+    std::memcpy(p + 32, host.data(), host_length);
+    std::memcpy(p + 32 + host_length, segment.data(), segment_length);
+}
+
+/*
+Returns:
+    The decoded frame, or nothing if the message is not a well-formed frame
+*/
+inline std::optional<ShmFrame> parse_shm_frame(const std::string_view message) {
+    if (!is_shm_frame(message)) {
+        return std::nullopt;
+    }
+
+    const char* p = message.data();
+    ShmFrame frame;
+    uint16_t host_length;
+    uint16_t segment_length;
+
+    std::memcpy(&frame.slice.position, p + 8, 8);
+    std::memcpy(&frame.slice.sequence, p + 16, 8);
+    std::memcpy(&frame.slice.length, p + 24, 4);
+    std::memcpy(&host_length, p + 28, 2);
+    std::memcpy(&segment_length, p + 30, 2);
+
+    if (message.size() != shmring_detail::FRAME_HEADER_SIZE + host_length + segment_length) {
+        return std::nullopt;
+    }
+
+    frame.host.assign(p + 32, host_length);
+    frame.segment.assign(p + 32 + host_length, segment_length);
+
+    return frame;
+}
+
+#endif
@@ -0,0 +1,86 @@
+#include "vizier/utils/shmring/shmring.h"
+#include <unistd.h>
+#include <string>
+#include "gtest/gtest.h"
+
+namespace {
+    std::string segment_name(const std::string& test) {
+        return "/vizier_shmring_test_" + test + "_" + std::to_string(getpid());
+    }
+}
+
+TEST(ShmRing, WriteAndRead) {
+    ShmRing ring(segment_name("rw"), 1024);
+    ShmRingReader reader(ring.name());
+
+    auto first = ring.write("first");
+    auto second = ring.write(std::string("sec\0nd", 6));
+    ASSERT_TRUE(bool(first));
+    ASSERT_TRUE(bool(second));
+    EXPECT_EQ(0, first->sequence);
+    EXPECT_EQ(1, second->sequence);
+
+    std::string out;
+    EXPECT_TRUE(reader.read(first.value(), out));
+    EXPECT_EQ("first", out);
+    EXPECT_TRUE(reader.read(second.value(), out));
+    EXPECT_EQ(std::string("sec\0nd", 6), out);
+}
+
+TEST(ShmRing, RejectsOversizedPayloads) {
+    ShmRing ring(segment_name("oversized"), 16);
+
+    EXPECT_FALSE(bool(ring.write(std::string(17, 'x'))));
+    EXPECT_TRUE(bool(ring.write(std::string(16, 'x'))));
+}
+
+TEST(ShmRing, DetectsOverwrittenPayloads) {
+    ShmRing ring(segment_name("overwritten"), 64);
+    ShmRingReader reader(ring.name());
+
+    auto old_slice = ring.write(std::string(40, 'a')).value();
+
+    // Does not fit behind the first payload, so it wraps to the start of the ring and overwrites it
+    auto new_slice = ring.write(std::string(40, 'b')).value();
+    EXPECT_EQ(64, new_slice.position);
+
+    std::string out;
+    EXPECT_FALSE(reader.read(old_slice, out));
+    EXPECT_TRUE(reader.read(new_slice, out));
+    EXPECT_EQ(std::string(40, 'b'), out);
+}
+
+TEST(ShmRing, ReaderRequiresSegment) {
+    EXPECT_THROW(ShmRingReader reader(segment_name("missing")), std::runtime_error);
+
+    std::string name;
+    {
+        ShmRing ring(segment_name("unlinked"), 64);
+        name = ring.name();
+    }
+
+    // Unlinked by the writer
+    EXPECT_THROW(ShmRingReader reader(name), std::runtime_error);
+}
+
+TEST(ShmFrame, RoundTrip) {
+    ShmSlice slice;
+    slice.position = 1ull << 40;
+    slice.length = 1920 * 1080 * 3;
+    slice.sequence = 7;
+
+    std::string encoded;
+    encode_shm_frame("robot", "/vizier-abc-0", slice, encoded);
+    EXPECT_TRUE(is_shm_frame(encoded));
+
+    auto frame = parse_shm_frame(encoded);
+    ASSERT_TRUE(bool(frame));
+    EXPECT_EQ("robot", frame->host);
+    EXPECT_EQ("/vizier-abc-0", frame->segment);
+    EXPECT_EQ(slice.position, frame->slice.position);
+    EXPECT_EQ(slice.length, frame->slice.length);
+    EXPECT_EQ(slice.sequence, frame->slice.sequence);
+
+    EXPECT_FALSE(is_shm_frame("{\"a\": 1}"));
+    EXPECT_FALSE(bool(parse_shm_frame(encoded.substr(0, encoded.size() - 1))));
+}
@@ -0,0 +1,121 @@
+#ifndef VIZIER_SLOTQUEUE_H
+#define VIZIER_SLOTQUEUE_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+Multi-producer, single-consumer FIFO of pre-allocated slots.  Slots are reused in place, so members such as strings keep their capacity
+from one use to the next and a steady stream of items causes no heap allocations.  Producers fill a slot and the consumer processes it
+where it lies, without moving it out.
+
+The queue only allocates when more items are outstanding than it has slots, in which case it doubles its capacity.
+*/
+template <class T>
+class SlotQueue {
+private:
+    // Slots are individually allocated so that growing the ring never moves a slot the consumer is working on
+    std::vector<std::unique_ptr<T>> slots;
+    size_t head = 0;
+    size_t count = 0;
+
+    std::mutex m;
+    std::condition_variable c;
+
+public:
+    /*
+    Args:
+        capacity: number of slots allocated up front.  Must be at least one
+    */
+    explicit SlotQueue(const size_t capacity) {
+        for (size_t i = 0; i < std::max<size_t>(capacity, 1); ++i) {
+            this->slots.push_back(std::make_unique<T>());
+        }
+    }
+
+    SlotQueue(const SlotQueue&) = delete;
+    SlotQueue& operator=(const SlotQueue&) = delete;
+
+    /*
+    Fills the next free slot and hands it to the consumer.  Thread safe
+
+    Args:
+        fill: called with the slot, which still holds whatever the last item to use it left behind
+    */
+    template <class F>
+    void produce(F&& fill) {
+        {
+            std::lock_guard<std::mutex> lock(this->m);
+
+            if (this->count == this->slots.size()) {
+                this->grow();
+            }
+
+            fill(*this->slots[(this->head + this->count) % this->slots.size()]);
+            ++this->count;
+        }
+
+        this->c.notify_one();
+    }
+
+    /*
+    Waits for the oldest item and processes it in place.  Must only be called from one thread at a time
+
+    Args:
+        process: called with the slot, without the queue's lock held, so producers can keep filling other slots meanwhile
+    */
+    template <class F>
+    void consume(F&& process) {
+        T* slot;
+
+        {
+            std::unique_lock<std::mutex> lock(this->m);
+
+            // Protects against spurious wake-ups
+            while (this->count == 0) {
+                this->c.wait(lock);
+            }
+
+            slot = this->slots[this->head].get();
+        }
+
+        process(*slot);
+
+        std::lock_guard<std::mutex> lock(this->m);
+        this->head = (this->head + 1) % this->slots.size();
+        --this->count;
+    }
+
+    /*
+    Returns:
+        The number of slots, used or not.  Thread safe
+    */
+    size_t capacity() {
+        std::lock_guard<std::mutex> lock(this->m);
+        return this->slots.size();
+    }
+
+private:
+    // Doubles the number of slots, keeping the occupied ones in order starting at index 0.  Called with the lock held
+    void grow() {
+        const size_t size = 2 * this->slots.size();
+        std::vector<std::unique_ptr<T>> grown;
+        grown.reserve(size);
+
+        for (size_t i = 0; i < this->slots.size(); ++i) {
+            grown.push_back(std::move(this->slots[(this->head + i) % this->slots.size()]));
+        }
+
+        while (grown.size() < size) {
+            grown.push_back(std::make_unique<T>());
+        }
+
+        this->slots = std::move(grown);
+        this->head = 0;
+    }
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include "vizier/utils/slotqueue/slotqueue.h"
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+
+TEST(SlotQueue, Fifo) {
+    SlotQueue<int> q(4);
+
+    for (int i = 0; i < 3; ++i) {
+        q.produce([i](int& slot) { slot = i; });
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        q.consume([i](int& slot) { EXPECT_EQ(i, slot); });
+    }
+}
+
+TEST(SlotQueue, ReusesSlotBuffers) {
+    SlotQueue<std::string> q(1);
+    const char* buffer = nullptr;
+
+    q.produce([](std::string& slot) { slot.assign(1000, 'a'); });
+    q.consume([&buffer](std::string& slot) { buffer = slot.data(); });
+
+    q.produce([](std::string& slot) { slot.assign(500, 'b'); });
+    q.consume([&buffer](std::string& slot) {
+        EXPECT_EQ(std::string(500, 'b'), slot);
+        EXPECT_EQ(buffer, slot.data());
+    });
+}
+
+TEST(SlotQueue, GrowsKeepingOrder) {
+    SlotQueue<int> q(2);
+
+    q.produce([](int& slot) { slot = 0; });
+    q.consume([](int& slot) { EXPECT_EQ(0, slot); });
+
+    // Wrap around before growing
+    for (int i = 1; i <= 5; ++i) {
+        q.produce([i](int& slot) { slot = i; });
+    }
+    EXPECT_EQ(8, q.capacity());
+
+    for (int i = 1; i <= 5; ++i) {
+        q.consume([i](int& slot) { EXPECT_EQ(i, slot); });
+    }
+}
+
+TEST(SlotQueue, ManyProducers) {
+    SlotQueue<int> q(16);
+    std::vector<std::thread> producers;
+
+    for (int p = 0; p < 4; ++p) {
+        producers.emplace_back([&q]() {
+            for (int i = 0; i < 1000; ++i) {
+                q.produce([](int& slot) { slot = 1; });
+            }
+        });
+    }
+
+    int sum = 0;
+    for (int i = 0; i < 4000; ++i) {
+        q.consume([&sum](int& slot) { sum += slot; });
+    }
+
+    for (auto& p : producers) {
+        p.join();
+    }
+
+    EXPECT_EQ(4000, sum);
+}
@@ -0,0 +1,280 @@
+#ifndef VIZIER_SPOOL_H
+#define VIZIER_SPOOL_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+/*
+Bounded FIFO of (topic, payload) messages, with the QoS and retain flag to send them with, stored in a memory-mapped ring file, so that a backlog lives in the page cache rather than on
+the heap.  The ring's state is kept in the file, so messages spooled before a crash are still there when the spool is reopened.
+
+Records are written back to back and never wrap around the end of the file; a record that does not fit before the end starts over at
+the beginning.  Thread safe.
+*/
+class RingSpool {
+private:
+    /*
+    Layout of the start of the file
+    */
+    struct Header {
+        char magic[8];
+        uint64_t capacity;
+        // Offset of the oldest record and of the next record to write, relative to the start of the ring
+        uint64_t head;
+        uint64_t tail;
+        uint64_t count;
+    };
+
+    /*
+    Layout of a record, followed by the topic and the payload and padded to a multiple of 8 bytes
+    */
+    struct Record {
+        // MQTT topics are at most 65535 bytes long
+        uint16_t topic_length;
+        uint8_t qos;
+        uint8_t retain;
+        uint32_t payload_length;
+        // Wall clock time in milliseconds after which the record is stale, or 0 if it never is
+        int64_t expires;
+    };
+
+    // Payload length marking that the rest of the ring is unused and the next record is at its beginning.  Longer than any MQTT payload
+    static constexpr uint32_t WRAP = UINT32_MAX;
+    // Changes with the layout of records, so that a file in an older layout is started afresh
+    static constexpr char MAGIC[8] = {'V', 'Z', 'S', 'P', 'O', 'O', 'L', '2'};
+
+    int fd = -1;
+    char* map = nullptr;
+    size_t map_size = 0;
+    Header* header = nullptr;
+    char* ring = nullptr;
+
+    std::mutex m;
+
+    static uint64_t record_size(const size_t topic_length, const size_t payload_length) {
+        return (sizeof(Record) + topic_length + payload_length + 7) & ~uint64_t(7);
+    }
+
+    // Offset of the record at offset, skipping to the beginning if the ring wraps there
+    uint64_t unwrap(const uint64_t offset) const {
+        if (this->header->capacity - offset < sizeof(Record)) {
+            return 0;
+        }
+
+        Record record;
+        std::memcpy(&record, this->ring + offset, sizeof(Record));
+        return (record.payload_length == WRAP) ? 0 : offset;
+    }
+
+    // Returns the offset at which a record of size bytes can be written, or capacity if it does not fit
+    uint64_t find_space(const uint64_t size) const {
+        const Header& h = *this->header;
+
+        if (h.count == 0) {
+            return (size <= h.capacity) ? 0 : h.capacity;
+        }
+
+        if (h.tail > h.head) {
+            if (h.capacity - h.tail >= size) {
+                return h.tail;
+            }
+
+            return (h.head >= size) ? 0 : h.capacity;
+        }
+
+        return (h.head - h.tail >= size) ? h.tail : h.capacity;
+    }
+
+    void pop_locked() {
+        Header& h = *this->header;
+        if (h.count == 0) {
+            return;
+        }
+
+        h.head = this->unwrap(h.head);
+
+        Record record;
+        std::memcpy(&record, this->ring + h.head, sizeof(Record));
+        h.head += record_size(record.topic_length, record.payload_length);
+
+        if (--h.count == 0) {
+            h.head = 0;
+            h.tail = 0;
+        }
+    }
+
+public:
+    /*
+    Opens or creates a spool file.  An existing file with the same capacity is reused along with the messages in it
+
+    Args:
+        path: path of the ring file
+        capacity: number of bytes available for records
+
+    Throws:
+        std::runtime_error if the file cannot be created or mapped
+    */
+    RingSpool(const std::string& path, const size_t capacity) {
+        this->fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (this->fd < 0) {
+            throw std::runtime_error("Could not open spool file " + path);
+        }
+
+        this->map_size = sizeof(Header) + capacity;
+
+        struct stat st;
+        bool reuse = (::fstat(this->fd, &st) == 0) && (static_cast<size_t>(st.st_size) == this->map_size);
+
+        if (!reuse && ::ftruncate(this->fd, this->map_size) != 0) {
+            ::close(this->fd);
+            throw std::runtime_error("Could not size spool file " + path);
+        }
+
+        void* addr = ::mmap(nullptr, this->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(this->fd);
+            throw std::runtime_error("Could not map spool file " + path);
+        }
+
+        this->map = static_cast<char*>(addr);
+        this->header = reinterpret_cast<Header*>(this->map);
+        this->ring = this->map + sizeof(Header);
+
+        Header& h = *this->header;
+        reuse = reuse && std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) == 0 && h.capacity == capacity && h.head <= capacity && h.tail <= capacity;
+
+        if (!reuse) {
+            std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+            h.capacity = capacity;
+            h.head = 0;
+            h.tail = 0;
+            h.count = 0;
+        }
+    }
+
+    RingSpool(const RingSpool&) = delete;
+    RingSpool& operator=(const RingSpool&) = delete;
+
+    ~RingSpool() {
+        if (this->map != nullptr) {
+            ::munmap(this->map, this->map_size);
+        }
+
+        if (this->fd >= 0) {
+            ::close(this->fd);
+        }
+    }
+
+    /*
+    Appends a message.  Thread safe
+
+    Args:
+        topic: topic of the message
+        payload: payload of the message
+        expires: wall clock time in milliseconds after which the message is stale, or 0 if it never is
+        evict: if the spool is full, drop the oldest messages to make room instead of rejecting this one
+        qos: QoS to send the message with
+        retain: whether the broker is to retain the message
+
+    Returns:
+        False if the message was rejected
+    */
+    bool push(const std::string_view topic, const std::string_view payload, const int64_t expires, const bool evict, const int qos = 0,
+        const bool retain = false) {
+        std::lock_guard<std::mutex> lock(this->m);
+        Header& h = *this->header;
+
+        const uint64_t size = record_size(topic.size(), payload.size());
+        if (size > h.capacity || topic.size() > UINT16_MAX) {
+            return false;
+        }
+
+        uint64_t offset = this->find_space(size);
+        while (offset == h.capacity) {
+            if (!evict || h.count == 0) {
+                return false;
+            }
+
+            this->pop_locked();
+            offset = this->find_space(size);
+        }
+
+        // Mark the unused end of the ring, if there is room for a marker
+        if (offset == 0 && h.count > 0 && h.capacity - h.tail >= sizeof(Record)) {
+            Record wrap = {0, 0, 0, WRAP, 0};
+            std::memcpy(this->ring + h.tail, &wrap, sizeof(Record));
+        }
+
+        Record record = {static_cast<uint16_t>(topic.size()), static_cast<uint8_t>(qos), retain, static_cast<uint32_t>(payload.size()), expires};
+        char* out = this->ring + offset;
+        std::memcpy(out, &record, sizeof(Record));
+        std::memcpy(out + sizeof(Record), topic.data(), topic.size());
+        std::memcpy(out + sizeof(Record) + topic.size(), payload.data(), payload.size());
+
+        h.tail = offset + size;
+        ++h.count;
+
+        return true;
+    }
+
+    /*
+    Hands the oldest message to f without removing it.  Thread safe, but f is called with the spool's lock held
+
+    Args:
+        f: called as f(topic, payload, expires, qos, retain).  The views point into the ring and are only valid during the call
+
+    Returns:
+        False if the spool is empty
+    */
+    template <class F>
+    bool peek(F&& f) {
+        std::lock_guard<std::mutex> lock(this->m);
+        Header& h = *this->header;
+
+        if (h.count == 0) {
+            return false;
+        }
+
+        h.head = this->unwrap(h.head);
+
+        Record record;
+        std::memcpy(&record, this->ring + h.head, sizeof(Record));
+
+        const char* data = this->ring + h.head + sizeof(Record);
+        f(std::string_view(data, record.topic_length), std::string_view(data + record.topic_length, record.payload_length), record.expires,
+            static_cast<int>(record.qos), record.retain != 0);
+
+        return true;
+    }
+
+    /*
+    Removes the oldest message, if any.  Thread safe
+    */
+    void pop() {
+        std::lock_guard<std::mutex> lock(this->m);
+        this->pop_locked();
+    }
+
+    /*
+    Returns:
+        The number of messages in the spool.  Thread safe
+    */
+    size_t size() {
+        std::lock_guard<std::mutex> lock(this->m);
+        return this->header->count;
+    }
+
+    bool empty() {
+        return this->size() == 0;
+    }
+};
+
+#endif
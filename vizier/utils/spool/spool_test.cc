@@ -0,0 +1,139 @@
+#include "vizier/utils/spool/spool.h"
+#include <unistd.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "gtest/gtest.h"
+
+namespace {
+    std::string temp_path() {
+        char path[] = "/tmp/vizier_spool_XXXXXX";
+        int fd = mkstemp(path);
+        close(fd);
+        unlink(path);
+        return path;
+    }
+
+    std::vector<std::pair<std::string, std::string>> drain(RingSpool& spool) {
+        std::vector<std::pair<std::string, std::string>> out;
+        while (spool.peek([&out](std::string_view topic, std::string_view payload, int64_t expires, int qos, bool retain) {
+            out.emplace_back(topic, payload);
+        })) {
+            spool.pop();
+        }
+        return out;
+    }
+}
+
+TEST(RingSpool, Fifo) {
+    std::string path = temp_path();
+    RingSpool spool(path, 4096);
+
+    EXPECT_TRUE(spool.empty());
+    EXPECT_TRUE(spool.push("a/0", "zero", 0, false));
+    EXPECT_TRUE(spool.push("a/1", std::string("o\0ne", 4), 0, false));
+    EXPECT_TRUE(spool.push("b/2", "", 12345, false));
+    EXPECT_EQ(3, spool.size());
+
+    int64_t expires = 0;
+    spool.peek([&expires](std::string_view, std::string_view, int64_t e, int, bool) { expires = e; });
+    EXPECT_EQ(0, expires);
+
+    auto messages = drain(spool);
+    std::vector<std::pair<std::string, std::string>> expected = {{"a/0", "zero"}, {"a/1", std::string("o\0ne", 4)}, {"b/2", ""}};
+    EXPECT_EQ(expected, messages);
+    EXPECT_TRUE(spool.empty());
+
+    unlink(path.c_str());
+}
+
+TEST(RingSpool, KeepsSendOptions) {
+    std::string path = temp_path();
+    RingSpool spool(path, 4096);
+
+    EXPECT_TRUE(spool.push("a/0", "zero", 0, false, 1, true));
+    EXPECT_TRUE(spool.push("a/1", "one", 0, false));
+    // Longer than any MQTT topic
+    EXPECT_FALSE(spool.push(std::string(70000, 't'), "two", 0, false));
+
+    std::vector<std::pair<int, bool>> options;
+    while (spool.peek([&options](std::string_view, std::string_view, int64_t, int qos, bool retain) { options.emplace_back(qos, retain); })) {
+        spool.pop();
+    }
+
+    std::vector<std::pair<int, bool>> expected = {{1, true}, {0, false}};
+    EXPECT_EQ(expected, options);
+
+    unlink(path.c_str());
+}
+
+TEST(RingSpool, WrapsAround) {
+    std::string path = temp_path();
+    // Room for three 40-byte records
+    RingSpool spool(path, 128);
+    std::string payload(16, 'x');
+
+    for (int round = 0; round < 20; ++round) {
+        EXPECT_TRUE(spool.push("t/" + std::to_string(round), payload, 0, false));
+        EXPECT_TRUE(spool.push("u/" + std::to_string(round), payload, 0, false));
+
+        auto messages = drain(spool);
+        ASSERT_EQ(2, messages.size());
+        EXPECT_EQ("t/" + std::to_string(round), messages[0].first);
+        EXPECT_EQ("u/" + std::to_string(round), messages[1].first);
+    }
+
+    unlink(path.c_str());
+}
+
+TEST(RingSpool, FullSpool) {
+    std::string path = temp_path();
+    RingSpool spool(path, 128);
+    std::string payload(16, 'x');
+
+    EXPECT_TRUE(spool.push("t/0", payload, 0, false));
+    EXPECT_TRUE(spool.push("t/1", payload, 0, false));
+    EXPECT_TRUE(spool.push("t/2", payload, 0, false));
+
+    // Rejected, or accepted by evicting the oldest message
+    EXPECT_FALSE(spool.push("t/3", payload, 0, false));
+    EXPECT_TRUE(spool.push("t/4", payload, 0, true));
+    EXPECT_FALSE(spool.push("t/5", std::string(200, 'x'), 0, true));
+
+    auto messages = drain(spool);
+    ASSERT_EQ(3, messages.size());
+    EXPECT_EQ("t/1", messages[0].first);
+    EXPECT_EQ("t/2", messages[1].first);
+    EXPECT_EQ("t/4", messages[2].first);
+
+    unlink(path.c_str());
+}
+
+TEST(RingSpool, SurvivesReopening) {
+    std::string path = temp_path();
+
+    {
+        RingSpool spool(path, 1024);
+        spool.push("t/0", "kept", 0, false);
+        spool.push("t/1", "also kept", 0, false);
+    }
+
+    {
+        RingSpool spool(path, 1024);
+        auto messages = drain(spool);
+        ASSERT_EQ(2, messages.size());
+        EXPECT_EQ("kept", messages[0].second);
+        EXPECT_EQ("also kept", messages[1].second);
+    }
+
+    // A different capacity starts over
+    {
+        RingSpool spool(path, 1024);
+        spool.push("t/0", "dropped", 0, false);
+    }
+
+    RingSpool spool(path, 2048);
+    EXPECT_TRUE(spool.empty());
+
+    unlink(path.c_str());
+}
@@ -0,0 +1,123 @@
+#ifndef VIZIER_STREAMJOIN_H
+#define VIZIER_STREAMJOIN_H
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+/*
+PoD for the settings of a StreamJoin
+*/
+struct JoinOptions {
+    // Extracts the alignment key (a timestamp or sequence number) from a message.  Messages without a key are dropped
+    std::function<std::optional<double>(const std::string&)> key;
+    // Maximum difference between the keys of the messages in one tuple
+    double slop = 0;
+    // Number of unmatched messages kept per stream.  The oldest message is dropped when a stream's buffer is full
+    size_t queue_size = 10;
+    // Keep only the newest unmatched message per stream, so tuples are always built from the latest data
+    bool latest_only = false;
+};
+
+/*
+Aligns messages from several streams by key and emits one tuple per set of messages whose keys lie within the slop of each other.
+Each stream must deliver messages in non-decreasing key order.
+
+Not thread safe.  It is meant to be fed from the MQTT client's single message thread, so that joining costs no extra threads or locks.
+*/
+class StreamJoin {
+private:
+    struct Keyed {
+        double key;
+        std::string message;
+    };
+
+    JoinOptions options;
+    std::vector<std::deque<Keyed>> streams;
+    std::function<void(std::vector<std::string>&&)> emit;
+
+public:
+    /*
+    Args:
+        num_streams: number of streams being joined
+        options: see JoinOptions
+        emit: called with one message per stream, in stream order, for every aligned tuple
+    */
+    StreamJoin(const size_t num_streams, JoinOptions options, std::function<void(std::vector<std::string>&&)> emit)
+        : options(std::move(options)), streams(num_streams), emit(std::move(emit)) {
+
+        if (this->options.latest_only || this->options.queue_size == 0) {
+            this->options.queue_size = 1;
+        }
+    }
+
+    /*
+    Adds a message to a stream and emits any tuple it completes
+
+    Args:
+        stream: index of the stream the message arrived on
+        message: the message
+    */
+    void push(const size_t stream, std::string&& message) {
+        std::optional<double> key = this->options.key(message);
+
+        if (!key || stream >= this->streams.size()) {
+            return;
+        }
+
+        auto& buffer = this->streams[stream];
+        if (buffer.size() >= this->options.queue_size) {
+            buffer.pop_front();
+        }
+        buffer.push_back({key.value(), std::move(message)});
+
+        this->match();
+    }
+
+private:
+    /*
+    Emits tuples while every stream has a message.  Each stream delivers keys in order, so a front message older than the newest
+    front minus the slop can never be matched and is dropped.
+    */
+    void match() {
+        while (true) {
+            double newest = 0;
+
+            for (size_t i = 0; i < this->streams.size(); ++i) {
+                if (this->streams[i].empty()) {
+                    return;
+                }
+
+                newest = (i == 0) ? this->streams[i].front().key : std::max(newest, this->streams[i].front().key);
+            }
+
+            bool aligned = true;
+            for (auto& buffer : this->streams) {
+                while (!buffer.empty() && buffer.front().key < newest - this->options.slop) {
+                    buffer.pop_front();
+                }
+
+                aligned = aligned && !buffer.empty();
+            }
+
+            if (!aligned) {
+                return;
+            }
+
+            std::vector<std::string> tuple;
+            tuple.reserve(this->streams.size());
+
+            for (auto& buffer : this->streams) {
+                tuple.push_back(std::move(buffer.front().message));
+                buffer.pop_front();
+            }
+
+            this->emit(std::move(tuple));
+        }
+    }
+};
+
+#endif
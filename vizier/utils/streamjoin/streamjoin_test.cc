@@ -0,0 +1,78 @@
+#include "vizier/utils/streamjoin/streamjoin.h"
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+
+namespace {
+    JoinOptions key_options(double slop) {
+        JoinOptions options;
+        options.slop = slop;
+        options.key = [](const std::string& message) -> std::optional<double> {
+            return std::stod(message);
+        };
+
+        return options;
+    }
+}
+
+TEST(StreamJoin, ExactMatch) {
+    std::vector<std::vector<std::string>> tuples;
+    StreamJoin join(2, key_options(0), [&tuples](std::vector<std::string>&& t) { tuples.push_back(std::move(t)); });
+
+    join.push(0, "1");
+    join.push(0, "2");
+    join.push(1, "2");
+    join.push(1, "3");
+    join.push(0, "3");
+
+    std::vector<std::vector<std::string>> expected = {{"2", "2"}, {"3", "3"}};
+    EXPECT_EQ(expected, tuples);
+}
+
+TEST(StreamJoin, Slop) {
+    std::vector<std::vector<std::string>> tuples;
+    StreamJoin join(3, key_options(0.05), [&tuples](std::vector<std::string>&& t) { tuples.push_back(std::move(t)); });
+
+    join.push(0, "1.00");
+    join.push(1, "1.03");
+    join.push(2, "1.2");
+    join.push(0, "1.21");
+    join.push(1, "1.24");
+
+    std::vector<std::vector<std::string>> expected = {{"1.21", "1.24", "1.2"}};
+    EXPECT_EQ(expected, tuples);
+}
+
+TEST(StreamJoin, LatestOnly) {
+    std::vector<std::vector<std::string>> tuples;
+    JoinOptions options = key_options(1);
+    options.latest_only = true;
+    StreamJoin join(2, options, [&tuples](std::vector<std::string>&& t) { tuples.push_back(std::move(t)); });
+
+    join.push(0, "1");
+    join.push(0, "2");
+    join.push(0, "3");
+    join.push(1, "3.5");
+
+    std::vector<std::vector<std::string>> expected = {{"3", "3.5"}};
+    EXPECT_EQ(expected, tuples);
+}
+
+TEST(StreamJoin, DropsMessagesWithoutKey) {
+    std::vector<std::vector<std::string>> tuples;
+    JoinOptions options;
+    options.key = [](const std::string& message) -> std::optional<double> {
+        if (message == "bad") {
+            return std::nullopt;
+        }
+        return std::stod(message);
+    };
+    StreamJoin join(2, options, [&tuples](std::vector<std::string>&& t) { tuples.push_back(std::move(t)); });
+
+    join.push(0, "bad");
+    join.push(1, "1");
+    join.push(0, "1");
+
+    std::vector<std::vector<std::string>> expected = {{"1", "1"}};
+    EXPECT_EQ(expected, tuples);
+}
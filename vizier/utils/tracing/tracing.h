@@ -0,0 +1,260 @@
+#ifndef VIZIER_TRACING_H
+#define VIZIER_TRACING_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+Timestamps of a traced message, in nanoseconds since the epoch.  The publisher stamps enqueued and published on its clock; the
+subscriber stamps received and dispatched on its own
+*/
+struct TraceStamps {
+    // Identifies the publishing client.  Random, and new every time the client starts
+    uint64_t trace_id = 0;
+    // Number of traced messages the publishing client sent on the topic before this one
+    uint64_t sequence = 0;
+    // When the message was handed to the client, and when the client handed it to the network.  Zero if unknown
+    int64_t enqueued = 0;
+    int64_t published = 0;
+    // When the message arrived from the network, and when it was handed to the subscriber's callback
+    int64_t received = 0;
+    int64_t dispatched = 0;
+};
+
+/*
+Returns:
+    The current time in nanoseconds since the epoch, for TraceStamps
+*/
+inline int64_t trace_now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+namespace tracing_detail {
+    // Distinct from the prefixes of compressed payloads, shared-memory frames and response chunks
+    constexpr char FRAME_MAGIC[4] = {'\0', 'T', 'R', '1'};
+    // Magic, trace id, sequence, enqueued, published
+    constexpr size_t FRAME_HEADER_SIZE = 4 + 8 + 8 + 8 + 8;
+}
+
+/*
+Returns:
+    True if a message starts with a trace header.  Cheap enough to check on every message
+*/
+inline bool is_trace_frame(const std::string_view message) {
+    return message.size() >= tracing_detail::FRAME_HEADER_SIZE
+        && std::memcmp(message.data(), tracing_detail::FRAME_MAGIC, sizeof(tracing_detail::FRAME_MAGIC)) == 0;
+}
+
+/*
+Prefixes a payload with the publisher's timestamps.  Integers are in host byte order, like the rest of the binary framing between nodes
+
+Args:
+    stamps: trace id, sequence and publisher timestamps to encode
+    payload: message to trace
+    out: set to the traced message, reusing its capacity
+*/
+inline void encode_trace_frame(const TraceStamps& stamps, const std::string_view payload, std::string& out) {
+    out.resize(tracing_detail::FRAME_HEADER_SIZE + payload.size());
+    char* p = &out[0];
+
+    std::memcpy(p, tracing_detail::FRAME_MAGIC, 4);
+    std::memcpy(p + 4, &stamps.trace_id, 8);
+    std::memcpy(p + 12, &stamps.sequence, 8);
+    std::memcpy(p + 20, &stamps.enqueued, 8);
+    std::memcpy(p + 28, &stamps.published, 8);
+    std::memcpy(p + 36, payload.data(), payload.size());
+}
+
+/*
+Reads the publisher's timestamps from a traced message
+
+Args:
+    message: traced message
+    stamps: trace id, sequence and publisher timestamps are set from the header
+
+Returns:
+    The traced payload, pointing into message, or nothing if the message is not a trace frame
+*/
+inline std::optional<std::string_view> parse_trace_frame(const std::string_view message, TraceStamps& stamps) {
+    if (!is_trace_frame(message)) {
+        return std::nullopt;
+    }
+
+    const char* p = message.data();
+    std::memcpy(&stamps.trace_id, p + 4, 8);
+    std::memcpy(&stamps.sequence, p + 12, 8);
+    std::memcpy(&stamps.enqueued, p + 20, 8);
+    std::memcpy(&stamps.published, p + 28, 8);
+
+    return message.substr(tracing_detail::FRAME_HEADER_SIZE);
+}
+
+/*
+Running statistics of a duration in nanoseconds
+*/
+struct LatencyStats {
+    uint64_t count = 0;
+    double mean = 0;
+    int64_t min = std::numeric_limits<int64_t>::max();
+    int64_t max = std::numeric_limits<int64_t>::min();
+    int64_t last = 0;
+
+    void add(const int64_t ns) {
+        ++this->count;
+        this->mean += (static_cast<double>(ns) - this->mean) / this->count;
+        this->min = std::min(this->min, ns);
+        this->max = std::max(this->max, ns);
+        this->last = ns;
+    }
+};
+
+/*
+Where the latency of the traced messages on a topic goes
+*/
+struct LatencyBreakdown {
+    // Waiting in the publisher's queue, from enqueued to published.  On the publisher's clock
+    LatencyStats queue;
+    // Through the network and the broker, from published to received.  Corrected by the clock offset between the hosts, if known
+    LatencyStats transit;
+    // Waiting for the subscriber's dispatch thread, from received to dispatched.  On the subscriber's clock
+    LatencyStats dispatch;
+    // From enqueued to dispatched
+    LatencyStats total;
+    uint64_t messages = 0;
+    // Messages whose transit was measured without knowing the clock offset, which then counts as transit
+    uint64_t uncorrected = 0;
+    // Messages missing from the sequence
+    uint64_t lost = 0;
+    // Publishing client of the last message, and the sequence number expected next from it
+    uint64_t trace_id = 0;
+    uint64_t next_sequence = 0;
+
+    /*
+    Args:
+        stamps: timestamps of a message
+        offset: clock of the publisher's host minus clock of this host in nanoseconds, if known
+    */
+    void add(const TraceStamps& stamps, const std::optional<int64_t> offset) {
+        const int64_t published = stamps.published - offset.value_or(0);
+        const int64_t enqueued = (stamps.enqueued != 0 ? stamps.enqueued : stamps.published) - offset.value_or(0);
+
+        if (stamps.enqueued != 0) {
+            this->queue.add(stamps.published - stamps.enqueued);
+        }
+
+        this->transit.add(stamps.received - published);
+        this->dispatch.add(stamps.dispatched - stamps.received);
+        this->total.add(stamps.dispatched - enqueued);
+
+        ++this->messages;
+        this->uncorrected += !offset;
+
+        // A restarted publisher starts its sequence over, and a new subscriber starts wherever the publisher is
+        if (stamps.trace_id != this->trace_id) {
+            this->trace_id = stamps.trace_id;
+            this->next_sequence = stamps.sequence;
+        }
+
+        if (stamps.sequence > this->next_sequence) {
+            this->lost += stamps.sequence - this->next_sequence;
+        }
+
+        this->next_sequence = std::max(this->next_sequence, stamps.sequence + 1);
+    }
+};
+
+/*
+Clock offset between this host and a remote one
+*/
+struct ClockOffset {
+    // Remote clock minus local clock, in nanoseconds
+    int64_t offset = 0;
+    // Round-trip network delay of the exchange the offset comes from.  The offset is off by at most half of it
+    int64_t delay = 0;
+    // Number of exchanges the estimate was chosen from
+    size_t samples = 0;
+};
+
+/*
+NTP-style estimate of the clock offset to a remote host from request/response exchanges.  Each exchange gives an offset that is off by
+at most half its round trip, so the estimate is the offset of the exchange with the shortest round trip among the most recent ones.
+Not thread safe
+*/
+class ClockOffsetEstimator {
+private:
+    struct Sample {
+        int64_t offset;
+        int64_t delay;
+    };
+
+    std::vector<Sample> samples;
+    // Index of the oldest sample once the window is full
+    size_t next = 0;
+    size_t window;
+
+public:
+    /*
+    Args:
+        window: number of most recent exchanges to choose from
+    */
+    explicit ClockOffsetEstimator(const size_t window = 8) : window(std::max<size_t>(window, 1)) {}
+
+    /*
+    Adds an exchange
+
+    Args:
+        t0: request sent, on the local clock
+        t1: request received, on the remote clock
+        t2: response sent, on the remote clock
+        t3: response received, on the local clock
+
+    Returns:
+        False if the timestamps are inconsistent, in which case the exchange is ignored
+    */
+    bool add(const int64_t t0, const int64_t t1, const int64_t t2, const int64_t t3) {
+        if (t3 < t0 || t2 < t1) {
+            return false;
+        }
+
+        Sample sample{((t1 - t0) + (t2 - t3)) / 2, (t3 - t0) - (t2 - t1)};
+
+        if (this->samples.size() < this->window) {
+            this->samples.push_back(sample);
+        } else {
+            this->samples[this->next] = sample;
+            this->next = (this->next + 1) % this->window;
+        }
+
+        return true;
+    }
+
+    /*
+    Returns:
+        The estimate, or nothing before the first exchange
+    */
+    std::optional<ClockOffset> estimate() const {
+        if (this->samples.empty()) {
+            return std::nullopt;
+        }
+
+        auto best = std::min_element(this->samples.begin(), this->samples.end(), [](const Sample& a, const Sample& b) {
+            return a.delay < b.delay;
+        });
+
+        ClockOffset out;
+        out.offset = best->offset;
+        out.delay = std::max<int64_t>(best->delay, 0);
+        out.samples = this->samples.size();
+
+        return out;
+    }
+};
+
+#endif
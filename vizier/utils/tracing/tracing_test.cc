@@ -0,0 +1,86 @@
+#include "vizier/utils/tracing/tracing.h"
+#include <string>
+#include "gtest/gtest.h"
+
+TEST(Tracing, FrameRoundTrip) {
+    TraceStamps stamps;
+    stamps.trace_id = 0x0123456789abcdef;
+    stamps.sequence = 42;
+    stamps.enqueued = 1000;
+    stamps.published = 2500;
+
+    std::string framed;
+    encode_trace_frame(stamps, std::string("\0VZ compressed", 14), framed);
+    EXPECT_TRUE(is_trace_frame(framed));
+    EXPECT_FALSE(is_trace_frame("{\"status\": \"200\"}"));
+
+    TraceStamps decoded;
+    auto payload = parse_trace_frame(framed, decoded);
+    ASSERT_TRUE(bool(payload));
+    EXPECT_EQ(std::string("\0VZ compressed", 14), payload.value());
+    EXPECT_EQ(stamps.trace_id, decoded.trace_id);
+    EXPECT_EQ(42, decoded.sequence);
+    EXPECT_EQ(1000, decoded.enqueued);
+    EXPECT_EQ(2500, decoded.published);
+
+    EXPECT_FALSE(bool(parse_trace_frame(framed.substr(0, 10), decoded)));
+}
+
+TEST(Tracing, ClockOffsetPrefersShortRoundTrips) {
+    ClockOffsetEstimator estimator(4);
+    EXPECT_FALSE(bool(estimator.estimate()));
+
+    // Remote clock is 500 ahead.  A symmetric 10 each way gives the offset exactly
+    EXPECT_TRUE(estimator.add(0, 510, 520, 30));
+    // A request that sat in a queue for 200 on the way out skews its offset
+    EXPECT_TRUE(estimator.add(100, 810, 820, 330));
+    // Inconsistent
+    EXPECT_FALSE(estimator.add(100, 0, 0, 50));
+
+    auto estimate = estimator.estimate();
+    ASSERT_TRUE(bool(estimate));
+    EXPECT_EQ(500, estimate->offset);
+    EXPECT_EQ(20, estimate->delay);
+    EXPECT_EQ(2, estimate->samples);
+
+    // The best exchange ages out of the window
+    for (int i = 0; i < 4; ++i) {
+        estimator.add(1000, 1540, 1550, 1050);
+    }
+
+    EXPECT_EQ(520, estimator.estimate()->offset);
+}
+
+TEST(Tracing, LatencyBreakdown) {
+    LatencyBreakdown breakdown;
+
+    auto stamps = [](uint64_t sequence, int64_t enqueued) {
+        TraceStamps s;
+        s.trace_id = 7;
+        s.sequence = sequence;
+        s.enqueued = enqueued;
+        s.published = enqueued + 100;
+        // The publisher's clock is 1000 ahead
+        s.received = enqueued + 100 - 1000 + 40;
+        s.dispatched = s.received + 5;
+        return s;
+    };
+
+    breakdown.add(stamps(10, 10000), int64_t(1000));
+    breakdown.add(stamps(11, 20000), int64_t(1000));
+    // Two lost
+    breakdown.add(stamps(14, 30000), int64_t(1000));
+
+    EXPECT_EQ(3, breakdown.messages);
+    EXPECT_EQ(2, breakdown.lost);
+    EXPECT_EQ(0, breakdown.uncorrected);
+    EXPECT_EQ(100, breakdown.queue.mean);
+    EXPECT_EQ(40, breakdown.transit.max);
+    EXPECT_EQ(5, breakdown.dispatch.min);
+    EXPECT_EQ(145, breakdown.total.last);
+
+    // Without the offset, the clock difference shows up as transit
+    breakdown.add(stamps(15, 40000), std::nullopt);
+    EXPECT_EQ(1, breakdown.uncorrected);
+    EXPECT_EQ(-960, breakdown.transit.last);
+}
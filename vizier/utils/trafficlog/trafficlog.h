@@ -0,0 +1,404 @@
+#ifndef VIZIER_TRAFFICLOG_H
+#define VIZIER_TRAFFICLOG_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+/*
+Which way a recorded message went
+*/
+enum class TrafficDirection : uint8_t {PUBLISHED, RECEIVED};
+
+/*
+Message read from a traffic log.  The topic and payload point into the log's mapping
+*/
+struct TrafficRecord {
+    // Nanoseconds since the epoch
+    int64_t timestamp = 0;
+    TrafficDirection direction = TrafficDirection::PUBLISHED;
+    std::string_view topic;
+    std::string_view payload;
+};
+
+namespace trafficlog_detail {
+    // Number of index entries, each pointing at the record that crosses the next capacity / INDEX_SLOTS bytes of the log
+    constexpr size_t INDEX_SLOTS = 1024;
+
+    struct IndexEntry {
+        // Offset of the record plus one, or zero if the slot has not been written yet.  Set after the timestamp
+        std::atomic<uint64_t> position;
+        int64_t timestamp;
+    };
+
+    /*
+    Layout of the start of the file
+    */
+    struct Header {
+        char magic[8];
+        uint64_t capacity;
+        // Bytes of log between index entries
+        uint64_t stride;
+        // Bytes of log handed out to writers so far.  May run past the capacity once the log is full
+        std::atomic<uint64_t> reserved;
+        // Messages that did not fit
+        std::atomic<uint64_t> dropped;
+        IndexEntry index[INDEX_SLOTS];
+    };
+
+    /*
+    Layout of a record, followed by the topic and the payload and padded to a multiple of 8 bytes
+    */
+    struct Record {
+        // Padded size of the record.  Zero until the record is completely written
+        std::atomic<uint32_t> size;
+        TrafficDirection direction;
+        uint8_t unused[3];
+        uint32_t topic_length;
+        uint32_t payload_length;
+        int64_t timestamp;
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+        "Traffic logs need lock-free atomics");
+
+    constexpr char MAGIC[8] = {'V', 'Z', 'T', 'L', 'O', 'G', '0', '1'};
+
+    inline uint64_t record_size(const size_t topic_length, const size_t payload_length) {
+        return (sizeof(Record) + topic_length + payload_length + 7) & ~uint64_t(7);
+    }
+
+    inline const Record* record_at(const char* data, const uint64_t offset) {
+        return reinterpret_cast<const Record*>(data + offset);
+    }
+}
+
+/*
+Append-only log of messages in a memory-mapped file, for recording the traffic of a client and replaying it later.
+
+Appending is lock free: a writer reserves space with a single atomic add, copies the message into the mapping and marks the record
+complete.  The kernel writes the pages out in the background, so the file survives a crash of the process.  The log has a fixed
+capacity; once it is full, further messages are counted and dropped.  An index of up to INDEX_SLOTS entries lets readers start
+reading at a point in time without scanning the records before it.  Thread safe
+*/
+class TrafficLog {
+private:
+    int fd = -1;
+    char* map = nullptr;
+    size_t map_size = 0;
+    trafficlog_detail::Header* header = nullptr;
+    char* data = nullptr;
+
+public:
+    /*
+    Creates a log, replacing any file at path.  The file is sparse until it fills up, and is cut down to the records in it when the log
+    is destroyed
+
+    Args:
+        path: path of the log file
+        capacity: number of bytes available for records
+
+    Throws:
+        std::runtime_error if the file cannot be created or mapped
+    */
+    TrafficLog(const std::string& path, const size_t capacity) {
+        using namespace trafficlog_detail;
+
+        this->fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (this->fd < 0) {
+            throw std::runtime_error("Could not open traffic log " + path);
+        }
+
+        const uint64_t usable = capacity & ~uint64_t(7);
+        this->map_size = sizeof(Header) + usable;
+
+        if (::ftruncate(this->fd, this->map_size) != 0) {
+            ::close(this->fd);
+            throw std::runtime_error("Could not size traffic log " + path);
+        }
+
+        void* addr = ::mmap(nullptr, this->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(this->fd);
+            throw std::runtime_error("Could not map traffic log " + path);
+        }
+
+        this->map = static_cast<char*>(addr);
+        this->header = reinterpret_cast<Header*>(this->map);
+        this->data = this->map + sizeof(Header);
+
+        // The file starts out zeroed, so the index and every record are empty
+        Header& h = *this->header;
+        h.capacity = usable;
+        h.stride = std::max<uint64_t>(((usable + INDEX_SLOTS - 1) / INDEX_SLOTS + 7) & ~uint64_t(7), 8);
+        std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    }
+
+    TrafficLog(const TrafficLog&) = delete;
+    TrafficLog& operator=(const TrafficLog&) = delete;
+
+    ~TrafficLog() {
+        if (this->map != nullptr) {
+            // The empty record header after the last record stays, so that readers still mapping the whole file stop there
+            const uint64_t capacity = this->header->capacity;
+            const uint64_t used = std::min(this->header->reserved.load(), capacity);
+            ::munmap(this->map, this->map_size);
+
+            if (::ftruncate(this->fd, sizeof(trafficlog_detail::Header) + std::min<uint64_t>(used + sizeof(trafficlog_detail::Record), capacity)) != 0) {
+                // The log is still readable at full size
+            }
+        }
+
+        if (this->fd >= 0) {
+            ::close(this->fd);
+        }
+    }
+
+    /*
+    Appends a message, stamped with the current time.  Thread safe and lock free
+
+    Args:
+        direction: whether the message was published or received
+        topic: topic of the message
+        payload: payload of the message
+
+    Returns:
+        False if the log is full
+    */
+    bool append(const TrafficDirection direction, const std::string_view topic, const std::string_view payload) {
+        const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        return this->append(direction, topic, payload, now);
+    }
+
+    /*
+    Appends a message with the given timestamp.  Thread safe and lock free
+
+    Args:
+        direction: whether the message was published or received
+        topic: topic of the message
+        payload: payload of the message
+        timestamp: nanoseconds since the epoch
+
+    Returns:
+        False if the log is full
+    */
+    bool append(const TrafficDirection direction, const std::string_view topic, const std::string_view payload, const int64_t timestamp) {
+        using namespace trafficlog_detail;
+        Header& h = *this->header;
+
+        const uint64_t size = record_size(topic.size(), payload.size());
+        if (size > UINT32_MAX) {
+            h.dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        const uint64_t offset = h.reserved.fetch_add(size, std::memory_order_relaxed);
+        if (offset + size > h.capacity) {
+            h.dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        char* p = this->data + offset;
+        Record* record = reinterpret_cast<Record*>(p);
+        record->direction = direction;
+        record->topic_length = topic.size();
+        record->payload_length = payload.size();
+        record->timestamp = timestamp;
+        std::memcpy(p + sizeof(Record), topic.data(), topic.size());
+        std::memcpy(p + sizeof(Record) + topic.size(), payload.data(), payload.size());
+
+        // Publishes the record to readers
+        record->size.store(static_cast<uint32_t>(size), std::memory_order_release);
+
+        // Index the boundaries this record crosses.  Each boundary is crossed by exactly one record, so each slot has one writer
+        for (uint64_t slot = (offset + h.stride - 1) / h.stride; slot < INDEX_SLOTS && slot * h.stride < offset + size; ++slot) {
+            h.index[slot].timestamp = timestamp;
+            h.index[slot].position.store(offset + 1, std::memory_order_release);
+        }
+
+        return true;
+    }
+
+    /*
+    Returns:
+        The number of messages that did not fit
+    */
+    size_t dropped() const {
+        return this->header->dropped.load(std::memory_order_relaxed);
+    }
+
+    /*
+    Returns:
+        The number of bytes of records in the log
+    */
+    size_t used() const {
+        return std::min(this->header->reserved.load(std::memory_order_relaxed), this->header->capacity);
+    }
+};
+
+/*
+Reads a traffic log, including one that is still being written.  Records are read in the order they were appended, which is the order
+of their timestamps up to the jitter between concurrent writers.  Reading stops at a record that is not completely written, such as one
+that was being appended when the writer crashed.  Thread safe
+*/
+class TrafficLogReader {
+private:
+    int fd = -1;
+    char* map = nullptr;
+    size_t map_size = 0;
+    const trafficlog_detail::Header* header = nullptr;
+    const char* data = nullptr;
+    // Bytes of the file holding records
+    uint64_t limit = 0;
+
+public:
+    /*
+    Maps a log read-only
+
+    Args:
+        path: path of the log file
+
+    Throws:
+        std::runtime_error if the file cannot be mapped or is not a traffic log
+    */
+    explicit TrafficLogReader(const std::string& path) {
+        using namespace trafficlog_detail;
+
+        this->fd = ::open(path.c_str(), O_RDONLY);
+        if (this->fd < 0) {
+            throw std::runtime_error("Could not open traffic log " + path);
+        }
+
+        struct stat st;
+        if (::fstat(this->fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+            ::close(this->fd);
+            throw std::runtime_error("Not a traffic log: " + path);
+        }
+
+        this->map_size = st.st_size;
+
+        void* addr = ::mmap(nullptr, this->map_size, PROT_READ, MAP_SHARED, this->fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(this->fd);
+            throw std::runtime_error("Could not map traffic log " + path);
+        }
+
+        this->map = static_cast<char*>(addr);
+        this->header = reinterpret_cast<const Header*>(this->map);
+        this->data = this->map + sizeof(Header);
+
+        if (std::memcmp(this->header->magic, MAGIC, sizeof(MAGIC)) != 0) {
+            ::munmap(this->map, this->map_size);
+            ::close(this->fd);
+            throw std::runtime_error("Not a traffic log: " + path);
+        }
+
+        this->limit = std::min<uint64_t>(this->header->capacity, this->map_size - sizeof(Header));
+    }
+
+    TrafficLogReader(const TrafficLogReader&) = delete;
+    TrafficLogReader& operator=(const TrafficLogReader&) = delete;
+
+    ~TrafficLogReader() {
+        if (this->map != nullptr) {
+            ::munmap(this->map, this->map_size);
+        }
+
+        if (this->fd >= 0) {
+            ::close(this->fd);
+        }
+    }
+
+    /*
+    Reads the record at a position and moves the position past it
+
+    Args:
+        position: position of the record, starting at 0 or returned by seek
+
+    Returns:
+        The record, or nothing at the end of the log
+    */
+    std::optional<TrafficRecord> next(uint64_t& position) const {
+        using namespace trafficlog_detail;
+
+        if (position + sizeof(Record) > this->limit) {
+            return std::nullopt;
+        }
+
+        const Record* record = record_at(this->data, position);
+        const uint32_t size = record->size.load(std::memory_order_acquire);
+
+        if (size == 0 || position + size > this->limit || record_size(record->topic_length, record->payload_length) != size) {
+            return std::nullopt;
+        }
+
+        const char* p = this->data + position + sizeof(Record);
+
+        TrafficRecord out;
+        out.timestamp = record->timestamp;
+        out.direction = record->direction;
+        out.topic = std::string_view(p, record->topic_length);
+        out.payload = std::string_view(p + record->topic_length, record->payload_length);
+
+        position += size;
+        return out;
+    }
+
+    /*
+    Finds where to start reading to get the records from a point in time on.  Uses the index to skip most of the log
+
+    Args:
+        timestamp: nanoseconds since the epoch
+
+    Returns:
+        The position of the first record with a timestamp at or after timestamp, or the end of the log
+    */
+    uint64_t seek(const int64_t timestamp) const {
+        using namespace trafficlog_detail;
+
+        // Index slots fill in order, so the filled ones are a prefix, and their timestamps grow
+        size_t filled = 0;
+        while (filled < INDEX_SLOTS && this->header->index[filled].position.load(std::memory_order_acquire) != 0) {
+            ++filled;
+        }
+
+        const IndexEntry* begin = this->header->index;
+        const IndexEntry* it = std::partition_point(begin, begin + filled, [timestamp](const IndexEntry& entry) {
+            return entry.timestamp < timestamp;
+        });
+
+        // The last indexed record before the timestamp, so that records between it and the next indexed one are not skipped
+        uint64_t position = (it == begin) ? 0 : (it - 1)->position.load(std::memory_order_relaxed) - 1;
+
+        uint64_t current = position;
+        while (auto record = this->next(position)) {
+            if (record->timestamp >= timestamp) {
+                return current;
+            }
+
+            current = position;
+        }
+
+        return current;
+    }
+
+    /*
+    Returns:
+        The number of messages that did not fit in the log
+    */
+    size_t dropped() const {
+        return this->header->dropped.load(std::memory_order_relaxed);
+    }
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include "vizier/utils/trafficlog/trafficlog.h"
+#include <unistd.h>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+
+namespace {
+    std::string temp_path() {
+        char path[] = "/tmp/vizier_trafficlog_XXXXXX";
+        int fd = mkstemp(path);
+        close(fd);
+        unlink(path);
+        return path;
+    }
+
+    std::vector<std::string> read_topics(const TrafficLogReader& reader, uint64_t position = 0) {
+        std::vector<std::string> out;
+        while (auto record = reader.next(position)) {
+            out.emplace_back(record->topic);
+        }
+        return out;
+    }
+}
+
+TEST(TrafficLog, RoundTrip) {
+    std::string path = temp_path();
+
+    {
+        TrafficLog log(path, 4096);
+        EXPECT_TRUE(log.append(TrafficDirection::PUBLISHED, "a/0", "zero", 100));
+        EXPECT_TRUE(log.append(TrafficDirection::RECEIVED, "b/1", std::string("o\0ne", 4), 200));
+        EXPECT_TRUE(log.append(TrafficDirection::PUBLISHED, "c/2", "", 300));
+
+        // Readable while the log is being written
+        TrafficLogReader live(path);
+        EXPECT_EQ(3, read_topics(live).size());
+    }
+
+    TrafficLogReader reader(path);
+    uint64_t position = 0;
+
+    auto first = reader.next(position);
+    ASSERT_TRUE(bool(first));
+    EXPECT_EQ(100, first->timestamp);
+    EXPECT_EQ(TrafficDirection::PUBLISHED, first->direction);
+    EXPECT_EQ("a/0", first->topic);
+    EXPECT_EQ("zero", first->payload);
+
+    auto second = reader.next(position);
+    ASSERT_TRUE(bool(second));
+    EXPECT_EQ(TrafficDirection::RECEIVED, second->direction);
+    EXPECT_EQ(std::string("o\0ne", 4), second->payload);
+
+    auto third = reader.next(position);
+    ASSERT_TRUE(bool(third));
+    EXPECT_EQ("", third->payload);
+
+    EXPECT_FALSE(bool(reader.next(position)));
+
+    unlink(path.c_str());
+}
+
+TEST(TrafficLog, DropsWhenFull) {
+    std::string path = temp_path();
+    // Room for three 48-byte records
+    TrafficLog log(path, 150);
+    std::string payload(16, 'x');
+
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i < 3, log.append(TrafficDirection::PUBLISHED, "t/" + std::to_string(i), payload));
+    }
+
+    EXPECT_EQ(2, log.dropped());
+
+    TrafficLogReader reader(path);
+    EXPECT_EQ(3, read_topics(reader).size());
+    EXPECT_EQ(2, reader.dropped());
+
+    unlink(path.c_str());
+}
+
+TEST(TrafficLog, SeeksByTime) {
+    std::string path = temp_path();
+
+    {
+        // Small enough that the index has an entry every couple of records
+        TrafficLog log(path, 64 * 1024);
+        for (int i = 0; i < 1000; ++i) {
+            log.append(TrafficDirection::PUBLISHED, "t/" + std::to_string(i), "payload", 1000 + i * 10);
+        }
+    }
+
+    TrafficLogReader reader(path);
+
+    uint64_t position = reader.seek(1000 + 500 * 10);
+    auto record = reader.next(position);
+    ASSERT_TRUE(bool(record));
+    EXPECT_EQ("t/500", record->topic);
+
+    // Between two records
+    position = reader.seek(1000 + 700 * 10 - 5);
+    EXPECT_EQ("t/700", reader.next(position)->topic);
+
+    EXPECT_EQ(1000, read_topics(reader, reader.seek(0)).size());
+    EXPECT_EQ(0, read_topics(reader, reader.seek(1000000)).size());
+
+    unlink(path.c_str());
+}
+
+TEST(TrafficLog, ConcurrentAppends) {
+    std::string path = temp_path();
+
+    {
+        TrafficLog log(path, 1 << 20);
+        std::vector<std::thread> writers;
+
+        for (int w = 0; w < 4; ++w) {
+            writers.emplace_back([&log, w]() {
+                for (int i = 0; i < 1000; ++i) {
+                    log.append(TrafficDirection::PUBLISHED, std::to_string(w) + "/" + std::to_string(i), "payload");
+                }
+            });
+        }
+
+        for (auto& writer : writers) {
+            writer.join();
+        }
+    }
+
+    TrafficLogReader reader(path);
+    auto topics = read_topics(reader);
+    EXPECT_EQ(4000, topics.size());
+    EXPECT_EQ(4000, std::set<std::string>(topics.begin(), topics.end()).size());
+
+    unlink(path.c_str());
+}
+
+TEST(TrafficLog, RejectsOtherFiles) {
+    std::string path = temp_path();
+    FILE* f = fopen(path.c_str(), "w");
+    fputs("not a log", f);
+    fclose(f);
+
+    EXPECT_THROW(TrafficLogReader reader(path), std::runtime_error);
+
+    unlink(path.c_str());
+}
@@ -0,0 +1,130 @@
+#ifndef VIZIER_WORKERPOOL_H
+#define VIZIER_WORKERPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+Fixed-size pool of worker threads that pull items from a bounded admission queue and hand them to a single handler.  Items that
+arrive while the queue is full are rejected rather than queued, so the caller can shed load instead of building an unbounded backlog.
+*/
+template <class T>
+class WorkerPool {
+private:
+    std::deque<T> q;
+    size_t capacity;
+    bool stopping = false;
+
+    std::mutex m;
+    std::condition_variable c;
+
+    std::function<void(T&&)> handler;
+    std::vector<std::thread> workers;
+
+public:
+    /*
+    Starts the worker threads.
+
+    Args:
+        num_workers: number of threads handling items.  Must be at least one
+        capacity: maximum number of items waiting in the admission queue (not counting items currently being handled)
+        handler: called on a worker thread for every admitted item
+    */
+    WorkerPool(const size_t num_workers, const size_t capacity, std::function<void(T&&)> handler)
+        : capacity(capacity), handler(std::move(handler)) {
+
+        for (size_t i = 0; i < num_workers; ++i) {
+            this->workers.emplace_back(&WorkerPool::work_loop, this);
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /*
+    Stops the pool.  See stop
+    */
+    ~WorkerPool() {
+        this->stop();
+    }
+
+    /*
+    Admits an item to the pool if there is room in the queue.  Thread safe
+
+    Args:
+        item: item to be handled.  Only moved from if it was admitted
+
+    Returns:
+        True if the item was admitted and false if the queue was full or the pool is stopping
+    */
+    bool try_submit(T&& item) {
+        {
+            std::lock_guard<std::mutex> lock(this->m);
+
+            if (this->stopping || this->q.size() >= this->capacity) {
+                return false;
+            }
+
+            this->q.push_back(std::move(item));
+        }
+
+        this->c.notify_one();
+        return true;
+    }
+
+    /*
+    Returns:
+        The number of items waiting in the admission queue.  Thread safe
+    */
+    size_t size() {
+        std::lock_guard<std::mutex> lock(this->m);
+        return this->q.size();
+    }
+
+    /*
+    Stops admitting new items, lets the workers drain any queued items, and joins them.  Safe to call more than once
+    */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(this->m);
+            this->stopping = true;
+        }
+
+        this->c.notify_all();
+
+        for (auto& worker : this->workers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+private:
+    // Passed to each worker thread on construction.  Returns once the pool is stopping and the queue is empty
+    void work_loop(void) {
+        while (true) {
+            std::unique_lock<std::mutex> lock(this->m);
+
+            // Protects against spurious wake-ups
+            while (this->q.empty() && !this->stopping) {
+                this->c.wait(lock);
+            }
+
+            if (this->q.empty()) {
+                break;
+            }
+
+            T item = std::move(this->q.front());
+            this->q.pop_front();
+            lock.unlock();
+
+            this->handler(std::move(item));
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,46 @@
+#include "vizier/utils/workerpool/workerpool.h"
+#include <atomic>
+#include <future>
+#include "gtest/gtest.h"
+
+TEST(WorkerPool, HandlesAllItems) {
+    std::atomic<int> sum(0);
+
+    {
+        WorkerPool<int> pool(4, 100, [&sum](int&& i) { sum += i; });
+        for (int i = 0; i < 100; ++i) {
+            EXPECT_TRUE(pool.try_submit(int(i)));
+        }
+    }
+
+    EXPECT_EQ(4950, sum);
+}
+
+TEST(WorkerPool, RejectsWhenFull) {
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::atomic<int> handled(0);
+
+    WorkerPool<int> pool(1, 2, [&](int&& i) {
+        released.wait();
+        ++handled;
+    });
+
+    // One item is taken by the worker, two more fill the queue
+    EXPECT_TRUE(pool.try_submit(0));
+    while (pool.size() != 0) {
+        std::this_thread::yield();
+    }
+    EXPECT_TRUE(pool.try_submit(1));
+    EXPECT_TRUE(pool.try_submit(2));
+
+    int rejected = 3;
+    EXPECT_FALSE(pool.try_submit(std::move(rejected)));
+    EXPECT_EQ(3, rejected);
+
+    release.set_value();
+    pool.stop();
+
+    EXPECT_EQ(3, handled);
+    EXPECT_FALSE(pool.try_submit(4));
+}
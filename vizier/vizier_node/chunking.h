@@ -0,0 +1,203 @@
+#ifndef VIZIER_VIZIER_NODE_CHUNKING
+#define VIZIER_VIZIER_NODE_CHUNKING
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vizier {
+
+using string = std::string;
+using string_view = std::string_view;
+
+/*
+    One piece of a response too large to send as a single message.  Chunks are binary and start with a NUL byte, so they cannot be
+    mistaken for a JSON response
+*/
+struct Chunk {
+    uint32_t index = 0;
+    uint32_t count = 0;
+    // Size of every chunk but the last, so that each chunk knows where it goes
+    uint32_t chunk_size = 0;
+    // Size of the whole response
+    uint64_t total_size = 0;
+    // Identifies the response the chunk belongs to.  Chunks with different tags are never assembled together
+    string_view tag;
+    string_view data;
+};
+
+namespace {
+    // Distinct from the prefixes of compressed payloads and shared-memory frames
+    constexpr char CHUNK_MAGIC[4] = {'\0', 'C', 'K', '1'};
+    // Magic, index, count, chunk size, total size, tag length
+    constexpr size_t CHUNK_HEADER_SIZE = 4 + 4 + 4 + 4 + 8 + 2;
+}
+
+/*
+    Returns:
+        True if a message looks like a chunk
+*/
+inline bool is_chunk(const string_view message) {
+    return message.size() >= CHUNK_HEADER_SIZE && std::memcmp(message.data(), CHUNK_MAGIC, sizeof(CHUNK_MAGIC)) == 0;
+}
+
+/*
+    Returns:
+        The number of chunks a message of size bytes is split into
+*/
+inline uint32_t chunk_count(const size_t size, const size_t chunk_size) {
+    return static_cast<uint32_t>((size + chunk_size - 1) / chunk_size);
+}
+
+/*
+    Encodes chunk index of message.  Integers are in host byte order, like the rest of the binary framing between nodes
+
+    Args:
+        message: the whole response
+        index: index of the chunk, less than chunk_count(message.size(), chunk_size)
+        chunk_size: size of every chunk but the last
+        tag: identifies the response.  At most 65535 bytes
+
+    Returns:
+        The encoded chunk
+*/
+inline string encode_chunk(const string_view message, const uint32_t index, const uint32_t chunk_size, const string_view tag) {
+    const uint32_t count = chunk_count(message.size(), chunk_size);
+    const uint64_t total_size = message.size();
+    const uint16_t tag_length = static_cast<uint16_t>(tag.size());
+    const size_t offset = static_cast<size_t>(index) * chunk_size;
+    const size_t length = std::min<size_t>(chunk_size, message.size() - offset);
+
+    string out(CHUNK_HEADER_SIZE + tag_length + length, '\0');
+    char* p = &out[0];
+
+    std::memcpy(p, CHUNK_MAGIC, 4);
+    std::memcpy(p + 4, &index, 4);
+    std::memcpy(p + 8, &count, 4);
+    std::memcpy(p + 12, &chunk_size, 4);
+    std::memcpy(p + 16, &total_size, 8);
+    std::memcpy(p + 24, &tag_length, 2);
+    std::memcpy(p + 26, tag.data(), tag_length);
+    std::memcpy(p + 26 + tag_length, message.data() + offset, length);
+
+    return out;
+}
+
+/*
+    Returns:
+        The decoded chunk, pointing into message, or nothing if the message is not a consistent chunk
+*/
+inline std::optional<Chunk> parse_chunk(const string_view message) {
+    if(!is_chunk(message)) {
+        return std::nullopt;
+    }
+
+    const char* p = message.data();
+    Chunk chunk;
+    uint16_t tag_length;
+
+    std::memcpy(&chunk.index, p + 4, 4);
+    std::memcpy(&chunk.count, p + 8, 4);
+    std::memcpy(&chunk.chunk_size, p + 12, 4);
+    std::memcpy(&chunk.total_size, p + 16, 8);
+    std::memcpy(&tag_length, p + 24, 2);
+
+    if(message.size() < CHUNK_HEADER_SIZE + tag_length || chunk.chunk_size == 0 || chunk.index >= chunk.count
+        || chunk.count != chunk_count(chunk.total_size, chunk.chunk_size)) {
+        return std::nullopt;
+    }
+
+    chunk.tag = message.substr(CHUNK_HEADER_SIZE, tag_length);
+    chunk.data = message.substr(CHUNK_HEADER_SIZE + tag_length);
+
+    uint64_t offset = static_cast<uint64_t>(chunk.index) * chunk.chunk_size;
+    if(chunk.data.size() != std::min<uint64_t>(chunk.chunk_size, chunk.total_size - offset)) {
+        return std::nullopt;
+    }
+
+    return chunk;
+}
+
+/*
+    Reassembles the chunks of a response, in any order, into a buffer sized by the first chunk.  Keeps what it has across retries, so
+    that only the missing chunks need to be sent again.  Not thread safe
+*/
+class ChunkAssembler {
+private:
+    string tag_;
+    string buffer_;
+    std::vector<bool> received_;
+    uint32_t chunk_size_ = 0;
+    size_t remaining_ = 0;
+
+public:
+    /*
+        Copies a chunk into place.  A chunk of a different response than the one being assembled starts over
+
+        Returns:
+            True once every chunk of the response has arrived
+    */
+    bool add(const Chunk& chunk) {
+        if(chunk.tag != this->tag_ || chunk.total_size != this->buffer_.size() || chunk.chunk_size != this->chunk_size_
+            || this->received_.size() != chunk.count) {
+            this->tag_ = string(chunk.tag);
+            this->buffer_.resize(chunk.total_size);
+            this->received_.assign(chunk.count, false);
+            this->chunk_size_ = chunk.chunk_size;
+            this->remaining_ = chunk.count;
+        }
+
+        if(!this->received_[chunk.index]) {
+            std::memcpy(&this->buffer_[static_cast<size_t>(chunk.index) * chunk.chunk_size], chunk.data.data(), chunk.data.size());
+            this->received_[chunk.index] = true;
+            --this->remaining_;
+        }
+
+        return this->complete();
+    }
+
+    bool complete() const {
+        return !this->received_.empty() && this->remaining_ == 0;
+    }
+
+    // True if no chunk has arrived yet
+    bool empty() const {
+        return this->received_.empty();
+    }
+
+    const string& tag() const {
+        return this->tag_;
+    }
+
+    /*
+        Returns:
+            The indices of the chunks that have not arrived yet
+    */
+    std::vector<uint32_t> missing() const {
+        std::vector<uint32_t> out;
+        for(uint32_t i = 0; i < this->received_.size(); ++i) {
+            if(!this->received_[i]) {
+                out.push_back(i);
+            }
+        }
+
+        return out;
+    }
+
+    /*
+        Hands over the assembled response.  The assembler is empty afterwards
+    */
+    string take() {
+        string out = std::move(this->buffer_);
+        *this = ChunkAssembler();
+        return out;
+    }
+};
+
+} // namespace vizier
+
+#endif
@@ -0,0 +1,75 @@
+#include "vizier/vizier_node/chunking.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+namespace {
+    std::string make_message(const size_t size) {
+        std::string message(size, '\0');
+        for(size_t i = 0; i < size; ++i) {
+            message[i] = static_cast<char>('a' + i % 26);
+        }
+        return message;
+    }
+}
+
+TEST(Chunking, RoundTrip) {
+    std::string message = make_message(1000);
+    ASSERT_EQ(4, vizier::chunk_count(message.size(), 300));
+
+    std::string encoded = vizier::encode_chunk(message, 3, 300, "etag-1");
+    EXPECT_TRUE(vizier::is_chunk(encoded));
+    EXPECT_FALSE(vizier::is_chunk("{\"status\": \"200\"}"));
+
+    auto chunk = vizier::parse_chunk(encoded);
+    ASSERT_TRUE(bool(chunk));
+    EXPECT_EQ(3, chunk->index);
+    EXPECT_EQ(4, chunk->count);
+    EXPECT_EQ(300, chunk->chunk_size);
+    EXPECT_EQ(1000, chunk->total_size);
+    EXPECT_EQ("etag-1", chunk->tag);
+    EXPECT_EQ(message.substr(900), chunk->data);
+
+    // Truncated
+    EXPECT_FALSE(bool(vizier::parse_chunk(encoded.substr(0, encoded.size() - 1))));
+}
+
+TEST(Chunking, AssemblesOutOfOrder) {
+    std::string message = make_message(1000);
+    std::vector<std::string> chunks;
+    for(uint32_t i = 0; i < 4; ++i) {
+        chunks.push_back(vizier::encode_chunk(message, i, 300, "etag-1"));
+    }
+
+    vizier::ChunkAssembler assembler;
+    EXPECT_TRUE(assembler.empty());
+
+    EXPECT_FALSE(assembler.add(vizier::parse_chunk(chunks[2]).value()));
+    EXPECT_FALSE(assembler.add(vizier::parse_chunk(chunks[0]).value()));
+    // Duplicates are ignored
+    EXPECT_FALSE(assembler.add(vizier::parse_chunk(chunks[0]).value()));
+
+    EXPECT_EQ((std::vector<uint32_t>{1, 3}), assembler.missing());
+    EXPECT_EQ("etag-1", assembler.tag());
+
+    EXPECT_FALSE(assembler.add(vizier::parse_chunk(chunks[3]).value()));
+    EXPECT_TRUE(assembler.add(vizier::parse_chunk(chunks[1]).value()));
+    EXPECT_EQ(message, assembler.take());
+    EXPECT_TRUE(assembler.empty());
+}
+
+TEST(Chunking, NewResponseStartsOver) {
+    std::string old_message = make_message(1000);
+    std::string new_message = make_message(700);
+
+    vizier::ChunkAssembler assembler;
+    assembler.add(vizier::parse_chunk(vizier::encode_chunk(old_message, 0, 300, "etag-1")).value());
+
+    // The value changed between attempts
+    EXPECT_FALSE(assembler.add(vizier::parse_chunk(vizier::encode_chunk(new_message, 0, 300, "etag-2")).value()));
+    EXPECT_EQ((std::vector<uint32_t>{1, 2}), assembler.missing());
+
+    assembler.add(vizier::parse_chunk(vizier::encode_chunk(new_message, 1, 300, "etag-2")).value());
+    EXPECT_TRUE(assembler.add(vizier::parse_chunk(vizier::encode_chunk(new_message, 2, 300, "etag-2")).value()));
+    EXPECT_EQ(new_message, assembler.take());
+}
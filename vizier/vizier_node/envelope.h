@@ -0,0 +1,459 @@
+#ifndef VIZIER_VIZIER_NODE_ENVELOPE
+#define VIZIER_VIZIER_NODE_ENVELOPE
+
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace vizier {
+
+using string = std::string;
+using string_view = std::string_view;
+
+/*
+    Raw JSON text of the top-level values of a request or response message.  Each view points into the scanned message, so the message
+    must outlive the envelope.  A view is empty if the message does not contain the key.
+*/
+struct Envelope {
+    string_view id;
+    string_view method;
+    string_view link;
+    string_view status;
+    string_view type;
+    string_view body;
+    string_view version;
+    string_view base_version;
+    string_view instance;
+    string_view lease;
+    string_view etag;
+    // Clock-offset timestamps of a traced request or response
+    string_view trace;
+};
+
+namespace {
+    const char* skip_whitespace(const char* p, const char* end) {
+        while(p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            ++p;
+        }
+        return p;
+    }
+
+    /*
+        p points at an opening quote.  Returns a pointer just past the closing quote, or nullptr if the string is unterminated.
+        memchr does the heavy lifting, which keeps large bodies cheap to skip.
+    */
+    const char* skip_string(const char* p, const char* end) {
+        ++p;
+
+        while(p < end) {
+            const char* quote = static_cast<const char*>(std::memchr(p, '"', end - p));
+            if(quote == nullptr) {
+                return nullptr;
+            }
+
+            // The quote is escaped if it is preceded by an odd number of backslashes
+            size_t backslashes = 0;
+            for(const char* b = quote - 1; b >= p && *b == '\\'; --b) {
+                ++backslashes;
+            }
+
+            if(backslashes % 2 == 0) {
+                return quote + 1;
+            }
+
+            p = quote + 1;
+        }
+
+        return nullptr;
+    }
+
+    /*
+        p points at the first character of a value.  Returns a pointer just past the value, or nullptr if it is malformed.  Nested
+        containers are skipped by bracket counting without validating their contents.
+    */
+    const char* skip_value(const char* p, const char* end) {
+        if(p >= end) {
+            return nullptr;
+        }
+
+        if(*p == '"') {
+            return skip_string(p, end);
+        }
+
+        if(*p == '{' || *p == '[') {
+            size_t depth = 0;
+
+            while(p < end) {
+                if(*p == '"') {
+                    p = skip_string(p, end);
+                    if(p == nullptr) {
+                        return nullptr;
+                    }
+                    continue;
+                }
+
+                if(*p == '{' || *p == '[') {
+                    ++depth;
+                } else if(*p == '}' || *p == ']') {
+                    if(--depth == 0) {
+                        return p + 1;
+                    }
+                }
+
+                ++p;
+            }
+
+            return nullptr;
+        }
+
+        // Number, true, false or null
+        const char* start = p;
+        while(p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+            ++p;
+        }
+
+        return (p == start) ? nullptr : p;
+    }
+
+    int hex_value(const char c) {
+        if(c >= '0' && c <= '9') return c - '0';
+        if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    std::optional<uint32_t> read_hex4(const char* p, const char* end) {
+        if(end - p < 4) {
+            return std::nullopt;
+        }
+
+        uint32_t value = 0;
+        for(size_t i = 0; i < 4; ++i) {
+            int h = hex_value(p[i]);
+            if(h < 0) {
+                return std::nullopt;
+            }
+            value = (value << 4) | h;
+        }
+
+        return value;
+    }
+
+    char* write_utf8(uint32_t cp, char* out) {
+        if(cp < 0x80) {
+            *out++ = static_cast<char>(cp);
+        } else if(cp < 0x800) {
+            *out++ = static_cast<char>(0xC0 | (cp >> 6));
+            *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+        } else if(cp < 0x10000) {
+            *out++ = static_cast<char>(0xE0 | (cp >> 12));
+            *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            *out++ = static_cast<char>(0xF0 | (cp >> 18));
+            *out++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+        }
+
+        return out;
+    }
+
+    /*
+        Decodes the contents of a JSON string (without quotes) from in to out.  Decoding never grows the text, so out may equal in.
+
+        Returns:
+            The number of bytes written, or nothing if the string contains an invalid escape
+    */
+    std::optional<size_t> unescape(const char* in, const size_t length, char* out) {
+        const char* end = in + length;
+        char* start = out;
+
+        while(in < end) {
+            const char* backslash = static_cast<const char*>(std::memchr(in, '\\', end - in));
+            size_t run = (backslash == nullptr) ? (end - in) : (backslash - in);
+
+            std::memmove(out, in, run);
+            out += run;
+            in += run;
+
+            if(backslash == nullptr) {
+                break;
+            }
+
+            if(end - in < 2) {
+                return std::nullopt;
+            }
+
+            char c = in[1];
+            in += 2;
+
+            switch(c) {
+                case '"': *out++ = '"'; break;
+                case '\\': *out++ = '\\'; break;
+                case '/': *out++ = '/'; break;
+                case 'b': *out++ = '\b'; break;
+                case 'f': *out++ = '\f'; break;
+                case 'n': *out++ = '\n'; break;
+                case 'r': *out++ = '\r'; break;
+                case 't': *out++ = '\t'; break;
+                case 'u':
+                {
+                    std::optional<uint32_t> cp = read_hex4(in, end);
+                    if(!cp) {
+                        return std::nullopt;
+                    }
+                    in += 4;
+
+                    // Surrogate pair
+                    if(cp.value() >= 0xD800 && cp.value() <= 0xDBFF) {
+                        if(end - in < 6 || in[0] != '\\' || in[1] != 'u') {
+                            return std::nullopt;
+                        }
+
+                        std::optional<uint32_t> low = read_hex4(in + 2, end);
+                        if(!low || low.value() < 0xDC00 || low.value() > 0xDFFF) {
+                            return std::nullopt;
+                        }
+                        in += 6;
+
+                        cp = 0x10000 + ((cp.value() - 0xD800) << 10) + (low.value() - 0xDC00);
+                    }
+
+                    out = write_utf8(cp.value(), out);
+                }
+                break;
+
+                default:
+                    return std::nullopt;
+            }
+        }
+
+        return out - start;
+    }
+} // namespace
+
+/*
+    Visits the top-level members of a JSON object without building a DOM.
+
+    Args:
+        message: JSON text of an object
+        visit: called with the raw key (without quotes, still escaped) and the raw JSON text of the value of each member
+
+    Returns:
+        False if the message is not a well-formed object at the top level
+*/
+template<class Visitor>
+bool scan_json_object(const string_view message, Visitor&& visit) {
+    const char* p = message.data();
+    const char* end = p + message.size();
+
+    p = skip_whitespace(p, end);
+    if(p >= end || *p != '{') {
+        return false;
+    }
+
+    p = skip_whitespace(p + 1, end);
+    if(p < end && *p == '}') {
+        return true;
+    }
+
+    while(p < end) {
+        if(*p != '"') {
+            return false;
+        }
+
+        const char* key_end = skip_string(p, end);
+        if(key_end == nullptr) {
+            return false;
+        }
+        string_view key(p + 1, key_end - p - 2);
+
+        p = skip_whitespace(key_end, end);
+        if(p >= end || *p != ':') {
+            return false;
+        }
+
+        p = skip_whitespace(p + 1, end);
+        const char* value_end = skip_value(p, end);
+        if(value_end == nullptr) {
+            return false;
+        }
+
+        visit(key, string_view(p, value_end - p));
+
+        p = skip_whitespace(value_end, end);
+        if(p < end && *p == ',') {
+            p = skip_whitespace(p + 1, end);
+            continue;
+        }
+
+        return p < end && *p == '}';
+    }
+
+    return false;
+}
+
+/*
+    Locates the top-level fields of a request or response message.  Only the envelope is scanned; the body is skipped over, not parsed.
+
+    Returns:
+        The envelope, or nothing if the message is not a JSON object
+*/
+inline std::optional<Envelope> parse_envelope(const string_view message) {
+    Envelope envelope;
+
+    bool ok = scan_json_object(message, [&envelope](const string_view key, const string_view value) {
+        if(key == "id") envelope.id = value;
+        else if(key == "method") envelope.method = value;
+        else if(key == "link") envelope.link = value;
+        else if(key == "status") envelope.status = value;
+        else if(key == "type") envelope.type = value;
+        else if(key == "body") envelope.body = value;
+        else if(key == "version") envelope.version = value;
+        else if(key == "base_version") envelope.base_version = value;
+        else if(key == "instance") envelope.instance = value;
+        else if(key == "lease") envelope.lease = value;
+        else if(key == "etag") envelope.etag = value;
+        else if(key == "trace") envelope.trace = value;
+    });
+
+    if(!ok) {
+        return std::nullopt;
+    }
+
+    return envelope;
+}
+
+/*
+    Returns:
+        True if raw is the JSON text of a string
+*/
+inline bool is_json_string(const string_view raw) {
+    return raw.size() >= 2 && raw.front() == '"' && raw.back() == '"';
+}
+
+/*
+    Returns:
+        True if text, leading whitespace aside, starts like a JSON object or array.  Only these are embedded in messages as raw
+        bodies, as the JSON text of a string would be taken for an escaped body
+*/
+inline bool is_json_container(const string_view text) {
+    size_t first = text.find_first_not_of(" \t\r\n");
+    return first != string_view::npos && (text[first] == '{' || text[first] == '[');
+}
+
+/*
+    Decodes the JSON text of a string value
+
+    Returns:
+        The decoded string, or nothing if raw is not a valid JSON string
+*/
+inline std::optional<string> decode_json_string(const string_view raw) {
+    if(!is_json_string(raw)) {
+        return std::nullopt;
+    }
+
+    string out(raw.size() - 2, '\0');
+    std::optional<size_t> written = unescape(raw.data() + 1, raw.size() - 2, &out[0]);
+    if(!written) {
+        return std::nullopt;
+    }
+
+    out.resize(written.value());
+    return out;
+}
+
+/*
+    Decodes a JSON string value that lies inside message, reusing message's buffer instead of allocating a new one
+
+    Args:
+        message: message that raw points into.  Consumed
+        raw: JSON text of a string value within message
+
+    Returns:
+        The decoded string, or nothing if raw is not a valid JSON string
+*/
+inline std::optional<string> take_json_string(string&& message, const string_view raw) {
+    if(!is_json_string(raw) || raw.data() < message.data() || raw.data() + raw.size() > message.data() + message.size()) {
+        return std::nullopt;
+    }
+
+    size_t offset = raw.data() - message.data() + 1;
+    std::optional<size_t> written = unescape(&message[offset], raw.size() - 2, &message[0]);
+    if(!written) {
+        return std::nullopt;
+    }
+
+    message.resize(written.value());
+    return std::move(message);
+}
+
+/*
+    Extracts a raw JSON value that lies inside message, reusing message's buffer instead of allocating a new one
+
+    Args:
+        message: message that raw points into.  Consumed
+        raw: JSON text of a value within message
+
+    Returns:
+        The JSON text of the value, or nothing if raw does not point into message
+*/
+inline std::optional<string> take_json_value(string&& message, const string_view raw) {
+    if(raw.data() < message.data() || raw.data() + raw.size() > message.data() + message.size()) {
+        return std::nullopt;
+    }
+
+    size_t offset = raw.data() - message.data();
+    message.erase(offset + raw.size());
+    message.erase(0, offset);
+
+    return std::move(message);
+}
+
+/*
+    Returns:
+        The value of a JSON number that is a non-negative integer, or nothing if raw is not one
+*/
+inline std::optional<uint64_t> parse_json_uint(const string_view raw) {
+    uint64_t value = 0;
+    auto result = std::from_chars(raw.data(), raw.data() + raw.size(), value);
+
+    if(result.ec != std::errc() || result.ptr != raw.data() + raw.size()) {
+        return std::nullopt;
+    }
+
+    return value;
+}
+
+/*
+    Returns:
+        The value of a JSON number, or nothing if raw is not a number
+*/
+inline std::optional<double> parse_json_double(const string_view raw) {
+    if(raw.empty() || raw.size() > 64) {
+        return std::nullopt;
+    }
+
+    // strtod needs a terminated buffer
+    char buffer[65];
+    std::memcpy(buffer, raw.data(), raw.size());
+    buffer[raw.size()] = '\0';
+
+    char* end = nullptr;
+    double value = std::strtod(buffer, &end);
+
+    if(end != buffer + raw.size()) {
+        return std::nullopt;
+    }
+
+    return value;
+}
+
+} // namespace vizier
+
+#endif
@@ -0,0 +1,87 @@
+#include "vizier/vizier_node/envelope.h"
+#include "nlohmann/json.hpp"
+#include "gtest/gtest.h"
+#include <string>
+
+using json = nlohmann::json;
+
+TEST(ParseEnvelope, Request) {
+    json request = {
+        {"id", "node/abc"},
+        {"method", "GET"},
+        {"link", "node/1"},
+        {"body", {{"version", 12}, {"nested", {"}", "\\\"", {1, 2}}}}}
+    };
+    std::string message = request.dump();
+
+    auto envelope = vizier::parse_envelope(message);
+
+    ASSERT_TRUE(bool(envelope));
+    EXPECT_EQ("node/abc", vizier::decode_json_string(envelope->id).value());
+    EXPECT_EQ("GET", vizier::decode_json_string(envelope->method).value());
+    EXPECT_EQ("node/1", vizier::decode_json_string(envelope->link).value());
+    EXPECT_EQ(request["body"], json::parse(envelope->body));
+    EXPECT_TRUE(envelope->status.empty());
+}
+
+TEST(ParseEnvelope, Response) {
+    std::string body = "{\"map\": [1, 2, 3], \"name\": \"caf\xc3\xa9 \\u00e9\", \"tab\": \"\t\"}";
+    json response = {{"status", "200"}, {"body", body}, {"type", "DATA"}, {"version", 7}, {"trace", {{"t0", 1}, {"t1", 2}, {"t2", 3}}}};
+    std::string message = response.dump();
+
+    auto envelope = vizier::parse_envelope(message);
+
+    ASSERT_TRUE(bool(envelope));
+    EXPECT_EQ("200", vizier::decode_json_string(envelope->status).value());
+    EXPECT_EQ(7, vizier::parse_json_uint(envelope->version).value());
+    EXPECT_EQ(response["trace"], json::parse(envelope->trace));
+    EXPECT_TRUE(envelope->base_version.empty());
+    EXPECT_EQ(body, vizier::decode_json_string(envelope->body).value());
+    EXPECT_EQ(body, vizier::take_json_string(std::move(message), envelope->body).value());
+}
+
+TEST(ParseEnvelope, Whitespace) {
+    std::string message = " {\n \"status\" : \"503\" ,\t\"body\":\"\" , \"version\": 3 }";
+
+    auto envelope = vizier::parse_envelope(message);
+
+    ASSERT_TRUE(bool(envelope));
+    EXPECT_EQ("503", vizier::decode_json_string(envelope->status).value());
+    EXPECT_EQ("", vizier::decode_json_string(envelope->body).value());
+    EXPECT_EQ(3, vizier::parse_json_uint(envelope->version).value());
+}
+
+TEST(ParseEnvelope, Malformed) {
+    EXPECT_FALSE(bool(vizier::parse_envelope("")));
+    EXPECT_FALSE(bool(vizier::parse_envelope("[1, 2]")));
+    EXPECT_FALSE(bool(vizier::parse_envelope("{\"id\": \"unterminated}")));
+    EXPECT_FALSE(bool(vizier::parse_envelope("{\"id\": {\"a\": 1}")));
+    EXPECT_FALSE(bool(vizier::parse_envelope("{\"id\" \"x\"}")));
+    EXPECT_FALSE(bool(vizier::decode_json_string("\"bad \\x escape\"")));
+    EXPECT_FALSE(bool(vizier::parse_json_uint("-1")));
+    EXPECT_FALSE(bool(vizier::parse_json_uint("\"1\"")));
+}
+
+TEST(ParseEnvelope, UnicodeEscapes) {
+    EXPECT_EQ("\xf0\x9f\x98\x80", vizier::decode_json_string("\"\\ud83d\\ude00\"").value());
+    EXPECT_EQ("a/b\n", vizier::decode_json_string("\"a\\/b\\n\"").value());
+    EXPECT_FALSE(bool(vizier::decode_json_string("\"\\ud83d\"")));
+}
+
+TEST(ParseEnvelope, RawBody) {
+    std::string message = "{\"status\": \"200\", \"body\": {\"map\": [1, 2, {\"a\": \"}\"}]}, \"type\": \"DATA\"}";
+
+    auto envelope = vizier::parse_envelope(message);
+
+    ASSERT_TRUE(bool(envelope));
+    EXPECT_FALSE(vizier::is_json_string(envelope->body));
+    EXPECT_EQ("{\"map\": [1, 2, {\"a\": \"}\"}]}", vizier::take_json_value(std::move(message), envelope->body).value());
+}
+
+TEST(ParseEnvelope, JsonContainers) {
+    EXPECT_TRUE(vizier::is_json_container("{\"a\": 1}"));
+    EXPECT_TRUE(vizier::is_json_container(" \n[1, 2]"));
+    EXPECT_FALSE(vizier::is_json_container("\"abc\""));
+    EXPECT_FALSE(vizier::is_json_container("42"));
+    EXPECT_FALSE(vizier::is_json_container("  "));
+}
@@ -0,0 +1,278 @@
+#ifndef VIZIER_VIZIER_NODE_LINK_TABLE
+#define VIZIER_VIZIER_NODE_LINK_TABLE
+
+#include "nlohmann/json.hpp"
+#include "vizier/vizier_node/utils.h"
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vizier {
+
+using json = nlohmann::json;
+using string = std::string;
+using string_view = std::string_view;
+
+/*
+    What a node may do with a link.  Permissions are combined as bit flags
+*/
+struct LinkPermissions {
+    // Declared by this node.  Requests for it are answered
+    static constexpr uint8_t SERVE = 1 << 0;
+    // STREAM link of this node
+    static constexpr uint8_t PUBLISH = 1 << 1;
+    // DATA link of this node
+    static constexpr uint8_t PUT = 1 << 2;
+    // Requested DATA link of another node
+    static constexpr uint8_t GET = 1 << 3;
+    // Requested STREAM link of another node
+    static constexpr uint8_t SUBSCRIBE = 1 << 4;
+};
+
+/*
+    Everything a node knows about one link
+*/
+struct LinkRecord {
+    // Absolute path of the link, stored in the table's arena
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    LinkType type = LinkType::DATA;
+    uint8_t permissions = 0;
+    // Leaf descriptor of a link declared by this node, or null for requested links.  Points into the node descriptor, whose leaves
+    // stay put as other links are added to or removed from it
+    const json* descriptor = nullptr;
+};
+
+/*
+    Flat table of the links known to a node, sorted by path.  The paths of all links are stored back to back in a single arena, so
+    a table of thousands of links takes a handful of allocations and lookups by string_view never allocate.  The paths of erased links
+    stay in the arena until they make up half of it.
+
+    Not thread safe.  Nodes guard the table with a lock, as links can be added and removed at runtime
+*/
+class LinkTable {
+private:
+    string arena_;
+    std::vector<LinkRecord> records_;
+    // Bytes of the arena taken by the paths of erased links
+    size_t garbage_ = 0;
+
+    friend std::optional<LinkTable> parse_link_table(const json& descriptor);
+
+    // Appends a record without keeping the table sorted.  Followed by sort_ once all records are in
+    void append_(const string_view path, const LinkType type, const uint8_t permissions, const json* descriptor) {
+        LinkRecord record;
+        record.offset = static_cast<uint32_t>(this->arena_.size());
+        record.length = static_cast<uint32_t>(path.size());
+        record.type = type;
+        record.permissions = permissions;
+        record.descriptor = descriptor;
+
+        this->arena_.append(path);
+        this->records_.push_back(record);
+    }
+
+    // Sorts the records by path.  Duplicate paths are merged into the first record with that path, which keeps its type
+    void sort_() {
+        auto less = [this](const LinkRecord& a, const LinkRecord& b) {return this->path(a) < this->path(b);};
+        std::stable_sort(this->records_.begin(), this->records_.end(), less);
+
+        auto out = this->records_.begin();
+        for(auto it = this->records_.begin(); it != this->records_.end(); ++it) {
+            if(out != this->records_.begin() && this->path(*(out - 1)) == this->path(*it)) {
+                (out - 1)->permissions |= it->permissions;
+            } else {
+                *out++ = *it;
+            }
+        }
+
+        this->records_.erase(out, this->records_.end());
+    }
+
+    std::vector<LinkRecord>::const_iterator lower_bound_(const string_view path) const {
+        return std::lower_bound(this->records_.begin(), this->records_.end(), path,
+            [this](const LinkRecord& record, const string_view p) {return this->path(record) < p;});
+    }
+
+    std::vector<LinkRecord>::iterator lower_bound_(const string_view path) {
+        return this->records_.begin() + (static_cast<const LinkTable*>(this)->lower_bound_(path) - this->records_.cbegin());
+    }
+
+    // Rewrites the arena with only the paths of the links in the table
+    void compact_() {
+        string arena;
+        arena.reserve(this->arena_.size() - this->garbage_);
+
+        for(LinkRecord& record : this->records_) {
+            const uint32_t offset = static_cast<uint32_t>(arena.size());
+            arena.append(this->path(record));
+            record.offset = offset;
+        }
+
+        this->arena_.swap(arena);
+        this->garbage_ = 0;
+    }
+
+public:
+    /*
+        Returns:
+            The absolute path of a record of this table.  Valid until the table is modified
+    */
+    string_view path(const LinkRecord& record) const {
+        return string_view(this->arena_.data() + record.offset, record.length);
+    }
+
+    /*
+        Returns:
+            The record of a link, or null if the table does not contain it.  Valid until the table is modified
+    */
+    const LinkRecord* find(const string_view path) const {
+        auto it = this->lower_bound_(path);
+
+        if(it == this->records_.end() || this->path(*it) != path) {
+            return nullptr;
+        }
+
+        return &(*it);
+    }
+
+    /*
+        Returns:
+            True if the table contains the link and it has every permission in permissions
+    */
+    bool allows(const string_view path, const uint8_t permissions) const {
+        const LinkRecord* record = this->find(path);
+        return record != nullptr && (record->permissions & permissions) == permissions;
+    }
+
+    /*
+        Adds a link, or grants more permissions on a link already in the table.  The type and descriptor of an existing link are kept
+
+        Args:
+            path: absolute path of the link
+            type: type of the link
+            permissions: permissions granted on the link
+            descriptor: leaf descriptor of the link, if it is declared by this node
+    */
+    void insert(const string_view path, const LinkType type, const uint8_t permissions, const json* descriptor = nullptr) {
+        auto it = this->lower_bound_(path);
+
+        if(it != this->records_.end() && this->path(*it) == path) {
+            it->permissions |= permissions;
+            return;
+        }
+
+        LinkRecord record;
+        record.offset = static_cast<uint32_t>(this->arena_.size());
+        record.length = static_cast<uint32_t>(path.size());
+        record.type = type;
+        record.permissions = permissions;
+        record.descriptor = descriptor;
+
+        this->arena_.append(path);
+        this->records_.insert(it, record);
+    }
+
+    /*
+        Withdraws permissions on a link.  Does nothing if the table does not contain the link
+
+        Returns:
+            True if the link had any of the permissions
+    */
+    bool revoke(const string_view path, const uint8_t permissions) {
+        auto it = this->lower_bound_(path);
+
+        if(it == this->records_.end() || this->path(*it) != path) {
+            return false;
+        }
+
+        bool had = (it->permissions & permissions) != 0;
+        it->permissions &= ~permissions;
+        return had;
+    }
+
+    /*
+        Replaces the leaf descriptor of a link.  Does nothing if the table does not contain the link
+
+        Returns:
+            True if the table contains the link
+    */
+    bool set_descriptor(const string_view path, const json* descriptor) {
+        auto it = this->lower_bound_(path);
+
+        if(it == this->records_.end() || this->path(*it) != path) {
+            return false;
+        }
+
+        it->descriptor = descriptor;
+        return true;
+    }
+
+    /*
+        Removes a link along with all permissions on it
+
+        Returns:
+            True if the table contained the link
+    */
+    bool erase(const string_view path) {
+        auto it = this->lower_bound_(path);
+
+        if(it == this->records_.end() || this->path(*it) != path) {
+            return false;
+        }
+
+        this->garbage_ += it->length;
+        this->records_.erase(it);
+
+        if(this->garbage_ > this->arena_.size() / 2) {
+            this->compact_();
+        }
+
+        return true;
+    }
+
+    std::vector<LinkRecord>::const_iterator begin() const {
+        return this->records_.begin();
+    }
+
+    std::vector<LinkRecord>::const_iterator end() const {
+        return this->records_.end();
+    }
+
+    size_t size() const {
+        return this->records_.size();
+    }
+};
+
+/*
+    Parses the links declared by a node descriptor into a link table in a single pass.  DATA links are granted SERVE and PUT, STREAM
+    links SERVE and PUBLISH.  Requests are not included
+
+    Args:
+        descriptor: node descriptor.  Must outlive the table, which points to its leaf descriptors
+
+    Returns:
+        The table, or nothing if the descriptor is invalid
+*/
+inline std::optional<LinkTable> parse_link_table(const json& descriptor) {
+    LinkTable table;
+
+    bool ok = walk_descriptor(descriptor, [&table](const string_view path, const LinkType type, const json& leaf) {
+        uint8_t permissions = LinkPermissions::SERVE | ((type == LinkType::DATA) ? LinkPermissions::PUT : LinkPermissions::PUBLISH);
+        table.append_(path, type, permissions, &leaf);
+    });
+
+    if(!ok) {
+        return std::nullopt;
+    }
+
+    table.sort_();
+    return table;
+}
+
+} // namespace vizier
+
+#endif
@@ -0,0 +1,120 @@
+#include "vizier/vizier_node/link_table.h"
+#include "nlohmann/json.hpp"
+#include "gtest/gtest.h"
+#include <string>
+
+using json = nlohmann::json;
+using vizier::LinkPermissions;
+
+TEST(ParseLinkTable, Nested) {
+    json descriptor = {
+        {"endpoint", "node"},
+        {"links", {
+            {"/0", {{"type", "STREAM"}, {"compression", {{"codec", "DEFLATE"}}}}},
+            {"/1", {{"links", {
+                {"/2", {{"type", "DATA"}}},
+                {"node/1/3", {{"type", "DATA"}}}
+            }}}}
+        }}
+    };
+
+    auto table = vizier::parse_link_table(descriptor);
+
+    ASSERT_TRUE(bool(table));
+    EXPECT_EQ(3, table->size());
+
+    const vizier::LinkRecord* stream = table->find("node/0");
+    ASSERT_NE(nullptr, stream);
+    EXPECT_EQ(vizier::LinkType::STREAM, stream->type);
+    EXPECT_EQ(LinkPermissions::SERVE | LinkPermissions::PUBLISH, stream->permissions);
+    EXPECT_EQ(descriptor["links"]["/0"], *stream->descriptor);
+
+    EXPECT_TRUE(table->allows("node/1/2", LinkPermissions::SERVE | LinkPermissions::PUT));
+    EXPECT_TRUE(table->allows("node/1/3", LinkPermissions::PUT));
+    EXPECT_FALSE(table->allows("node/1/3", LinkPermissions::PUBLISH));
+    EXPECT_EQ(nullptr, table->find("node/1"));
+    EXPECT_EQ(nullptr, table->find("node/1/2/"));
+
+    // Records are sorted by path
+    std::vector<std::string> paths;
+    for(const auto& record : *table) {
+        paths.emplace_back(table->path(record));
+    }
+    EXPECT_EQ(std::vector<std::string>({"node/0", "node/1/2", "node/1/3"}), paths);
+}
+
+TEST(ParseLinkTable, Invalid) {
+    // Absolute links must lie beneath their parent
+    json outside = {{"endpoint", "node"}, {"links", {{"other/0", {{"type", "DATA"}}}}}};
+    EXPECT_FALSE(bool(vizier::parse_link_table(outside)));
+
+    json untyped = {{"endpoint", "node"}, {"links", {{"/0", json::object()}}}};
+    EXPECT_FALSE(bool(vizier::parse_link_table(untyped)));
+
+    json unknown_type = {{"endpoint", "node"}, {"links", {{"/0", {{"type", "BLOB"}}}}}};
+    EXPECT_FALSE(bool(vizier::parse_link_table(unknown_type)));
+
+    EXPECT_FALSE(bool(vizier::parse_link_table({{"links", json::object()}})));
+}
+
+TEST(LinkTable, InsertAndRevoke) {
+    json descriptor = {{"endpoint", "node"}, {"links", {{"/b", {{"type", "DATA"}}}}}};
+    auto table = vizier::parse_link_table(descriptor).value();
+
+    table.insert("other/a", vizier::LinkType::STREAM, LinkPermissions::SUBSCRIBE);
+    table.insert("other/c", vizier::LinkType::DATA, LinkPermissions::GET);
+    // Granting more permissions keeps the existing record
+    table.insert("node/b", vizier::LinkType::STREAM, LinkPermissions::GET);
+
+    EXPECT_EQ(3, table.size());
+    EXPECT_EQ(vizier::LinkType::DATA, table.find("node/b")->type);
+    EXPECT_TRUE(table.allows("node/b", LinkPermissions::PUT | LinkPermissions::GET));
+    EXPECT_TRUE(table.allows("other/a", LinkPermissions::SUBSCRIBE));
+    EXPECT_EQ(nullptr, table.find("other/a")->descriptor);
+
+    EXPECT_TRUE(table.revoke("node/b", LinkPermissions::PUT));
+    EXPECT_FALSE(table.revoke("node/b", LinkPermissions::PUT));
+    EXPECT_FALSE(table.allows("node/b", LinkPermissions::PUT));
+    EXPECT_TRUE(table.allows("node/b", LinkPermissions::SERVE));
+    EXPECT_FALSE(table.revoke("missing", LinkPermissions::PUT));
+
+    EXPECT_TRUE(table.set_descriptor("node/b", nullptr));
+    EXPECT_EQ(nullptr, table.find("node/b")->descriptor);
+    EXPECT_TRUE(table.set_descriptor("other/a", &descriptor["links"]["/b"]));
+    EXPECT_EQ(&descriptor["links"]["/b"], table.find("other/a")->descriptor);
+    EXPECT_FALSE(table.set_descriptor("missing", nullptr));
+}
+
+TEST(LinkTable, ManyLinks) {
+    json links = json::object();
+    for(int i = 0; i < 5000; ++i) {
+        links["/sensor_" + std::to_string(i)] = {{"type", (i % 2) ? "STREAM" : "DATA"}};
+    }
+    json descriptor = {{"endpoint", "robot"}, {"links", links}};
+
+    auto table = vizier::parse_link_table(descriptor);
+
+    ASSERT_TRUE(bool(table));
+    EXPECT_EQ(5000, table->size());
+    EXPECT_TRUE(table->allows("robot/sensor_4999", LinkPermissions::PUBLISH));
+    EXPECT_TRUE(table->allows("robot/sensor_0", LinkPermissions::PUT));
+}
+
+TEST(LinkTable, Erase) {
+    json descriptor = {{"endpoint", "node"}, {"links", {{"/a", {{"type", "DATA"}}}, {"/b", {{"type", "STREAM"}}}}}};
+    auto table = vizier::parse_link_table(descriptor).value();
+
+    for(int i = 0; i < 100; ++i) {
+        std::string link = "other/link_" + std::to_string(i);
+        table.insert(link, vizier::LinkType::STREAM, LinkPermissions::SUBSCRIBE);
+        EXPECT_TRUE(table.erase(link));
+        EXPECT_FALSE(table.erase(link));
+    }
+
+    // Erased paths are compacted away without disturbing the links left
+    EXPECT_EQ(2, table.size());
+    EXPECT_EQ("node/a", table.path(*table.begin()));
+    EXPECT_TRUE(table.allows("node/b", LinkPermissions::PUBLISH));
+    EXPECT_EQ(&descriptor["links"]["/b"], table.find("node/b")->descriptor);
+    EXPECT_EQ(nullptr, table.find("other/link_0"));
+}
@@ -0,0 +1,142 @@
+#ifndef VIZIER_VIZIER_NODE_TYPED_LINK
+#define VIZIER_VIZIER_NODE_TYPED_LINK
+
+#include "nlohmann/json.hpp"
+#include "vizier/vizier_node/utils.h"
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace vizier {
+
+using json = nlohmann::json;
+using string = std::string;
+using string_view = std::string_view;
+
+/*
+    Wire format of the values of a typed link
+*/
+enum class Encoding {
+    // The bytes of the value in host byte order.  Requires a trivially copyable type, and that all nodes on the link share the
+    // type's layout
+    BINARY,
+    // JSON through nlohmann's to_json/from_json, e.g. as generated by NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE
+    JSON,
+};
+
+/*
+    Turns values of type T into payloads and back.  Specialized per encoding, so the serializer of a link is fixed at compile time
+*/
+template <class T, Encoding ENCODING>
+struct LinkSerializer;
+
+template <class T>
+struct LinkSerializer<T, Encoding::BINARY> {
+    static_assert(std::is_trivially_copyable<T>::value, "BINARY links require a trivially copyable type");
+
+    /*
+        Writes the value into out, reusing its capacity
+    */
+    static void encode(const T& value, string& out) {
+        out.resize(sizeof(T));
+        std::memcpy(&out[0], &value, sizeof(T));
+    }
+
+    /*
+        Returns:
+            The value, or nothing if the payload does not have the size of T
+    */
+    static std::optional<T> decode(const string_view payload) {
+        if(payload.size() != sizeof(T)) {
+            return std::nullopt;
+        }
+
+        T value;
+        std::memcpy(&value, payload.data(), sizeof(T));
+        return value;
+    }
+};
+
+template <class T>
+struct LinkSerializer<T, Encoding::JSON> {
+    static void encode(const T& value, string& out) {
+        out = json(value).dump();
+    }
+
+    static std::optional<T> decode(const string_view payload) {
+        json decoded = json::parse(payload, nullptr, false);
+
+        if(decoded.is_discarded()) {
+            return std::nullopt;
+        }
+
+        try {
+            return decoded.get<T>();
+        } catch(const json::exception& e) {
+            return std::nullopt;
+        }
+    }
+};
+
+/*
+    Checks that a path names a link of some node: node/link/..., without empty levels or MQTT wildcards.  Usable in constant
+    expressions
+*/
+constexpr bool is_valid_link_path(const string_view path) {
+    if(path.empty() || path.front() == '/' || path.back() == '/' || path.find('/') == string_view::npos) {
+        return false;
+    }
+
+    for(size_t i = 0; i < path.size(); ++i) {
+        if(path[i] == '+' || path[i] == '#' || (path[i] == '/' && path[i + 1] == '/')) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+    A link whose values have type T.  The link type and wire format are part of the type, so publishing on a DATA link or getting a
+    value of the wrong type does not compile.  Meant to be declared once, as a constant shared by the nodes on both ends, e.g.
+
+        constexpr Link<Pose2D, LinkType::STREAM> pose("robot_1/pose");
+
+    A malformed path in a constant declaration is a compile error.  STREAM links default to BINARY and DATA links to JSON, as DATA
+    values are embedded in JSON responses
+*/
+template <class T, LinkType TYPE, Encoding ENCODING = (TYPE == LinkType::STREAM) ? Encoding::BINARY : Encoding::JSON>
+class Link {
+private:
+    string_view path_;
+
+public:
+    using value_type = T;
+    using serializer = LinkSerializer<T, ENCODING>;
+    static constexpr LinkType type = TYPE;
+    static constexpr Encoding encoding = ENCODING;
+
+    /*
+        Args:
+            path: absolute path of the link.  Must outlive the link; usually a string literal
+
+        Throws:
+            std::invalid_argument if the path is malformed.  In a constant expression, this is a compile error
+    */
+    constexpr explicit Link(const char* path) : path_(path) {
+        if(!is_valid_link_path(this->path_)) {
+            throw std::invalid_argument("Malformed link path");
+        }
+    }
+
+    constexpr string_view path() const {
+        return this->path_;
+    }
+};
+
+} // namespace vizier
+
+#endif
@@ -0,0 +1,76 @@
+#include "vizier/vizier_node/typed_link.h"
+#include "nlohmann/json.hpp"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+struct Pose2D {
+    double x;
+    double y;
+    double theta;
+};
+
+struct Gains {
+    std::vector<double> values;
+    std::string name;
+};
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Gains, values, name)
+
+// Evaluated at compile time
+constexpr vizier::Link<Pose2D, vizier::LinkType::STREAM> pose("robot/pose");
+constexpr vizier::Link<Gains, vizier::LinkType::DATA> gains("robot/control/gains");
+
+static_assert(decltype(pose)::encoding == vizier::Encoding::BINARY, "STREAM links default to BINARY");
+static_assert(decltype(gains)::encoding == vizier::Encoding::JSON, "DATA links default to JSON");
+static_assert(vizier::is_valid_link_path("robot/pose"), "");
+static_assert(!vizier::is_valid_link_path("robot"), "");
+static_assert(!vizier::is_valid_link_path("/robot/pose"), "");
+static_assert(!vizier::is_valid_link_path("robot/pose/"), "");
+static_assert(!vizier::is_valid_link_path("robot//pose"), "");
+static_assert(!vizier::is_valid_link_path("robot/+"), "");
+
+TEST(LinkSerializer, Binary) {
+    using serializer = decltype(pose)::serializer;
+
+    std::string buffer;
+    serializer::encode({1.0, -2.0, 0.25}, buffer);
+    EXPECT_EQ(sizeof(Pose2D), buffer.size());
+
+    // The buffer is reused for the next value
+    const char* data = buffer.data();
+    serializer::encode({3.0, 4.0, 5.0}, buffer);
+    EXPECT_EQ(data, buffer.data());
+
+    auto decoded = serializer::decode(buffer);
+    ASSERT_TRUE(bool(decoded));
+    EXPECT_EQ(3.0, decoded->x);
+    EXPECT_EQ(4.0, decoded->y);
+    EXPECT_EQ(5.0, decoded->theta);
+
+    EXPECT_FALSE(bool(serializer::decode(std::string(sizeof(Pose2D) - 1, '\0'))));
+}
+
+TEST(LinkSerializer, Json) {
+    using serializer = decltype(gains)::serializer;
+
+    std::string buffer;
+    serializer::encode({{1.5, 2.5}, "pd"}, buffer);
+    EXPECT_EQ(json({{"values", {1.5, 2.5}}, {"name", "pd"}}), json::parse(buffer));
+
+    auto decoded = serializer::decode(buffer);
+    ASSERT_TRUE(bool(decoded));
+    EXPECT_EQ(std::vector<double>({1.5, 2.5}), decoded->values);
+    EXPECT_EQ("pd", decoded->name);
+
+    EXPECT_FALSE(bool(serializer::decode("{\"values\": 3}")));
+    EXPECT_FALSE(bool(serializer::decode("not json")));
+}
+
+TEST(Link, MalformedPathThrowsAtRuntime) {
+    const char* path = "robot";
+    EXPECT_THROW((vizier::Link<Pose2D, vizier::LinkType::STREAM>(path)), std::invalid_argument);
+    EXPECT_EQ("robot/pose", std::string(pose.path()));
+}
@@ -9,6 +9,8 @@
 #include <algorithm>  // for std::generate_n #include <string>
 #include <optional>
 #include <spdlog/spdlog.h>
+#include "vizier/utils/compression/compression.h"
+#include "vizier/vizier_node/envelope.h"
 
 
 namespace vizier {
@@ -30,6 +32,7 @@ enum class LinkType {
 enum class Methods {
     GET,
     PUT,
+    WATCH,
 };
 
 /*
@@ -50,41 +53,17 @@ template<class T> using vector = std::vector<T>;
 template<class T> using optional = std::optional<T>;
 
 namespace {
-    std::vector<char> charset() {
-        return std::vector<char>( 
-        {'0','1','2','3','4',
-            '5','6','7','8','9',
-            'A','B','C','D','E','F',
-            'G','H','I','J','K',
-            'L','M','N','O','P',
-            'Q','R','S','T','U',
-            'V','W','X','Y','Z',
-            'a','b','c','d','e','f',
-            'g','h','i','j','k',
-            'l','m','n','o','p',
-            'q','r','s','t','u',
-            'v','w','x','y','z'
-        });
-    }   
-
-    //  Create a non-deterministic random number generator.
-    const auto ch_set = charset();
-    std::random_device seed;
-    std::default_random_engine rng(seed());
-    //  Create a random number "shaper" that will give us uniformly distributed indices into the character set
-    std::uniform_int_distribution<> dist(0, ch_set.size()-1);
+    //  URL-safe base64 alphabet.  Contains none of the MQTT topic special characters '/', '+' and '#'
+    constexpr char id_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
 
-    char rand_char() {
-        return ch_set[dist(rng)];
-    }
+    std::mt19937_64& id_engine() {
+        thread_local std::mt19937_64 engine([]() {
+            std::random_device device;
+            std::seed_seq seq{device(), device(), device(), device()};
+            return std::mt19937_64(seq);
+        }());
 
-    /*
-        TODO: Doc
-    */
-    string random_string(size_t length, std::function<char(void)> rand_char) {
-        string str(length, 0);
-        std::generate_n(str.begin(), length, rand_char);
-        return str;
+        return engine;
     }
 } // namespace
 
@@ -119,6 +98,10 @@ string methods_to_str(const Methods& method) {
             return "PUT";
         break;
 
+        case Methods::WATCH:
+            return "WATCH";
+        break;
+
         default:
             return "GET";
     }
@@ -136,17 +119,58 @@ optional<Methods> string_to_methods(const string& s) {
         return Methods::PUT;
     }
 
+    if(s == "WATCH") {
+        return Methods::WATCH;
+    }
+
     return std::nullopt;
 }
 
+/*
+    Number of characters in the random part of a message ID.  Carries 132 random bits
+*/
+constexpr size_t MESSAGE_ID_LENGTH = 22;
+
+/*
+    Writes a random identifier using 6 random bits per character from a URL-safe alphabet.  Uses a thread-local generator, so it is
+    thread safe and does not allocate.
+
+    Args:
+        out: buffer receiving length characters
+        length: number of characters to write
+*/
+void random_id(char* out, const size_t length) {
+    std::mt19937_64& engine = id_engine();
+    uint64_t bits = 0;
+    size_t available = 0;
+
+    for(size_t i = 0; i < length; ++i) {
+        if(available < 6) {
+            bits = engine();
+            available = 64;
+        }
+
+        out[i] = id_alphabet[bits & 0x3F];
+        bits >>= 6;
+        available -= 6;
+    }
+}
+
 /*
     Creates a unique message ID for a request
   
     Returns:
-        A random 64-byte message ID
+        node, followed by a slash and MESSAGE_ID_LENGTH random characters
 */
-string create_message_id(string node) {
-    return node + "/" + random_string(64, rand_char);
+string create_message_id(const string& node) {
+    string id;
+    id.reserve(node.size() + 1 + MESSAGE_ID_LENGTH);
+    id += node;
+    id += '/';
+    id.resize(node.size() + 1 + MESSAGE_ID_LENGTH);
+
+    random_id(&id[node.size() + 1], MESSAGE_ID_LENGTH);
+    return id;
 }
 
 /*
@@ -163,6 +187,41 @@ json create_response(const string& status, const string& body, const LinkType& t
     return create_response(status, string(body), topic_type);
 }
 
+/*
+    Serializes a GET response message.  Equivalent to dumping create_response, except that a JSON-encoded body can be spliced in as a
+    raw JSON value instead of being escaped into a string.
+
+    Args:
+        status: status of the response
+        body: body of the response
+        raw_body: if true, body must be valid JSON and is embedded as is
+        topic_type: type of the link
+        extra: additional top-level fields, such as version
+
+    Returns:
+        JSON text containing the keys: status, type, body and any keys of extra
+*/
+string dump_response(const string& status, const string& body, const bool raw_body, const LinkType& topic_type, const json& extra = json::object()) {
+    json head = extra;
+    head["status"] = status;
+    head["type"] = link_type_to_str(topic_type);
+
+    // Reopen the object and append the body as its last member
+    string out = head.dump();
+    out.pop_back();
+    out.reserve(out.size() + body.size() + 16);
+    out += ",\"body\":";
+
+    if(raw_body) {
+        out += body;
+    } else {
+        out += json(body).dump();
+    }
+
+    out += '}';
+    return out;
+}
+
 /*  
     Creates a response link for a node
  
@@ -173,6 +232,33 @@ string create_response_link(const string& node, const string& message_id) {
    return node + "/responses/" + message_id;
 }
 
+/*
+    Payloads of a node's status link.  The node publishes ONLINE on startup and the broker publishes its last will, OFFLINE, when the
+    node drops off.  Both are retained, so nodes subscribing later learn the current status straight away
+*/
+constexpr char NODE_ONLINE[] = "online";
+constexpr char NODE_OFFLINE[] = "offline";
+
+/*
+    Creates the status link of a node.  Reserved, like node_descriptor
+
+    Returns:
+        The status link for the node
+*/
+string create_status_link(const string& node) {
+    return node + "/node_status";
+}
+
+/*
+    Creates the link on which a node pushes the new values of one of its watched DATA links
+
+    Returns:
+        The watch link for link of node
+*/
+string create_watch_link(const string& node, const string& link) {
+    return node + "/watches/" + link;
+}
+
 /*
     Creates a request link for a node
 
@@ -204,6 +290,71 @@ json create_request(string id, Methods method, string link, json body) {
         {"body", std::move(body)}};
 }
 
+/*
+    Computes a JSON Patch (RFC 6902) that turns one JSON-encoded link body into another.  Used to answer GETs for DATA links with
+    only the changes since the version the requester already holds.
+
+    Args:
+        from: JSON-encoded body the patch applies to
+        to: JSON-encoded body the patch produces
+
+    Returns:
+        The patch as a JSON array, or nothing if either body is not valid JSON
+*/
+inline optional<json> create_json_patch(const string& from, const string& to) {
+    json source = json::parse(from, nullptr, false);
+    json target = json::parse(to, nullptr, false);
+
+    if(source.is_discarded() || target.is_discarded()) {
+        return std::nullopt;
+    }
+
+    return json::diff(source, target);
+}
+
+/*
+    Applies a JSON Patch (RFC 6902) produced by create_json_patch
+
+    Args:
+        base: decoded body the patch applies to
+        patch: JSON array of patch operations
+
+    Returns:
+        The patched body, or nothing if the patch does not apply to base
+*/
+inline optional<json> apply_json_patch(const json& base, const json& patch) {
+    try {
+        return base.patch(patch);
+    } catch(const json::exception& e) {
+        return std::nullopt;
+    }
+}
+
+/*
+    Creates a key function for JoinOptions that reads a numeric top-level field, such as a timestamp or sequence number, from
+    JSON-encoded messages
+
+    Args:
+        field: name of the field
+
+    Returns:
+        A function returning the field's value, or nothing if the message is not JSON or lacks a numeric field of that name
+*/
+std::function<optional<double>(const string&)> json_number_field(const string& field) {
+    return [field](const string& message) -> optional<double> {
+        optional<double> value;
+
+        // Scanning avoids building a DOM for every message on the dispatch thread
+        scan_json_object(message, [&field, &value](const string_view key, const string_view raw) {
+            if(key == field) {
+                value = parse_json_double(raw);
+            }
+        });
+
+        return value;
+    };
+}
+
 /*
     Returns true if path is a subpath of link.
 
@@ -245,65 +396,238 @@ string to_absolute_path(string base, string path) {
     }
 }
 
+namespace {
+    /*
+        Walks one level of a node descriptor.  The absolute path of the link is built in place in path, which is restored before
+        returning, so the walk does not allocate per link.
+    */
+    template <class F>
+    bool walk_links(string& path, const string& link, const json& descriptor, F& visit) {
+        const size_t parent_length = path.length();
+
+        // Relative links extend their parent.  Absolute links replace it, but must still lie beneath it
+        if(!link.empty() && link[0] == '/') {
+            path += link;
+        } else if(!link.empty()) {
+            if(link.compare(0, parent_length, path) != 0) {
+                return false;
+            }
+
+            path.assign(link);
+        }
+
+        auto links_it = descriptor.find("links");
+
+        if(links_it == descriptor.end() || links_it->size() == 0) {
+            // Leaf links must contain a type
+            auto type_it = descriptor.find("type");
+            if(type_it == descriptor.end()) {
+                return false;
+            }
+
+            if(*type_it == "STREAM") {
+                visit(string_view(path), LinkType::STREAM, descriptor);
+            } else if(*type_it == "DATA") {
+                visit(string_view(path), LinkType::DATA, descriptor);
+            } else {
+                return false;
+            }
+        } else {
+            for(const auto& item : links_it->items()) {
+                if(!walk_links(path, item.key(), item.value(), visit)) {
+                    return false;
+                }
+            }
+        }
+
+        path.resize(parent_length);
+        return true;
+    }
+} // namespace
+
+/*
+    Walks the links of a node descriptor in a single pass, calling visit for every leaf link
+
+    Args:
+        descriptor: node descriptor containing the key endpoint
+        visit: called as visit(path, type, leaf) with the absolute path of the link, its type and its descriptor.  The path is only
+            valid during the call
+
+    Returns:
+        False if the descriptor is invalid, in which case visit may already have been called for some links
+*/
+template <class F>
+bool walk_descriptor(const json& descriptor, F&& visit) {
+    auto endpoint_it = descriptor.find("endpoint");
+    if(endpoint_it == descriptor.end()) {
+        spdlog::error("Node descriptor must contain key 'endpoint'");
+        return false;
+    }
+
+    // The case where links is empty here is different from in recursive parsing
+    // so we handle it separately.
+    if(descriptor.count("links") == 0) {
+        return true;
+    }
+
+    string path;
+    return walk_links(path, endpoint_it->get<string>(), descriptor, visit);
+}
+
 /*
-    TODO: Doc
+    Expands a node descriptor into its leaf links
+
+    Returns:
+        The type of every leaf link keyed by its absolute path, or nothing if the descriptor is invalid
 */
-optional<unordered_map<string, LinkType>> parse_descriptor(const string& path, const string& link, const json& descriptor) {
+optional<unordered_map<string, LinkType>> parse_descriptor(const json& descriptor) {
+    unordered_map<string, LinkType> parsed_links;
 
-    auto link_here = to_absolute_path(path, link);
+    bool ok = walk_descriptor(descriptor, [&parsed_links](const string_view path, const LinkType type, const json& leaf) {
+        parsed_links.emplace(path, type);
+    });
 
-    if(!is_subpath_of(link_here, path)) {
+    if(!ok) {
         return std::nullopt;
     }
 
-    if(descriptor.count("links") == 0 || descriptor["links"].size() == 0) {
-        if(descriptor.count("type") == 1) {
+    return parsed_links;
+}
+
+namespace {
+    enum class EraseResult {NOT_FOUND, ERASED, EMPTIED};
 
-            if(descriptor["type"] == "STREAM") {
-                return unordered_map<string, LinkType>({{link_here, LinkType::STREAM}});
-            } else if(descriptor["type"] == "DATA") {
-                return unordered_map<string, LinkType>({{link_here, LinkType::DATA}});
-            } else {
-                return std::nullopt;
+    /*
+        Erases a leaf link from one level of a node descriptor, following the paths the way walk_links does
+
+        Returns:
+            EMPTIED if the link was erased and this level has no links left, so that the level above erases it in turn
+    */
+    EraseResult erase_links(string& path, const string& link, json& descriptor, const string_view target) {
+        const size_t parent_length = path.length();
+
+        if(!link.empty() && link[0] == '/') {
+            path += link;
+        } else if(!link.empty()) {
+            if(link.compare(0, parent_length, path) != 0) {
+                return EraseResult::NOT_FOUND;
             }
-        } else {
-            // This is an error.  Leaf links must contain a type
-            return std::nullopt;
+
+            path.assign(link);
         }
-    } else {
-        // Links is nonempty
-        unordered_map<string, LinkType> parsed_links;
 
-        for(const auto& item : descriptor["links"].items()) {
-            optional<unordered_map<string, LinkType>> pl = parse_descriptor(link_here, item.key(), item.value());
+        EraseResult result = EraseResult::NOT_FOUND;
+        auto links_it = descriptor.find("links");
 
-            if(!pl) {
-                return std::nullopt;
+        if(links_it == descriptor.end() || links_it->size() == 0) {
+            if(path == target) {
+                result = EraseResult::EMPTIED;
+            }
+        } else if(links_it->is_object()) {
+            for(auto it = links_it->begin(); it != links_it->end(); ++it) {
+                EraseResult erased = erase_links(path, it.key(), it.value(), target);
+                if(erased == EraseResult::NOT_FOUND) {
+                    continue;
+                }
+
+                if(erased == EraseResult::EMPTIED) {
+                    links_it->erase(it);
+                }
+
+                result = links_it->empty() ? EraseResult::EMPTIED : EraseResult::ERASED;
+                break;
             }
-
-            parsed_links.insert(pl->begin(), pl->end()); 
         }
 
-        return parsed_links;
+        path.resize(parent_length);
+        return result;
+    }
+} // namespace
+
+/*
+    Removes a leaf link from a node descriptor, along with the levels above it that are left without links.  Other leaves stay where
+    they are in memory, so pointers to them remain valid
+
+    Args:
+        descriptor: node descriptor containing the key endpoint
+        link: absolute path of the link
+
+    Returns:
+        False if the descriptor does not declare the link
+*/
+bool erase_descriptor_link(json& descriptor, const string_view link) {
+    auto endpoint_it = descriptor.find("endpoint");
+    if(endpoint_it == descriptor.end() || descriptor.count("links") == 0) {
+        return false;
+    }
+
+    string path;
+    EraseResult result = erase_links(path, endpoint_it->get<string>(), descriptor, link);
+
+    // No links is a valid descriptor, an empty links object is not
+    if(result == EraseResult::EMPTIED) {
+        descriptor.erase("links");
     }
+
+    return result != EraseResult::NOT_FOUND;
 }
 
 /*
-    TODO: Doc
+    Reads the optional compression settings of a leaf link, e.g.
+
+        {"type": "STREAM", "compression": {"codec": "DEFLATE", "threshold": 256, "level": 6, "dictionary": "..."}}
+
+    Every key except codec is optional.
+
+    Args:
+        link_descriptor: descriptor of a single leaf link
+
+    Returns:
+        The compression settings, with codec NONE if the link does not declare any, or nothing if the declaration is invalid
 */
-optional<unordered_map<string, LinkType>> parse_descriptor(const json& descriptor) {
-    if(descriptor.count("endpoint") == 0) {
-        spdlog::error("Node descriptor must contain key 'endpoint'");
+optional<CompressionOptions> parse_compression(const json& link_descriptor) {
+    CompressionOptions options;
+
+    if(link_descriptor.count("compression") == 0) {
+        return options;
+    }
+
+    const json& compression = link_descriptor["compression"];
+    if(!compression.is_object() || compression.count("codec") == 0 || !compression["codec"].is_string()) {
+        spdlog::error("Link compression must be an object containing key 'codec'");
         return std::nullopt;
     }
 
-    // The case where links is empty here is different from in recursive parsing
-    // so we handle it separately.
-    if(descriptor.count("links") == 0) {
-        return {};
+    string upper_codec(compression["codec"]);
+    std::for_each(upper_codec.begin(), upper_codec.end(), [](char& c) {c = toupper(c);});
+
+    if(upper_codec == "DEFLATE") {
+        options.codec = Codec::DEFLATE;
+    } else if(upper_codec == "NONE") {
+        options.codec = Codec::NONE;
+    } else {
+        spdlog::error("Link compression codec must be DEFLATE or NONE");
+        return std::nullopt;
+    }
+
+    try {
+        if(compression.count("threshold") == 1) {
+            options.threshold = compression["threshold"];
+        }
+
+        if(compression.count("level") == 1) {
+            options.level = compression["level"];
+        }
+
+        if(compression.count("dictionary") == 1) {
+            options.dictionary = std::make_shared<const string>(compression["dictionary"].get<string>());
+        }
+    } catch(const json::type_error& e) {
+        spdlog::error("Invalid link compression settings: {0}", e.what());
+        return std::nullopt;
     }
 
-    return parse_descriptor("", descriptor["endpoint"], descriptor);
+    return options;
 }
 
 /*
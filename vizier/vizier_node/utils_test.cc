@@ -2,16 +2,50 @@
 #include "nlohmann/json.hpp"
 #include "gtest/gtest.h"
 #include <iostream>
+#include <thread>
 #include <tuple>
+#include <unordered_set>
+#include <vector>
 
 using json = nlohmann::json;
 const int FUZZY_LENGTH = 100;
 
 TEST(CreateMessageId, CreatesCorrectIdLength) {
-    auto expected = size_t(64);
+    auto expected = vizier::MESSAGE_ID_LENGTH + 1;
     for(int i = 0; i < FUZZY_LENGTH; ++i) {
         EXPECT_EQ(expected, vizier::create_message_id("").length());
     }
+
+    EXPECT_EQ("node/", vizier::create_message_id("node").substr(0, 5));
+}
+
+TEST(CreateMessageId, UniqueAcrossThreads) {
+    const size_t per_thread = 10000;
+    std::vector<std::vector<std::string>> ids(4);
+    std::vector<std::thread> threads;
+
+    for(auto& thread_ids : ids) {
+        threads.emplace_back([&thread_ids, per_thread]() {
+            for(size_t i = 0; i < per_thread; ++i) {
+                thread_ids.push_back(vizier::create_message_id("node"));
+            }
+        });
+    }
+
+    for(auto& t : threads) {
+        t.join();
+    }
+
+    std::unordered_set<std::string> unique;
+    for(const auto& thread_ids : ids) {
+        for(const auto& id : thread_ids) {
+            EXPECT_EQ(std::string::npos, id.find_first_of("+#", 5));
+            EXPECT_EQ(std::string::npos, id.find('/', 5));
+            unique.insert(id);
+        }
+    }
+
+    EXPECT_EQ(4 * per_thread, unique.size());
 }
 
 TEST(CreateResponse, CreatesCorrectResponse) {
@@ -38,7 +72,8 @@ TEST(CreateResponse, CreatesCorrectResponse) {
 TEST(CreateResponse, CreatesCorrectResponseFuzzy) {
     for(int i = 0; i < FUZZY_LENGTH; ++i) {
 
-        auto status = vizier::random_string(FUZZY_LENGTH, vizier::rand_char);
+        std::string status(FUZZY_LENGTH, '\0');
+        vizier::random_id(&status[0], status.size());
         auto type = "DATA";
 
         json body = {
@@ -110,6 +145,38 @@ TEST(ParseNodeDescriptor, Intermediate) {
     EXPECT_EQ(expected, result.value());
 } 
 
+TEST(EraseDescriptorLink, PrunesEmptyLevels) {
+    json descriptor = {
+        {"endpoint", "node"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}},
+                {"/1", {{"links", {{"/2", {{"type", "DATA"}}}}}}}
+            }
+        }
+    };
+
+    const json* kept = &descriptor["links"]["/0"];
+
+    EXPECT_FALSE(vizier::erase_descriptor_link(descriptor, "node/1"));
+    EXPECT_TRUE(vizier::erase_descriptor_link(descriptor, "node/1/2"));
+
+    // The intermediate link went with its only leaf, and the other leaf did not move
+    EXPECT_EQ(0, descriptor["links"].count("/1"));
+    EXPECT_EQ(kept, &descriptor["links"]["/0"]);
+
+    std::unordered_map<std::string, vizier::LinkType> expected = {
+        {"node/0", vizier::LinkType::STREAM}
+    };
+    EXPECT_EQ(expected, vizier::parse_descriptor(descriptor).value());
+
+    // Still a valid descriptor without any links
+    EXPECT_TRUE(vizier::erase_descriptor_link(descriptor, "node/0"));
+    EXPECT_EQ(0, descriptor.count("links"));
+    EXPECT_TRUE(vizier::parse_descriptor(descriptor).value().empty());
+}
+
 TEST(GetRequestsFromDesriptor, EmptyRequests) {
     json descriptor = {
         {"requests", {}}
@@ -150,4 +217,40 @@ TEST(GetRequestsFromDesriptor, NoRequests) {
     json descriptor = {};
     auto result = vizier::get_requests_from_descriptor(descriptor);
     EXPECT_EQ(expected, result.value());
-}
\ No newline at end of file
+}
+
+TEST(JsonPatch, RoundTrip) {
+    json from = {{"a", 1}, {"b", {1, 2, 3}}};
+    json to = {{"a", 2}, {"b", {1, 2, 3, 4}}, {"c", "new"}};
+
+    auto patch = vizier::create_json_patch(from.dump(), to.dump());
+
+    EXPECT_TRUE(bool(patch));
+    EXPECT_EQ(to, vizier::apply_json_patch(from, patch.value()).value());
+}
+
+TEST(JsonPatch, NonJsonBody) {
+    EXPECT_FALSE(bool(vizier::create_json_patch("not json", "{}")));
+    EXPECT_FALSE(bool(vizier::apply_json_patch(json::object(), json::parse(R"([{"op": "remove", "path": "/missing"}])"))));
+}
+
+TEST(DumpResponse, MatchesCreateResponse) {
+    std::string body = "{\"msg\": \"a \\\"quoted\\\" value\"}";
+    json extra = {{"version", 3}};
+
+    json expected = vizier::create_response("200", body, vizier::LinkType::DATA);
+    EXPECT_EQ(expected, json::parse(vizier::dump_response("200", body, false, vizier::LinkType::DATA)));
+
+    expected["version"] = 3;
+    EXPECT_EQ(expected, json::parse(vizier::dump_response("200", body, false, vizier::LinkType::DATA, extra)));
+}
+
+TEST(DumpResponse, RawBody) {
+    std::string body = "{\"msg\": [1, 2, 3]}";
+
+    json response = json::parse(vizier::dump_response("200", body, true, vizier::LinkType::DATA));
+
+    EXPECT_EQ("200", response["status"]);
+    EXPECT_EQ("DATA", response["type"]);
+    EXPECT_EQ(json::parse(body), response["body"]);
+}
@@ -3,12 +3,29 @@
 
 #include "nlohmann/json.hpp"
 #include "vizier/vizier_node/utils.h"
+#include "vizier/vizier_node/chunking.h"
+#include "vizier/vizier_node/envelope.h"
+#include "vizier/vizier_node/link_table.h"
+#include "vizier/vizier_node/typed_link.h"
 #include "spdlog/spdlog.h"
+#include "vizier/utils/logging/logging.h"
 #include "vizier/utils/mqttclient/mqttclient_async.h"
+#include "vizier/utils/shmring/shmring.h"
+#include "vizier/utils/tracing/tracing.h"
+#include "vizier/utils/trafficlog/trafficlog.h"
 #include "vizier/utils/tsqueue/tsqueue.h"
+#include "vizier/utils/workerpool/workerpool.h"
+#include "vizier/utils/streamjoin/streamjoin.h"
 #include <unordered_set>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
 #include <optional>
 #include <memory>
+#include <shared_mutex>
+#include <thread>
+#include <unistd.h>
 
 #include <iostream>
 
@@ -17,7 +34,8 @@ namespace vizier {
 
 enum class ReponseCodes {
     ERROR = 404,
-    OK = 200
+    OK = 200,
+    UNAVAILABLE = 503
 };
 
 using json = nlohmann::json;
@@ -28,6 +46,81 @@ template<class T> using vector = std::vector<T>;
 template<class T, class U> using unordered_map = std::unordered_map<T, U>;
 template<class T> using unordered_set = std::unordered_set<T>;
 template<class T> using shared_ptr = std::shared_ptr<T>;
+template<class T> using unique_ptr = std::unique_ptr<T>;
+
+/*
+    PoD for optional node settings
+*/
+struct NodeOptions {
+    // Number of threads serving incoming requests.  If zero, requests are served inline on the MQTT client's message thread
+    size_t request_workers = 2;
+    // Maximum number of requests waiting for a worker.  Requests arriving when this is full are answered with status 503
+    size_t request_queue_size = 128;
+    // Number of past versions of each JSON-encoded DATA link kept so that GETs can be answered with a patch against the version the
+    // requester already holds.  Zero disables delta responses
+    size_t data_history = 0;
+    // Embed JSON-encoded DATA link values in GET responses as raw JSON instead of escaping them into a string, for requesters that
+    // accept it.  Saves an escape pass on this node and an unescape pass on the requester
+    bool raw_json_bodies = true;
+    // How long values of other nodes' DATA links fetched by get are served from a cache without asking the owning node.  Once
+    // expired, a cached value is revalidated by etag, so an unchanged value is not sent again.  Concurrent gets of the same link
+    // share one request.  Zero disables the cache and coalescing
+    std::chrono::milliseconds get_cache_ttl = std::chrono::milliseconds(0);
+    // Requests to nodes known to be offline fail immediately.  If set, they instead wait for the node to come back, for at most
+    // their retries times their timeout
+    bool wait_for_offline_nodes = false;
+    // How long a WATCH keeps a DATA link of this node watched.  Watching nodes renew their watches halfway through the lease
+    std::chrono::milliseconds watch_lease = std::chrono::seconds(30);
+    // Ring file holding messages of STREAM links declared with a "spool" while the broker is unreachable.  Reopened on restart,
+    // so a crash does not lose the backlog.  Empty for no spool
+    string spool_path;
+    // Size of the spool file in bytes
+    size_t spool_capacity = 64 << 20;
+    // Messages per second sent from the spool once the broker is back
+    double spool_drain_rate = 1000;
+    // GET responses larger than this are sent in chunks of this size, to requesters that accept them.  Chunks are interleaved with
+    // other messages rather than blocking the connection, and a retried GET only asks for the chunks it is missing.  Zero disables
+    // chunking
+    size_t response_chunk_size = 256 << 10;
+    // Connect with the endpoint as client id and ask the broker to keep this node's subscriptions across disconnects, so that a
+    // broker restart does not make every node resubscribe at once.  Only one node per endpoint may be connected at a time
+    bool persistent_session = false;
+    // Seconds to wait before reconnecting to the broker, doubled after every failed attempt up to reconnect_delay_max
+    unsigned int reconnect_delay = 1;
+    unsigned int reconnect_delay_max = 30;
+    // Return from the constructor without waiting for the broker, which need not be up yet.  The node announces itself once it is
+    // connected.  See VizierNode::ready
+    bool connect_async = false;
+    // How long startup may take: connecting, and hearing from the node owning every required request that it declares the link
+    std::chrono::milliseconds startup_timeout = std::chrono::seconds(10);
+    // Publish every STREAM link traced, and stamp requests so that responding nodes report their clock.  Subscribers then break down
+    // the latency of traced links into queueing, transit and dispatch, see VizierNode::latency.  Links can also be traced one at a
+    // time with "trace": true in the descriptor
+    bool trace = false;
+    // Preset dictionaries that compressed messages from other nodes may refer to.  Dictionaries declared in this node's own
+    // descriptor are registered automatically
+    vector<string> compression_dictionaries;
+    // Log every message this node publishes and receives is appended to, for reproducing a problem with the exact traffic that
+    // caused it, see VizierNode::replay.  Replaced if it exists.  Empty for no recording
+    string record_path;
+    // Size of the log in bytes.  Traffic beyond it is not recorded
+    size_t record_capacity = size_t(256) << 20;
+};
+
+/*
+    PoD for the options of VizierNode::replay
+*/
+struct ReplayOptions {
+    // Pace relative to the recording, e.g. 10 for ten times as fast.  Zero replays as fast as possible
+    double speed = 1;
+    // Republish the recorded messages of STREAM links of this node
+    bool published = true;
+    // Hand the recorded messages of STREAM links this node subscribes to to its subscribers, as if they came from the broker
+    bool received = false;
+    // Replay the messages recorded in this interval, in nanoseconds since the epoch.  Zero for no bound
+    int64_t from = 0;
+    int64_t until = 0;
+};
 
 
 /*
@@ -39,285 +132,2476 @@ class VizierNode {
 private:
     const string host_;
     const int port_;
-    const json descriptor_;
+    // Updated as links and requests are added and removed.  Guarded by links_mutex_
+    json descriptor_;
     string request_link_;
     MqttClientAsync mqtt_client_;
 
     string endpoint_;
-    unordered_map<string, LinkType> expanded_links_;
     vector<RequestData> requests_;
-    unordered_set<string> puttable_links_;
-    unordered_set<string> publishable_links_;
-    unordered_set<string> gettable_links_;
-    unordered_set<string> subscribable_links_;
-    unordered_map<string, string> link_data_;
+    // Links of this node and links it requests, with what it may do with each
+    LinkTable links_;
+    // Guards descriptor_, requests_, links_, link_options_ and shm_rings_.  Taken before link_data_mutex_
+    std::shared_mutex links_mutex_;
+    /*
+        Value of a DATA link.  is_json marks values that can be embedded in responses without escaping
+    */
+    struct LinkData {
+        string data;
+        bool is_json = false;
+        // Incremented by every put, so that watchers can order the values pushed to them
+        uint64_t version = 0;
+    };
 
-    /* 
-        TODO: Doc
+    unordered_map<string, LinkData> link_data_;
+    std::shared_mutex link_data_mutex_;
+    bool raw_json_bodies_;
+
+    /*
+        Version history of a DATA link.  patches[i] turns version (version - patches.size() + i) into the next version
     */
-    optional<string> make_request(json body, const Methods method, const string& link, const size_t& retries, const std::chrono::milliseconds& timeout) {
-        string id = create_message_id(this->endpoint_);
+    struct LinkHistory {
+        uint64_t version = 0;
+        std::deque<json> patches;
+    };
 
-        json request = create_request(id, method, link, std::move(body));
+    // Guarded by link_data_mutex_
+    unordered_map<string, LinkHistory> link_history_;
+    size_t data_history_;
 
-        size_t found = link.find_first_of('/');
+    /*
+        Last full body received for a remote DATA link that the serving node versions, kept so later GETs can be answered with a patch
+    */
+    struct RemoteVersion {
+        uint64_t version = 0;
+        json body;
+    };
 
-        if(found == string::npos) {
-            spdlog::error("Invalid link {0}. Structure should be node_name/link/link...");
+    unordered_map<string, RemoteVersion> remote_versions_;
+    std::mutex remote_versions_mutex_;
+
+    /*
+        Value of another node's DATA link cached by get
+    */
+    struct CachedValue {
+        string body;
+        string etag;
+        std::chrono::steady_clock::time_point fetched;
+    };
+
+    /*
+        Outcome of a GET.  body is empty if the owning node confirmed that the value with the requested etag is still current
+    */
+    struct Fetched {
+        optional<string> body;
+        string etag;
+    };
+
+    /*
+        Fetch of a link by get that other threads share.  Ends it if get leaves early, e.g. because the fetch threw: the link is no
+        longer in flight and the threads sharing the fetch get nothing
+    */
+    struct InflightGet {
+        VizierNode& node;
+        const string& link;
+        std::promise<optional<string>>& promise;
+        // Lock of get_cache_mutex_ held by get, if it left while holding it
+        std::unique_lock<std::mutex>& lock;
+        bool settled = false;
+
+        ~InflightGet() {
+            if(this->settled) {
+                return;
+            }
+
+            if(!this->lock.owns_lock()) {
+                this->lock.lock();
+            }
+
+            this->node.inflight_gets_.erase(this->link);
+            this->lock.unlock();
+
+            this->promise.set_value(std::nullopt);
+        }
+    };
+
+    // Guarded by get_cache_mutex_
+    unordered_map<string, CachedValue> get_cache_;
+    unordered_map<string, std::shared_future<optional<string>>> inflight_gets_;
+    std::mutex get_cache_mutex_;
+    std::chrono::milliseconds get_cache_ttl_;
+
+    // Publish options of links that declare compression
+    unordered_map<string, PublishOptions> link_options_;
+    // Whether the client has a spool for links that ask for one
+    bool has_spool_;
+    size_t response_chunk_size_;
+
+    /*
+        Request waiting for a worker, with when it arrived, which a traced request reports as the time the node received it
+    */
+    struct IncomingRequest {
+        string message;
+        int64_t received;
+    };
+
+    unique_ptr<WorkerPool<IncomingRequest>> request_pool_;
+
+    // Liveness of the nodes that this node makes requests to, as announced on their status links.  Nodes that never announced their
+    // status are assumed to be online.  Guarded by node_status_mutex_
+    unordered_map<string, bool> node_online_;
+    std::mutex node_status_mutex_;
+    std::condition_variable node_status_cv_;
+    bool wait_for_offline_nodes_;
+
+    // Random identifier of this node instance.  Watchers compare versions only between values from the same instance
+    string instance_;
+    // Shared-memory rings of the STREAM links of this node declared with "shm"
+    unordered_map<string, unique_ptr<ShmRing>> shm_rings_;
+    // Number of segments created, so that a ring created for a link added at runtime never reuses a name
+    size_t shm_segments_ = 0;
+    // Host name carried in shm frames, so that subscribers on other hosts can tell the segment is out of reach
+    string hostname_;
+
+    /*
+        Segment of another node's shm link.  Replaced when the node restarts and publishes from a new segment
+    */
+    struct ShmSubscription {
+        string segment;
+        unique_ptr<ShmRingReader> reader;
+    };
+
+    /*
+        Readers of the segments of other nodes' shm links.  Shared with the callbacks of subscriptions, which outlive the node
+    */
+    struct ShmReaders {
+        // Host name of this node, which frames must carry to be readable here
+        string hostname;
+        std::mutex mutex;
+        // Guarded by mutex
+        unordered_map<string, ShmSubscription> subscriptions;
+    };
+
+    shared_ptr<ShmReaders> shm_readers_ = std::make_shared<ShmReaders>();
+
+    // Expiry of the watches on links of this node.  Guarded by link_data_mutex_
+    unordered_map<string, std::chrono::steady_clock::time_point> watched_links_;
+    std::chrono::milliseconds watch_lease_;
+
+    /*
+        A DATA link of another node that this node watches
+    */
+    struct Watch {
+        shared_ptr<ThreadSafeQueue<string>> queue;
+        // Instance and version of the last value delivered to the queue
+        string instance;
+        uint64_t version = 0;
+        size_t retries = 0;
+        std::chrono::milliseconds timeout;
+        // When the watch is next renewed
+        std::chrono::steady_clock::time_point refresh = std::chrono::steady_clock::time_point::max();
+    };
+
+    /*
+        Wakes the watch thread.  Shared with the MQTT client's connect listener, which may outlive the node's other members
+    */
+    struct WatchSignal {
+        std::mutex mutex;
+        std::condition_variable cv;
+        // Renew every watch, because the connection to the broker was re-established
+        bool rewatch = false;
+        bool stop = false;
+    };
+
+    // Guarded by watch_signal_->mutex
+    unordered_map<string, Watch> watches_;
+    shared_ptr<WatchSignal> watch_signal_ = std::make_shared<WatchSignal>();
+    std::thread watch_thread_;
+
+    /*
+        Wakes the startup thread.  Shared with the MQTT client's connect listener, like WatchSignal
+    */
+    struct StartupSignal {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool connected = false;
+        bool stop = false;
+    };
+
+    // Time given to each node owning required requests to send its descriptor, before asking again
+    static constexpr std::chrono::milliseconds STARTUP_ATTEMPT = std::chrono::milliseconds(250);
+
+    shared_ptr<StartupSignal> startup_signal_ = std::make_shared<StartupSignal>();
+    std::promise<bool> ready_promise_;
+    std::shared_future<bool> ready_ = ready_promise_.get_future().share();
+    std::thread startup_thread_;
+
+    bool trace_;
+    // Latency of the traced links this node subscribes to, and clock offsets of the nodes it made traced requests to.  Guarded by
+    // trace_mutex_
+    unordered_map<string, LatencyBreakdown> latency_;
+    unordered_map<string, ClockOffsetEstimator> clock_offsets_;
+    std::mutex trace_mutex_;
+
+    /*
+        Reads the compression settings, publishing policy, spool retention, priority and tracing of a leaf link, e.g.
+
+            {"type": "STREAM", "policy": {"max_rate": 30, "burst": 1, "decimation": 1, "conflate": true},
+             "spool": {"max_age": 60, "on_full": "DROP_OLDEST"}, "priority": "CRITICAL", "trace": true}
+
+        Every policy and spool key is optional.  max_age is in seconds, and zero keeps spooled messages until they are sent.  on_full
+        is DROP_OLDEST or DROP_NEWEST.  priority is CRITICAL, HIGH, NORMAL (the default) or LOW.
+
+        Returns:
+            The publish options, or nothing if the declaration is invalid
+    */
+    static optional<PublishOptions> parse_publish_options_(const json& link_descriptor) {
+        optional<CompressionOptions> compression = parse_compression(link_descriptor);
+        if(!compression) {
             return std::nullopt;
         }
 
-        string remote_node = link.substr(0, found);
-        string response_link = create_response_link(remote_node, id);
-        string request_link = create_request_link(remote_node);
+        PublishOptions options;
+        options.compression = std::move(compression.value());
 
-        optional<shared_ptr<ThreadSafeQueue<string>>> maybe_q = this->mqtt_client_.subscribe(response_link);
-        if(!maybe_q) {
+        if(link_descriptor.count("spool") == 1 && !parse_spool_(link_descriptor["spool"], options)) {
             return std::nullopt;
         }
 
-        auto q = maybe_q.value();
-        optional<string> message;
+        if(link_descriptor.count("priority") == 1) {
+            optional<Priority> priority = parse_priority_(link_descriptor["priority"]);
+            if(!priority) {
+                spdlog::error("Link priority must be one of CRITICAL, HIGH, NORMAL or LOW");
+                return std::nullopt;
+            }
 
-        for(size_t i = 0; i < retries; ++i) {
-            this->mqtt_client_.async_publish(request_link, request.dump());
-            message = q->dequeue(timeout);
+            options.priority = priority.value();
+        }
 
-            if(!message) {
-                spdlog::info("Request timed out.  Retrying");
-                continue;
-            } else {
-                break;
+        if(link_descriptor.count("trace") == 1) {
+            if(!link_descriptor["trace"].is_boolean()) {
+                spdlog::error("Link trace must be true or false");
+                return std::nullopt;
             }
+
+            options.trace = link_descriptor["trace"];
+        }
+
+        if(link_descriptor.count("policy") == 0) {
+            return options;
         }
 
-        if(!message) {
+        const json& policy = link_descriptor["policy"];
+        if(!policy.is_object()) {
+            spdlog::error("Link policy must be an object");
             return std::nullopt;
         }
 
-        json json_message;
         try {
-            json_message = std::move(json::parse(message.value()));
-        } catch (const json::parse_error& e) {
-            spdlog::error("Failure parsing json message");
+            if(policy.count("max_rate") == 1) {
+                options.max_rate = policy["max_rate"];
+            }
+
+            if(policy.count("burst") == 1) {
+                options.burst = policy["burst"];
+            }
+
+            if(policy.count("decimation") == 1) {
+                options.decimation = policy["decimation"];
+            }
+
+            if(policy.count("conflate") == 1) {
+                options.conflate = policy["conflate"];
+            }
+        } catch(const json::type_error& e) {
+            spdlog::error("Invalid link policy: {0}", e.what());
             return std::nullopt;
         }
 
-        if(json_message.count("body") == 0) {
-            spdlog::error("GET response received with no body");
+        if(options.max_rate < 0 || options.burst == 0 || options.decimation == 0) {
+            spdlog::error("Link policy max_rate must be non-negative and burst and decimation must be positive");
             return std::nullopt;
         }
 
-        return json_message["body"];
+        return options;
     }
 
-    /* 
-        TODO: DOC
+    /*
+        Returns:
+            The priority named by a link descriptor, or nothing if it names none
     */
-    void handle_requests_(string topic, string message) {
-        // Try to decode message
-        json decoded;
-        try {
-           decoded = std::move(json::parse(message)); 
-        } catch(const std::exception& e) {
-            std::cerr << e.what() << '\n';
-            return;
+    static optional<Priority> parse_priority_(const json& priority) {
+        if(!priority.is_string()) {
+            return std::nullopt;
         }
 
-        if(decoded.count("id") == 0) {
-            spdlog::error("Received request with no ID");
-            return;
-        } 
-        string id = std::move(decoded["id"]);
-
-        if(decoded.count("method") == 0) {
-            spdlog::error("Received request with no method");
-            return;
+        const string& name = priority.get_ref<const string&>();
+        if(name == "CRITICAL") {
+            return Priority::CRITICAL;
+        } else if(name == "HIGH") {
+            return Priority::HIGH;
+        } else if(name == "NORMAL") {
+            return Priority::NORMAL;
+        } else if(name == "LOW") {
+            return Priority::LOW;
         }
-        optional<Methods> maybe_method = string_to_methods(decoded["method"]);
 
-        if(!maybe_method) {
-            spdlog::error("Received invalid request method {0}", decoded["method"].dump());
-            return;
-        }
-        Methods method = maybe_method.value();
+        return std::nullopt;
+    }
 
-        if(decoded.count("link") == 0) {
-            spdlog::error("Received request with no link");
-            return;
-        } 
-        string link = std::move(decoded["link"]);
+    /*
+        Reads the spool retention of a leaf link into options
 
-        if(this->expanded_links_.find(link) == this->expanded_links_.end()) {
-            spdlog::error("Got request for invalid link: {0}", link);
-            return;
+        Returns:
+            False if the retention is invalid
+    */
+    static bool parse_spool_(const json& spool, PublishOptions& options) {
+        if(!spool.is_object()) {
+            spdlog::error("Link spool must be an object");
+            return false;
         }
 
+        options.spool = true;
 
-        // We finally have a valid request.  But do we want to respond?
-        string response_link = create_response_link(this->endpoint_, id);
-        optional<json> maybe_response;
+        try {
+            if(spool.count("max_age") == 1) {
+                double max_age = spool["max_age"];
+                if(max_age < 0) {
+                    spdlog::error("Link spool max_age must be non-negative");
+                    return false;
+                }
 
-        switch(method) {
-            case Methods::GET:
-                spdlog::info("Got valid GET request with id ({0}) for link ({1})", id, link);
-                maybe_response = std::make_optional<json>(create_response("200", this->link_data_[link], this->expanded_links_[link]));
-            break;
+                options.spool_max_age = std::chrono::milliseconds(static_cast<int64_t>(max_age * 1000));
+            }
 
-            case Methods::PUT:
-                spdlog::error("Put not implemented");
-            break;
+            if(spool.count("on_full") == 1) {
+                string on_full = spool["on_full"];
+                if(on_full != "DROP_OLDEST" && on_full != "DROP_NEWEST") {
+                    spdlog::error("Link spool on_full must be DROP_OLDEST or DROP_NEWEST");
+                    return false;
+                }
+
+                options.spool_evict = (on_full == "DROP_OLDEST");
+            }
+        } catch(const json::type_error& e) {
+            spdlog::error("Invalid link spool: {0}", e.what());
+            return false;
         }
 
-        // TODO: Implement PUT
-        if(!maybe_response) {
-            return;
+        return true;
+    }
+
+    /*
+        Connection options announcing this node's death, spooling messages while the broker is unreachable and, if asked for,
+        keeping the node's session.  The broker publishes the retained OFFLINE status if the node drops off
+    */
+    static MqttClientOptions client_options_(const json& descriptor, const NodeOptions& node_options) {
+        MqttClientOptions options;
+        options.spool_path = node_options.spool_path;
+        options.spool_capacity = node_options.spool_capacity;
+        options.spool_drain_rate = node_options.spool_drain_rate;
+        options.reconnect_delay = node_options.reconnect_delay;
+        options.reconnect_delay_max = node_options.reconnect_delay_max;
+        options.connect_async = node_options.connect_async;
+        options.record_path = node_options.record_path;
+        options.record_capacity = node_options.record_capacity;
+
+        auto endpoint_it = descriptor.find("endpoint");
+        if(endpoint_it != descriptor.end() && endpoint_it->is_string()) {
+            options.will_topic = create_status_link(endpoint_it->get<string>());
+            options.will_payload = NODE_OFFLINE;
+            options.will_retain = true;
+
+            if(node_options.persistent_session) {
+                options.client_id = endpoint_it->get<string>();
+                options.persistent_session = true;
+            }
         }
 
-        string dumped;
-        // TODO: Catch a more specific exception
-        try {
-            dumped = std::move(maybe_response.value().dump());
-        } catch(const std::exception& e) {
-            spdlog::error("Could not dump JSON response");
+        return options;
+    }
+
+    /*
+        Waits until a remote node is not known to be offline
+
+        Returns:
+            False if the node is offline, immediately unless wait_for_offline_nodes is set, or else once the deadline has passed
+    */
+    bool await_online_(const string& node, const std::chrono::steady_clock::time_point& deadline) {
+        std::unique_lock<std::mutex> lock(this->node_status_mutex_);
+        auto is_online = [this, &node]() {
+            auto it = this->node_online_.find(node);
+            return it == this->node_online_.end() || it->second;
+        };
+
+        if(is_online()) {
+            return true;
         }
 
-        // If something valid got moved into dumped
-        if(dumped.length() > 0) {
-            this->mqtt_client_.async_publish(response_link, std::move(dumped));
+        if(!this->wait_for_offline_nodes_) {
+            return false;
         }
+
+        return this->node_status_cv_.wait_until(lock, deadline, is_online);
     }
 
-public:
     /*
-        TODO: Doc
+        Publishes a payload on a STREAM link of this node.  Payloads of links with a shared-memory ring are written to the ring, and
+        only a frame locating them is sent through the broker.  Must be called with links_mutex_ held
+
+        Returns:
+            False if the payload does not fit in the link's ring
     */
-    VizierNode(const string& host, const int port, const json& descriptor) 
-    : 
-    host_(host),
-    port_(port),
-    descriptor_(descriptor),
-    mqtt_client_(host, port)
-    {
-        if(this->descriptor_.count("endpoint") == 0) {
-            string er = "Descriptor must contain key 'endpoint'";
-            spdlog::error(er);
-            
-            throw std::runtime_error(er);
+    bool publish_payload_(const string& link, string&& payload, const optional<Priority> priority = std::nullopt) {
+        auto ring_it = this->shm_rings_.find(link);
+        if(ring_it == this->shm_rings_.end()) {
+            this->publish_with_priority_(link, std::move(payload), priority);
+            return true;
         }
 
-        this->endpoint_ = this->descriptor_["endpoint"];
-        
-        auto result = parse_descriptor(descriptor_);
-        if(!result) {
-            string er = "Invalid node descriptor";
-            spdlog::error(er);
-
-            throw std::runtime_error(er);
+        optional<ShmSlice> slice = ring_it->second->write(payload);
+        if(!slice) {
+            VIZIER_LOG_ERROR_LIMITED("Message of {0} bytes does not fit in the shared-memory ring of link {1}", payload.size(), link);
+            return false;
         }
 
-        this->expanded_links_ = result.value();
+        // Reuses the payload's buffer for the frame
+        encode_shm_frame(this->hostname_, ring_it->second->name(), slice.value(), payload);
+        this->publish_with_priority_(link, std::move(payload), priority);
 
-        // On which links can we publish?
-        for(const std::pair<string, LinkType>& item : this->expanded_links_) {
-           if(item.second == LinkType::DATA) {
-               this->puttable_links_.insert(item.first);
-           } 
+        return true;
+    }
 
-           if(item.second == LinkType::STREAM) {
-               this->publishable_links_.insert(item.first);
-           }
+    void publish_with_priority_(const string& link, string&& payload, const optional<Priority> priority) {
+        if(priority) {
+            this->mqtt_client_.async_publish(link, std::move(payload), priority.value());
+        } else {
+            this->mqtt_client_.async_publish(link, std::move(payload));
         }
+    }
 
-        // endpoint/node_descriptor is a reserved link!
-        string reserved = this->endpoint_ + "/node_descriptor";
-        if(this->puttable_links_.find(reserved) != this->puttable_links_.end()) {
-            spdlog::error("Reserved link: " + reserved + " found in puttable links.  Deleting");
-            this->puttable_links_.erase(reserved);
+    /*
+        Must be called with links_mutex_ held
+
+        Returns:
+            The options for replies about a link, i.e. responses and watch pushes: those of the link, raised to at least HIGH priority
+            so that requesters are not kept waiting behind streams
+    */
+    PublishOptions reply_options_(const string& link) const {
+        PublishOptions options;
+
+        auto options_it = this->link_options_.find(link);
+        if(options_it != this->link_options_.end()) {
+            options = options_it->second;
         }
 
-        this->link_data_[reserved] = this->descriptor_.dump();
-        this->expanded_links_[reserved] = LinkType::DATA;
+        options.priority = std::min(options.priority, Priority::HIGH);
+        return options;
+    }
 
-        std::function<void(string, string)> cb = [this](string topic, string link) {this->handle_requests_(topic, link);};
-        this->mqtt_client_.subscribe_with_callback(create_request_link(this->endpoint_), std::move(cb));
+    /*
+        Returns:
+            True if this node may do everything in permissions with a link
+    */
+    bool allows_(const string_view link, const uint8_t permissions) {
+        std::shared_lock<std::shared_mutex> lock(this->links_mutex_);
+        return this->links_.allows(link, permissions);
+    }
 
-        // Set up requested links
-        auto get_req_result = get_requests_from_descriptor(descriptor_);
-        if(!get_req_result) {
-            string er = "Descriptor requests invalid";
-            spdlog::error(er);
+    /*
+        Applies the compression, publishing policy, priority, trace and shared-memory settings of a link of this node.  Must be called
+        with links_mutex_ held exclusively
 
-            throw std::runtime_error(er);
+        Throws:
+            std::runtime_error if the settings are invalid, in which case none are applied
+    */
+    void configure_link_(const string& link, const LinkType type, const json& leaf) {
+        // Compression and publishing policies are applied by the MQTT client.  STREAM links get them for every publish, DATA links
+        // get compression for each GET response
+        bool traced = this->trace_ && type == LinkType::STREAM;
+        optional<PublishOptions> publish_options;
+
+        if(leaf.count("compression") == 1 || leaf.count("policy") == 1 || leaf.count("spool") == 1 || leaf.count("priority") == 1
+            || leaf.count("trace") == 1 || traced) {
+            publish_options = parse_publish_options_(leaf);
+            if(!publish_options) {
+                string er = "Invalid compression or policy settings for link " + link;
+                spdlog::error(er);
+
+                throw std::runtime_error(er);
+            }
+
+            if(type == LinkType::DATA && leaf.count("policy") == 1) {
+                spdlog::warn("Ignoring publishing policy of DATA link {0}", link);
+            }
+
+            // Responses to GETs are stale by the time the broker is back
+            if(type == LinkType::DATA && publish_options->spool) {
+                spdlog::warn("Ignoring spool of DATA link {0}", link);
+                publish_options->spool = false;
+            }
+
+            // Traced messages are framed for subscribers.  GET responses are traced through their envelope instead
+            if(type == LinkType::DATA && publish_options->trace) {
+                spdlog::warn("Ignoring trace of DATA link {0}", link);
+                publish_options->trace = false;
+            }
+
+            publish_options->trace = publish_options->trace || traced;
+
+            if(publish_options->spool && !this->has_spool_) {
+                spdlog::warn("Link {0} asks for a spool, but the node has no spool_path", link);
+            }
         }
 
-        /*
-            TODO: Check required links
-        */
+        // Same-host fast path for large payloads, e.g. {"type": "STREAM", "shm": {"size": 67108864}}.  Only subscribers on this host
+        // can read the payloads.  Segments are named after the instance, so a restarted node never reuses a segment still mapped
+        unique_ptr<ShmRing> ring;
+        if(leaf.count("shm") == 1 && type != LinkType::STREAM) {
+            spdlog::warn("Ignoring shared-memory ring of DATA link {0}", link);
+        } else if(leaf.count("shm") == 1) {
+            const json& shm = leaf["shm"];
+            size_t size = 16 << 20;
 
-        // Determine type of requested links: DATA or STREAM
-        this->requests_ = get_req_result.value(); 
-        for(const auto& r : this->requests_) {
-            if(r.type == LinkType::DATA) {
-                this->gettable_links_.insert(r.link);
+            if(!shm.is_object() || (shm.count("size") == 1 && !(shm["size"].is_number_integer() && shm["size"] > 0))) {
+                string er = "Invalid shared-memory settings for link " + link;
+                spdlog::error(er);
+
+                throw std::runtime_error(er);
+            }
+
+            if(shm.count("size") == 1) {
+                size = shm["size"];
+            }
+
+            string segment = "/vizier-" + this->instance_ + "-" + std::to_string(this->shm_segments_++);
+            ring = std::make_unique<ShmRing>(segment, size);
+        }
+
+        if(publish_options) {
+            if(publish_options->compression.dictionary) {
+                this->mqtt_client_.add_compression_dictionary(publish_options->compression.dictionary);
             }
 
-            if(r.type == LinkType::STREAM) {
-                this->subscribable_links_.insert(r.link);
+            if(type == LinkType::STREAM) {
+                this->mqtt_client_.set_publish_options(link, publish_options.value());
             }
+
+            this->link_options_[link] = std::move(publish_options.value());
+        }
+
+        if(ring) {
+            this->shm_rings_[link] = std::move(ring);
         }
     }
-    
+
     /*
-        TODO: Doc
+        Undoes configure_link_.  Must be called with links_mutex_ held exclusively
     */
-    bool publish(const string& link, string message) {
-        if(this->publishable_links_.find(link) == this->publishable_links_.end()) {
-            spdlog::error("Cannot publish on link {0} because it has not been declared as a link of type STREAM", link);
-            return false;
+    void unconfigure_link_(const string& link) {
+        if(this->link_options_.erase(link) == 1) {
+            this->mqtt_client_.clear_publish_options(link);
         }
 
-        this->mqtt_client_.async_publish(link, std::move(message));
+        // Subscribers find the segment gone and drop what they have not read yet
+        this->shm_rings_.erase(link);
+    }
+
+    /*
+        Stores a new value of a DATA link of this node and pushes it to its watchers.  Must be called with links_mutex_ held
+    */
+    void store_(const string& link, string data) {
+        // Validated without building a DOM, and outside the lock
+        bool is_json = this->raw_json_bodies_ && is_json_container(data) && json::accept(data);
 
-        return true;
+        std::unique_lock<std::shared_mutex> lock(this->link_data_mutex_);
+        if(this->data_history_ > 0) {
+            this->update_history_(link, data);
+        }
+
+        LinkData& entry = this->link_data_[link];
+        entry.data = std::move(data);
+        entry.is_json = is_json;
+        ++entry.version;
+
+        // Push the new value if the link is watched.  Enqueued under the lock, so that watchers receive values in version order
+        auto watch_it = this->watched_links_.find(link);
+        if(watch_it != this->watched_links_.end()) {
+            if(std::chrono::steady_clock::now() < watch_it->second) {
+                string watch_link = create_watch_link(this->endpoint_, link);
+                this->mqtt_client_.async_publish(watch_link, this->dump_watch_(link), this->reply_options_(link));
+            } else {
+                this->watched_links_.erase(watch_it);
+            }
+        }
     }
 
     /*
-        TODO: Doc
+        Starts tracking the liveness of a node this node makes requests to.  Their retained status arrives as soon as we subscribe.
+        Must not be called with links_mutex_ held, as subscribing waits for the MQTT client's message thread
+
+        Args:
+            node: the node to track
+            wait: wait for the subscription to be made.  Otherwise it is only issued
     */
-    optional<string> get(const string& link, const size_t& retries, const std::chrono::milliseconds& timeout) {
-        if(this->gettable_links_.find(link) == this->gettable_links_.end()) {
-            spdlog::error("Cannot get on link {0} because it has not been declared as a request of type DATA", link);
-            return std::nullopt;
+    void track_node_(const string& node, const bool wait = true) {
+        bool tracked;
+        {
+            std::lock_guard<std::mutex> lock(this->node_status_mutex_);
+            tracked = this->node_online_.count(node) == 1;
+            this->node_online_.emplace(node, true);
+        }
+
+        if(tracked) {
+            return;
         }
 
-        return this->make_request({}, Methods::GET, link, retries, timeout);
+        auto f = [this, node](const string& topic, string&& message) {this->set_node_status_(node, message == NODE_ONLINE);};
+        if(wait) {
+            this->mqtt_client_.subscribe_with_callback(create_status_link(node), std::move(f));
+        } else {
+            this->mqtt_client_.async_subscribe_with_callback(create_status_link(node), std::move(f));
+        }
     }
 
     /*
-        TODO: Doc
+        Announces that this node is online, now if it is connected and again after every reconnect, as the broker publishes our last
+        will when the connection drops.  Retained, so that nodes starting later learn it too
     */
-    optional<shared_ptr<ThreadSafeQueue<string>>> subscribe(const string& link) {
-        if(this->subscribable_links_.find(link) == this->subscribable_links_.end()) {
-            spdlog::error("Cannot get on link {0} because it has not been declared as a request of type STREAM", link);
-            return std::nullopt;
+    void announce_online_() {
+        PublishOptions retained;
+        retained.retain = true;
+        retained.priority = Priority::HIGH;
+        this->mqtt_client_.set_birth(create_status_link(this->endpoint_), NODE_ONLINE, retained);
+    }
+
+    /*
+        Finishes starting this node on the startup thread, and settles ready
+
+        Args:
+            required: the requests of this node marked as required
+            deadline: when ready is settled as false if startup has not finished
+    */
+    void start_(const vector<RequestData> required, const std::chrono::steady_clock::time_point deadline) {
+        StartupSignal& signal = *this->startup_signal_;
+
+        {
+            std::unique_lock<std::mutex> lock(signal.mutex);
+
+            // The node is still announced once the broker is reachable, even if ready is settled as false by then
+            if(!signal.cv.wait_until(lock, deadline, [&signal]() {return signal.connected || signal.stop;}) || signal.stop) {
+                if(!signal.stop) {
+                    spdlog::error("Could not connect to the MQTT broker within the startup timeout.  Still trying");
+                }
+
+                this->ready_promise_.set_value(false);
+                return;
+            }
         }
 
-        return this->mqtt_client_.subscribe(link);
+        // The connection is made before the client restores the subscriptions.  Wait until the request link is subscribed to and
+        // the node is announced, so that nothing is asked of it before it can answer
+        this->mqtt_client_.flush();
+
+        this->ready_promise_.set_value(this->verify_required_(required, deadline));
     }
 
     /*
-        TODO: Doc
+        Asks the nodes owning required requests for their descriptors, all at once, and again every STARTUP_ATTEMPT until they answer
+        or the deadline passes
+
+        Returns:
+            True if every required request is declared, with the same type, by the node owning it
     */
-    bool put(const string& link, string data) {
-        if(this->puttable_links_.find(link) == this->subscribable_links_.end()) {
-           spdlog::error("Cannot put on link {0} because it has not been declared as a link of type DATA", link);
-           return false; 
+    bool verify_required_(const vector<RequestData>& required, const std::chrono::steady_clock::time_point& deadline) {
+        unordered_map<string, vector<const RequestData*>> pending;
+        for(const auto& r : required) {
+            pending[r.link.substr(0, r.link.find_first_of('/'))].push_back(&r);
         }
 
-        this->link_data_[link] = std::move(data);
+        StartupSignal& signal = *this->startup_signal_;
+        bool ok = true;
 
-        return true;
+        while(!pending.empty()) {
+            auto now = std::chrono::steady_clock::now();
+            auto attempt = std::min(STARTUP_ATTEMPT, std::chrono::ceil<std::chrono::milliseconds>(deadline - now));
+            if(attempt.count() <= 0) {
+                break;
+            }
+
+            vector<std::pair<string, std::future<optional<string>>>> fetches;
+            for(const auto& owner : pending) {
+                string link = owner.first + "/node_descriptor";
+                auto fetch = [this, link, attempt]() {return this->make_request({{"raw", true}}, Methods::GET, link, 1, attempt);};
+                fetches.emplace_back(owner.first, std::async(std::launch::async, std::move(fetch)));
+            }
+
+            for(auto& fetch : fetches) {
+                const string& node = fetch.first;
+                optional<string> response = fetch.second.get();
+                optional<string> body;
+
+                if(response) {
+                    body = this->resolve_get_response_(node + "/node_descriptor", std::move(response.value()));
+                }
+
+                if(!body) {
+                    continue;
+                }
+
+                json descriptor = json::parse(body.value(), nullptr, false);
+                optional<unordered_map<string, LinkType>> links;
+                if(!descriptor.is_discarded()) {
+                    links = parse_descriptor(descriptor);
+                }
+
+                for(const RequestData* r : pending[node]) {
+                    if(!links) {
+                        spdlog::error("Node {0} sent an invalid descriptor.  Cannot check required link {1}", node, r->link);
+                        ok = false;
+                        continue;
+                    }
+
+                    auto link_it = links->find(r->link);
+                    if(link_it == links->end()) {
+                        spdlog::error("Required link {0} is not declared by node {1}", r->link, node);
+                        ok = false;
+                    } else if(link_it->second != r->type) {
+                        spdlog::error("Required link {0} is declared by node {1} with another type", r->link, node);
+                        ok = false;
+                    }
+                }
+
+                pending.erase(node);
+            }
+
+            // Requests to nodes known to be offline fail at once, so the attempt is sat out before asking again
+            std::unique_lock<std::mutex> lock(signal.mutex);
+            if(!pending.empty() && signal.cv.wait_until(lock, now + attempt, [&signal]() {return signal.stop;})) {
+                return false;
+            }
+        }
+
+        for(const auto& owner : pending) {
+            spdlog::error("Node {0} did not send its descriptor within the startup timeout.  Cannot check required link {1}", owner.first,
+                owner.second.front()->link);
+        }
+
+        return ok && pending.empty();
+    }
+
+    /*
+        Replaces a shm frame received on a link by the payload it stands for, reusing the frame's buffer
+
+        Returns:
+            False if the payload cannot be read, e.g. because it was overwritten before this node got to it
+    */
+    static bool resolve_shm_(ShmReaders& readers, const string& link, string& message) {
+        optional<ShmFrame> frame = parse_shm_frame(message);
+        if(!frame) {
+            VIZIER_LOG_ERROR_LIMITED("Dropping malformed shared-memory frame on link {0}", link);
+            return false;
+        }
+
+        if(frame->host != readers.hostname) {
+            VIZIER_LOG_ERROR_LIMITED("Dropping message on link {0}: it is in shared memory on host {1}", link, frame->host);
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(readers.mutex);
+        ShmSubscription& subscription = readers.subscriptions[link];
+
+        if(subscription.segment != frame->segment) {
+            subscription.reader.reset();
+
+            try {
+                subscription.reader = std::make_unique<ShmRingReader>(frame->segment);
+            } catch(const std::runtime_error& e) {
+                VIZIER_LOG_ERROR_LIMITED("Dropping message on link {0}: {1}", link, e.what());
+                return false;
+            }
+
+            subscription.segment = std::move(frame->segment);
+        }
+
+        if(!subscription.reader->read(frame->slice, message)) {
+            VIZIER_LOG_WARN_LIMITED("Dropping message on link {0}: overwritten in shared memory before it was read", link);
+            return false;
+        }
+
+        return true;
+    }
+
+    /*
+        Wraps a callback for messages on a STREAM link so that it receives the payloads of shm frames instead of the frames
+    */
+    MessageCallback shm_aware_(MessageCallback f) {
+        return [readers = this->shm_readers_, f = std::move(f)](const string& topic, string&& message) {
+            if(is_shm_frame(message) && !resolve_shm_(*readers, topic, message)) {
+                return;
+            }
+
+            f(topic, std::move(message));
+        };
+    }
+
+    /* 
+        Sends a request to the node owning link and waits for the response.  Retries on timeout and when the remote node sheds the
+        request.  Traced requests update the estimate of the remote node's clock offset
+
+        Args:
+            trace: trace the request even if the node is not traced
+
+        Returns:
+            The raw response message, or nothing if no valid response arrived
+    */
+    optional<string> make_request(json body, const Methods method, const string& link, const size_t& retries, const std::chrono::milliseconds& timeout,
+        const bool trace = false) {
+        string id = create_message_id(this->endpoint_);
+
+        json request = create_request(id, method, link, std::move(body));
+
+        size_t found = link.find_first_of('/');
+
+        if(found == string::npos) {
+            VIZIER_LOG_ERROR_LIMITED("Invalid link {0}. Structure should be node_name/link/link...", link);
+            return std::nullopt;
+        }
+
+        string remote_node = link.substr(0, found);
+        string response_link = create_response_link(remote_node, id);
+        string request_link = create_request_link(remote_node);
+
+        optional<shared_ptr<ThreadSafeQueue<string>>> maybe_q = this->mqtt_client_.subscribe(response_link);
+        if(!maybe_q) {
+            return std::nullopt;
+        }
+
+        auto q = maybe_q.value();
+        optional<string> message;
+        auto deadline = std::chrono::steady_clock::now() + retries * timeout;
+        ChunkAssembler assembler;
+
+        // Large GET responses may arrive in chunks
+        if(method == Methods::GET && request["body"].is_object()) {
+            request["body"]["chunked"] = true;
+        }
+
+        for(size_t i = 0; i < retries; ++i) {
+            // Checked before every attempt, so a node dying mid-request does not cost the remaining retries
+            if(!this->await_online_(remote_node, deadline)) {
+                VIZIER_LOG_ERROR_LIMITED("Remote node {0} is offline", remote_node);
+                break;
+            }
+
+            // Only ask for the chunks that did not make it last time
+            if(!assembler.empty()) {
+                request["body"]["resume"] = {{"tag", assembler.tag()}, {"chunks", assembler.missing()}};
+            }
+
+            // Stamped anew for every attempt, so that a late response to an earlier one is not taken for this one
+            int64_t sent = 0;
+            if(trace || this->trace_) {
+                sent = trace_now();
+                request["trace"] = {{"t0", sent}};
+            }
+
+            this->mqtt_client_.async_publish(request_link, request.dump(), Priority::HIGH);
+            message = this->receive_response_(*q, assembler, timeout);
+
+            if(!message) {
+                VIZIER_LOG_INFO_LIMITED("Request timed out.  Retrying");
+                continue;
+            }
+
+            // Only the envelope is scanned here.  The body is left for the caller to extract
+            optional<Envelope> envelope = parse_envelope(message.value());
+            if(!envelope) {
+                VIZIER_LOG_ERROR_LIMITED("Failure parsing json message");
+                message = std::nullopt;
+                break;
+            }
+
+            if(sent != 0 && !envelope->trace.empty()) {
+                this->add_clock_sample_(remote_node, envelope->trace, sent, trace_now());
+            }
+
+            // The remote node shed our request.  Back off for one timeout period before retrying
+            if(envelope->status == "\"503\"") {
+                VIZIER_LOG_INFO_LIMITED("Remote node {0} is overloaded.  Retrying", remote_node);
+                message = std::nullopt;
+                std::this_thread::sleep_for(timeout);
+                continue;
+            }
+
+            break;
+        }
+
+        // Response links are unique to the request.  Left subscribed, they pile up and are all resubscribed on every reconnect
+        this->mqtt_client_.async_unsubscribe(response_link);
+
+        return message;
+    }
+
+    /*
+        Adds a request/response exchange with a remote node to the estimate of its clock offset
+
+        Args:
+            node: the remote node
+            trace: JSON text of the response's trace, holding the timestamps t0, t1 and t2 of the exchange
+            sent: t0 of the request the response should answer
+            received: when the response arrived, t3
+    */
+    void add_clock_sample_(const string& node, const string_view trace, const int64_t sent, const int64_t received) {
+        optional<uint64_t> t0, t1, t2;
+        scan_json_object(trace, [&](const string_view key, const string_view value) {
+            if(key == "t0") {
+                t0 = parse_json_uint(value);
+            } else if(key == "t1") {
+                t1 = parse_json_uint(value);
+            } else if(key == "t2") {
+                t2 = parse_json_uint(value);
+            }
+        });
+
+        // Answers an earlier attempt, whose round trip is unknown
+        if(!t0 || !t1 || !t2 || static_cast<int64_t>(t0.value()) != sent) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(this->trace_mutex_);
+        this->clock_offsets_[node].add(sent, t1.value(), t2.value(), received);
+    }
+
+    /*
+        Records the timestamps of a traced message on a subscribed link.  Called on the MQTT client's message thread
+    */
+    void record_trace_(const string& link, const TraceStamps& stamps) {
+        string_view node(link);
+        node = node.substr(0, node.find_first_of('/'));
+
+        std::lock_guard<std::mutex> lock(this->trace_mutex_);
+
+        optional<int64_t> offset;
+        auto offset_it = this->clock_offsets_.find(string(node));
+        if(offset_it != this->clock_offsets_.end()) {
+            optional<ClockOffset> estimate = offset_it->second.estimate();
+            if(estimate) {
+                offset = estimate->offset;
+            }
+        }
+
+        this->latency_[link].add(stamps, offset);
+    }
+
+    /*
+        Waits for the response to a request, reassembling it if it arrives in chunks
+
+        Args:
+            q: queue of messages on the response link
+            assembler: chunks received so far, kept across attempts
+            timeout: how long to wait for the response, or for the next chunk
+
+        Returns:
+            The whole response, or nothing on timeout
+    */
+    optional<string> receive_response_(ThreadSafeQueue<string>& q, ChunkAssembler& assembler, const std::chrono::milliseconds& timeout) {
+        while(true) {
+            optional<string> message = q.dequeue(timeout);
+            if(!message || !is_chunk(message.value())) {
+                return message;
+            }
+
+            optional<Chunk> chunk = parse_chunk(message.value());
+            if(!chunk) {
+                VIZIER_LOG_ERROR_LIMITED("Dropping malformed response chunk");
+                continue;
+            }
+
+            if(assembler.add(chunk.value())) {
+                return assembler.take();
+            }
+        }
+    }
+
+    /*
+        Splits a GET response into chunks and publishes them behind other messages
+
+        Args:
+            response_link: link on which the chunks are published
+            response: the whole response
+            tag: identifies the response, so that a requester resuming it gets chunks of the same bytes
+            resume: body of a retried request, naming the chunks the requester is missing, if any
+            options: publish options of the requested link
+    */
+    void publish_chunks_(const string& response_link, const string& response, const string& tag, const optional<json>& resume,
+        const PublishOptions& options) {
+        const uint32_t chunk_size = static_cast<uint32_t>(this->response_chunk_size_);
+        const uint32_t count = chunk_count(response.size(), chunk_size);
+        vector<string> chunks;
+
+        // The requester has the other chunks of this very response
+        if(resume && resume->is_object() && resume->value("tag", string()) == tag && resume->contains("chunks") && (*resume)["chunks"].is_array()) {
+            for(const json& index : (*resume)["chunks"]) {
+                if(index.is_number_unsigned() && index.get<uint64_t>() < count) {
+                    chunks.push_back(encode_chunk(response, index.get<uint32_t>(), chunk_size, tag));
+                }
+            }
+        }
+
+        if(chunks.empty()) {
+            for(uint32_t i = 0; i < count; ++i) {
+                chunks.push_back(encode_chunk(response, i, chunk_size, tag));
+            }
+        }
+
+        this->mqtt_client_.async_publish_bulk(response_link, std::move(chunks), options);
+    }
+
+    /*
+        Extracts the body of a GET response.  Delta responses are applied to the locally held version of the link, and versioned full
+        responses are remembered so that the next GET can ask for a delta.
+
+        Returns:
+            The body, or nothing if the response was malformed or a delta did not apply to the version held locally
+    */
+    optional<string> resolve_get_response_(const string& link, string message) {
+        optional<Envelope> envelope = parse_envelope(message);
+        if(!envelope || envelope->body.empty()) {
+            VIZIER_LOG_ERROR_LIMITED("GET response received with no body");
+            return std::nullopt;
+        }
+
+        optional<uint64_t> version = parse_json_uint(envelope->version);
+        optional<uint64_t> base_version = parse_json_uint(envelope->base_version);
+
+        // The body is either a JSON string or a raw JSON value.  Either way it is extracted in place, reusing the buffer of the
+        // received message
+        optional<string> maybe_body;
+        if(is_json_string(envelope->body)) {
+            maybe_body = take_json_string(std::move(message), envelope->body);
+        } else {
+            maybe_body = take_json_value(std::move(message), envelope->body);
+        }
+
+        if(!maybe_body) {
+            VIZIER_LOG_ERROR_LIMITED("GET response received with malformed body");
+            return std::nullopt;
+        }
+
+        string body = std::move(maybe_body.value());
+        std::lock_guard<std::mutex> lock(this->remote_versions_mutex_);
+
+        // Unversioned response.  The remote node does not keep a history for this link
+        if(!version) {
+            this->remote_versions_.erase(link);
+            return body;
+        }
+
+        if(!base_version) {
+            json decoded = json::parse(body, nullptr, false);
+
+            if(decoded.is_discarded()) {
+                this->remote_versions_.erase(link);
+            } else {
+                this->remote_versions_[link] = {version.value(), std::move(decoded)};
+            }
+
+            return body;
+        }
+
+        auto it = this->remote_versions_.find(link);
+        if(it == this->remote_versions_.end() || it->second.version != base_version.value()) {
+            VIZIER_LOG_ERROR_LIMITED("Received delta for link {0} against a version that is not held locally", link);
+            this->remote_versions_.erase(link);
+            return std::nullopt;
+        }
+
+        optional<json> patched = apply_json_patch(it->second.body, json::parse(body, nullptr, false));
+        if(!patched) {
+            VIZIER_LOG_ERROR_LIMITED("Could not apply delta for link {0}", link);
+            this->remote_versions_.erase(it);
+            return std::nullopt;
+        }
+
+        it->second = {version.value(), std::move(patched.value())};
+        return it->second.body.dump();
+    }
+
+    /*
+        Sends a GET for a link of another node.  Asks for raw JSON bodies, for a delta if a versioned copy of the link is held, and
+        for confirmation that the value is unchanged if if_none_match is the etag of a cached value.
+
+        Returns:
+            The outcome, or nothing if no valid response arrived
+    */
+    optional<Fetched> fetch_(const string& link, const size_t& retries, const std::chrono::milliseconds& timeout, const string& if_none_match) {
+        json body = {{"raw", true}};
+        if(!if_none_match.empty()) {
+            body["if_none_match"] = if_none_match;
+        }
+
+        bool has_version = false;
+        {
+            std::lock_guard<std::mutex> lock(this->remote_versions_mutex_);
+            auto it = this->remote_versions_.find(link);
+            if(it != this->remote_versions_.end()) {
+                body["version"] = it->second.version;
+                has_version = true;
+            }
+        }
+
+        optional<string> response = this->make_request(body, Methods::GET, link, retries, timeout);
+        if(!response) {
+            return std::nullopt;
+        }
+
+        Fetched fetched;
+        optional<Envelope> envelope = parse_envelope(response.value());
+        if(envelope) {
+            fetched.etag = decode_json_string(envelope->etag).value_or(string());
+
+            // The cached value is still current
+            if(envelope->status == "\"304\"") {
+                return fetched;
+            }
+        }
+
+        fetched.body = this->resolve_get_response_(link, std::move(response.value()));
+
+        // A delta that did not apply has dropped our local version, so the retry asks for the full body
+        if(!fetched.body && has_version) {
+            response = this->make_request({{"raw", true}}, Methods::GET, link, retries, timeout);
+            if(response) {
+                envelope = parse_envelope(response.value());
+                fetched.etag = envelope ? decode_json_string(envelope->etag).value_or(string()) : string();
+                fetched.body = this->resolve_get_response_(link, std::move(response.value()));
+            }
+        }
+
+        if(!fetched.body) {
+            return std::nullopt;
+        }
+
+        return fetched;
+    }
+
+    /*
+        Records a new value for a DATA link in its history.  Must be called with link_data_mutex_ held exclusively, before the stored
+        value is replaced.
+    */
+    void update_history_(const string& link, const string& data) {
+        LinkHistory& history = this->link_history_[link];
+        ++history.version;
+
+        auto data_it = this->link_data_.find(link);
+        optional<json> patch;
+        if(data_it != this->link_data_.end()) {
+            patch = create_json_patch(data_it->second.data, data);
+        }
+
+        // Without a patch from the previous version, older versions can no longer be brought up to date
+        if(!patch) {
+            history.patches.clear();
+            return;
+        }
+
+        history.patches.push_back(std::move(patch.value()));
+        if(history.patches.size() > this->data_history_) {
+            history.patches.pop_front();
+        }
+    }
+
+    /*
+        Records the status announced by a remote node and wakes requests waiting for it.  Called on the MQTT client's message thread
+    */
+    void set_node_status_(const string& node, const bool online) {
+        {
+            std::lock_guard<std::mutex> lock(this->node_status_mutex_);
+            this->node_online_[node] = online;
+        }
+
+        spdlog::info("Remote node {0} is {1}", node, online ? NODE_ONLINE : NODE_OFFLINE);
+        this->node_status_cv_.notify_all();
+    }
+
+    /*
+        Serializes the current value of a DATA link of this node for its watchers.  Must be called with link_data_mutex_ held
+    */
+    string dump_watch_(const string& link) {
+        json extra = {{"version", 0}, {"instance", this->instance_}, {"lease", this->watch_lease_.count()}};
+
+        auto data_it = this->link_data_.find(link);
+        if(data_it == this->link_data_.end()) {
+            return dump_response("200", string(), false, LinkType::DATA, extra);
+        }
+
+        extra["version"] = data_it->second.version;
+        return dump_response("200", data_it->second.data, data_it->second.is_json, LinkType::DATA, extra);
+    }
+
+    /*
+        Hands a value pushed for a watched link, or the response to a WATCH, to the watch's queue.  Values that are not newer than the
+        last one delivered are dropped, as pushes and responses may arrive out of order
+    */
+    void deliver_watch_(const string& link, string message) {
+        optional<Envelope> envelope = parse_envelope(message);
+        if(!envelope || decode_json_string(envelope->status) != "200") {
+            VIZIER_LOG_ERROR_LIMITED("Received malformed value for watched link {0}", link);
+            return;
+        }
+
+        optional<uint64_t> version = parse_json_uint(envelope->version);
+        optional<string> instance = decode_json_string(envelope->instance);
+        if(!version || !instance) {
+            VIZIER_LOG_ERROR_LIMITED("Received unversioned value for watched link {0}", link);
+            return;
+        }
+
+        string_view body_view = envelope->body;
+        optional<string> body;
+        if(is_json_string(body_view)) {
+            body = take_json_string(std::move(message), body_view);
+        } else {
+            body = take_json_value(std::move(message), body_view);
+        }
+
+        if(!body) {
+            VIZIER_LOG_ERROR_LIMITED("Received malformed value for watched link {0}", link);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(this->watch_signal_->mutex);
+        auto it = this->watches_.find(link);
+        if(it == this->watches_.end()) {
+            return;
+        }
+
+        Watch& watch = it->second;
+        if(watch.instance == instance.value() && version.value() <= watch.version) {
+            return;
+        }
+
+        watch.instance = std::move(instance.value());
+        watch.version = version.value();
+        watch.queue->enqueue(std::move(body.value()));
+    }
+
+    /*
+        Sends a WATCH for a link of another node, delivers the current value in the response and schedules the renewal of the watch
+
+        Returns:
+            True if the remote node granted the watch
+    */
+    bool register_watch_(const string& link, const size_t retries, const std::chrono::milliseconds timeout) {
+        optional<string> response = this->make_request({{"raw", true}}, Methods::WATCH, link, retries, timeout);
+        if(!response) {
+            return false;
+        }
+
+        optional<Envelope> envelope = parse_envelope(response.value());
+        optional<uint64_t> lease = envelope ? parse_json_uint(envelope->lease) : std::nullopt;
+        if(!lease) {
+            VIZIER_LOG_ERROR_LIMITED("WATCH response for link {0} carries no lease", link);
+            return false;
+        }
+
+        this->deliver_watch_(link, std::move(response.value()));
+
+        {
+            std::lock_guard<std::mutex> lock(this->watch_signal_->mutex);
+            auto it = this->watches_.find(link);
+            if(it != this->watches_.end()) {
+                it->second.refresh = std::chrono::steady_clock::now() + std::chrono::milliseconds(lease.value() / 2);
+            }
+        }
+
+        this->watch_signal_->cv.notify_all();
+        return true;
+    }
+
+    /*
+        Renews watches before their lease runs out, and all of them after the connection to the broker was re-established, in case
+        the remote node or the broker lost them.  Runs on its own thread, as renewals block on their responses
+    */
+    void watch_loop_() {
+        WatchSignal& signal = *this->watch_signal_;
+        std::unique_lock<std::mutex> lock(signal.mutex);
+
+        while(!signal.stop) {
+            auto now = std::chrono::steady_clock::now();
+            auto earliest = std::chrono::steady_clock::time_point::max();
+            vector<string> due;
+
+            for(const auto& item : this->watches_) {
+                if(signal.rewatch || item.second.refresh <= now) {
+                    due.push_back(item.first);
+                } else {
+                    earliest = std::min(earliest, item.second.refresh);
+                }
+            }
+            signal.rewatch = false;
+
+            if(due.empty()) {
+                if(earliest == std::chrono::steady_clock::time_point::max()) {
+                    signal.cv.wait(lock);
+                } else {
+                    signal.cv.wait_until(lock, earliest);
+                }
+                continue;
+            }
+
+            for(const string& link : due) {
+                auto it = this->watches_.find(link);
+                if(it == this->watches_.end() || signal.stop) {
+                    continue;
+                }
+
+                size_t retries = it->second.retries;
+                std::chrono::milliseconds timeout = it->second.timeout;
+                it->second.refresh = std::chrono::steady_clock::time_point::max();
+
+                lock.unlock();
+                bool ok = this->register_watch_(link, retries, timeout);
+                lock.lock();
+
+                // Try again after one timeout period
+                it = this->watches_.find(link);
+                if(!ok && it != this->watches_.end()) {
+                    VIZIER_LOG_WARN_LIMITED("Could not renew watch on link {0}", link);
+                    it->second.refresh = std::chrono::steady_clock::now() + timeout;
+                }
+            }
+        }
+    }
+
+    /*
+        Called on the MQTT client's message thread for every incoming request.  Hands the request to the worker pool, or serves it
+        inline if the node was configured without request workers.
+    */
+    void dispatch_request_(const string& topic, string&& message) {
+        IncomingRequest request{std::move(message), trace_now()};
+
+        if(!this->request_pool_) {
+            this->handle_requests_(topic, std::move(request.message), request.received);
+            return;
+        }
+
+        // try_submit leaves the request intact if it is rejected
+        if(!this->request_pool_->try_submit(std::move(request))) {
+            this->shed_request_(request.message);
+        }
+    }
+
+    /*
+        Answers a request that could not be admitted to the worker pool with status 503, so that the requester backs off instead of
+        waiting out its timeout.
+    */
+    void shed_request_(const string& message) {
+        optional<Envelope> envelope = parse_envelope(message);
+        if(!envelope) {
+            return;
+        }
+
+        optional<string> id = decode_json_string(envelope->id);
+        if(!id) {
+            return;
+        }
+
+        VIZIER_LOG_WARN_LIMITED("Request queue full.  Shedding request with id ({0})", id.value());
+
+        string response_link = create_response_link(this->endpoint_, id.value());
+        this->mqtt_client_.async_publish(response_link, create_response("503", "", LinkType::DATA).dump(), Priority::HIGH);
+    }
+
+    /* 
+        Parses and serves a single request.  May be called concurrently from the request workers
+
+        Args:
+            received: when the request arrived, reported to requesters that trace it
+    */
+    void handle_requests_(string topic, string message, const int64_t received) {
+        // Only the envelope is scanned.  The body is never materialized as a DOM
+        optional<Envelope> decoded = parse_envelope(message);
+        if(!decoded) {
+            VIZIER_LOG_ERROR_LIMITED("Received malformed request");
+            return;
+        }
+
+        // The requester's t0, echoed back along with ours
+        optional<uint64_t> traced;
+        scan_json_object(decoded->trace, [&traced](const string_view key, const string_view value) {
+            if(key == "t0") {
+                traced = parse_json_uint(value);
+            }
+        });
+
+        optional<string> maybe_id = decode_json_string(decoded->id);
+        if(!maybe_id) {
+            VIZIER_LOG_ERROR_LIMITED("Received request with no ID");
+            return;
+        } 
+        string id = std::move(maybe_id.value());
+
+        optional<string> method_str = decode_json_string(decoded->method);
+        if(!method_str) {
+            VIZIER_LOG_ERROR_LIMITED("Received request with no method");
+            return;
+        }
+        optional<Methods> maybe_method = string_to_methods(method_str.value());
+
+        if(!maybe_method) {
+            VIZIER_LOG_ERROR_LIMITED("Received invalid request method {0}", method_str.value());
+            return;
+        }
+        Methods method = maybe_method.value();
+
+        optional<string> maybe_link = decode_json_string(decoded->link);
+        if(!maybe_link) {
+            VIZIER_LOG_ERROR_LIMITED("Received request with no link");
+            return;
+        } 
+        string link = std::move(maybe_link.value());
+
+        // Held while the request is served, so that the link is not removed halfway through
+        std::shared_lock<std::shared_mutex> links_lock(this->links_mutex_);
+
+        const LinkRecord* record = this->links_.find(link);
+        if(record == nullptr || !(record->permissions & LinkPermissions::SERVE)) {
+            VIZIER_LOG_ERROR_LIMITED("Got request for invalid link: {0}", link);
+            return;
+        }
+
+
+        // We finally have a valid request.  But do we want to respond?
+        string response_link = create_response_link(this->endpoint_, id);
+        string dumped;
+
+        // Set for GETs from requesters that accept chunked responses
+        bool chunked = false;
+        string chunk_tag;
+        optional<json> resume;
+
+        switch(method) {
+            case Methods::GET:
+            {
+                VIZIER_LOG_DEBUG("Got valid GET request with id ({0}) for link ({1})", id, link);
+
+                // The GET body may carry the version the requester holds, the etag of a value it has cached and whether it accepts
+                // raw JSON bodies
+                optional<uint64_t> requested_version;
+                optional<string> if_none_match;
+                bool accepts_raw = false;
+                scan_json_object(decoded->body, [&](const string_view key, const string_view value) {
+                    if(key == "version") {
+                        requested_version = parse_json_uint(value);
+                    } else if(key == "if_none_match") {
+                        if_none_match = decode_json_string(value);
+                    } else if(key == "raw") {
+                        accepts_raw = (value == "true");
+                    } else if(key == "chunked") {
+                        chunked = (value == "true");
+                    } else if(key == "resume") {
+                        json parsed = json::parse(value, nullptr, false);
+                        if(!parsed.is_discarded()) {
+                            resume = std::move(parsed);
+                        }
+                    }
+                });
+
+                json extra = json::object();
+                std::shared_lock<std::shared_mutex> lock(this->link_data_mutex_);
+                auto data_it = this->link_data_.find(link);
+
+                string etag = this->instance_ + "-" + std::to_string((data_it == this->link_data_.end()) ? 0 : data_it->second.version);
+                extra["etag"] = etag;
+
+                // The response also depends on the version the requester holds
+                chunk_tag = etag + "/" + (requested_version ? std::to_string(requested_version.value()) : string()) + (accepts_raw ? "/raw" : "");
+
+                // The requester's cached value is still current
+                if(if_none_match && if_none_match.value() == etag) {
+                    lock.unlock();
+                    dumped = dump_response("304", string(), false, record->type, extra);
+                    break;
+                }
+
+                auto history_it = this->link_history_.find(link);
+
+                if(history_it != this->link_history_.end()) {
+                    const LinkHistory& history = history_it->second;
+                    uint64_t oldest = history.version - history.patches.size();
+                    extra["version"] = history.version;
+
+                    // Answer with the concatenated patches if the requester holds a version that we still have a history for
+                    if(requested_version && requested_version.value() >= oldest && requested_version.value() <= history.version) {
+                        uint64_t base = requested_version.value();
+                        json patch = json::array();
+                        for(size_t i = base - oldest; i < history.patches.size(); ++i) {
+                            patch.insert(patch.end(), history.patches[i].begin(), history.patches[i].end());
+                        }
+                        lock.unlock();
+
+                        extra["base_version"] = base;
+                        dumped = dump_response("200", patch.dump(), accepts_raw && this->raw_json_bodies_, record->type, extra);
+                        break;
+                    }
+                }
+
+                // Serialized straight from the stored value under the shared lock, so the body is copied exactly once
+                if(data_it == this->link_data_.end()) {
+                    dumped = dump_response("200", string(), false, record->type, extra);
+                } else {
+                    bool raw = accepts_raw && data_it->second.is_json;
+                    dumped = dump_response("200", data_it->second.data, raw, record->type, extra);
+                }
+            }
+            break;
+
+            case Methods::PUT:
+                VIZIER_LOG_ERROR_LIMITED("Put not implemented");
+            break;
+
+            case Methods::WATCH:
+            {
+                if(record->type != LinkType::DATA) {
+                    VIZIER_LOG_ERROR_LIMITED("Cannot watch link {0} because it is not of type DATA", link);
+                    return;
+                }
+
+                VIZIER_LOG_DEBUG("Got valid WATCH request with id ({0}) for link ({1})", id, link);
+
+                // Registered under the exclusive lock, so every put after this response is pushed to the watcher
+                std::unique_lock<std::shared_mutex> lock(this->link_data_mutex_);
+                auto& expiry = this->watched_links_[link];
+                expiry = std::max(expiry, std::chrono::steady_clock::now() + this->watch_lease_);
+                dumped = this->dump_watch_(link);
+            }
+            break;
+        }
+
+        // TODO: Implement PUT
+        if(dumped.length() > 0) {
+            PublishOptions options = this->reply_options_(link);
+
+            // Responses are JSON objects, so the trace goes in before the closing brace
+            if(traced && dumped.back() == '}') {
+                dumped.pop_back();
+                dumped += ",\"trace\":{\"t0\":" + std::to_string(traced.value()) + ",\"t1\":" + std::to_string(received)
+                    + ",\"t2\":" + std::to_string(trace_now()) + "}}";
+            }
+
+            if(chunked && this->response_chunk_size_ > 0 && dumped.size() > this->response_chunk_size_) {
+                this->publish_chunks_(response_link, dumped, chunk_tag, resume, options);
+            } else {
+                this->mqtt_client_.async_publish(response_link, std::move(dumped), options);
+            }
+        }
+    }
+
+public:
+    /*
+        TODO: Doc
+    */
+    VizierNode(const string& host, const int port, const json& descriptor, const NodeOptions& options = NodeOptions())
+    : 
+    host_(host),
+    port_(port),
+    descriptor_(descriptor),
+    mqtt_client_(host, port, client_options_(descriptor, options)),
+    raw_json_bodies_(options.raw_json_bodies),
+    data_history_(options.data_history),
+    get_cache_ttl_(options.get_cache_ttl),
+    has_spool_(!options.spool_path.empty()),
+    response_chunk_size_(options.response_chunk_size),
+    wait_for_offline_nodes_(options.wait_for_offline_nodes),
+    watch_lease_(options.watch_lease),
+    trace_(options.trace)
+    {
+        if(this->descriptor_.count("endpoint") == 0) {
+            string er = "Descriptor must contain key 'endpoint'";
+            spdlog::error(er);
+            
+            throw std::runtime_error(er);
+        }
+
+        this->endpoint_ = this->descriptor_["endpoint"];
+        
+        // The table points into descriptor_, whose leaves stay put as links are added and removed
+        auto result = parse_link_table(this->descriptor_);
+        if(!result) {
+            string er = "Invalid node descriptor";
+            spdlog::error(er);
+
+            throw std::runtime_error(er);
+        }
+
+        this->links_ = std::move(result.value());
+
+        for(const string& dictionary : options.compression_dictionaries) {
+            this->mqtt_client_.add_compression_dictionary(std::make_shared<const string>(dictionary));
+        }
+
+        this->instance_.resize(16);
+        random_id(&this->instance_[0], this->instance_.size());
+
+        char hostname[256] = {0};
+        ::gethostname(hostname, sizeof(hostname) - 1);
+        this->hostname_ = hostname;
+        this->shm_readers_->hostname = this->hostname_;
+
+        for(const LinkRecord& record : this->links_) {
+            this->configure_link_(string(this->links_.path(record)), record.type, *record.descriptor);
+        }
+
+        // endpoint/node_descriptor is a reserved link!
+        string reserved = this->endpoint_ + "/node_descriptor";
+        if(this->links_.revoke(reserved, LinkPermissions::PUT)) {
+            spdlog::error("Reserved link: " + reserved + " found in puttable links.  Deleting");
+        }
+
+        this->link_data_[reserved] = {this->descriptor_.dump(), this->raw_json_bodies_};
+        this->links_.insert(reserved, LinkType::DATA, LinkPermissions::SERVE);
+
+        // So is endpoint/node_status
+        string status_link = create_status_link(this->endpoint_);
+        if(this->links_.revoke(status_link, LinkPermissions::PUT | LinkPermissions::PUBLISH | LinkPermissions::SERVE)) {
+            spdlog::error("Reserved link: " + status_link + " found in node links.  Deleting");
+        }
+
+        if(options.request_workers > 0) {
+            auto handler = [this](IncomingRequest&& request) {this->handle_requests_(this->request_link_, std::move(request.message), request.received);};
+            this->request_pool_ = std::make_unique<WorkerPool<IncomingRequest>>(options.request_workers, options.request_queue_size, std::move(handler));
+        }
+
+        // Watches of other nodes' links may have been lost along with the connection
+        auto signal = this->watch_signal_;
+        this->mqtt_client_.add_connect_listener([signal]() {
+            std::lock_guard<std::mutex> lock(signal->mutex);
+            signal->rewatch = true;
+            signal->cv.notify_all();
+        });
+
+        // Registered before asking the client, so that a connection made in between is not missed
+        auto startup = this->startup_signal_;
+        this->mqtt_client_.add_connect_listener([startup]() {
+            std::lock_guard<std::mutex> lock(startup->mutex);
+            startup->connected = true;
+            startup->cv.notify_all();
+        });
+
+        // Before anything is subscribed, so that no traced message goes unrecorded
+        this->mqtt_client_.set_trace_listener([this](const string& link, const TraceStamps& stamps) {this->record_trace_(link, stamps);});
+
+        // Set up requested links
+        auto get_req_result = get_requests_from_descriptor(descriptor_);
+        if(!get_req_result) {
+            string er = "Descriptor requests invalid";
+            spdlog::error(er);
+
+            throw std::runtime_error(er);
+        }
+
+        // Determine type of requested links: DATA or STREAM.  No request arrives before the request link is subscribed to below
+        this->requests_ = get_req_result.value();
+
+        for(const auto& r : this->requests_) {
+            this->links_.insert(r.link, r.type, (r.type == LinkType::DATA) ? LinkPermissions::GET : LinkPermissions::SUBSCRIBE);
+        }
+
+        // Track the liveness of every node we make requests to.  The subscriptions are issued at once, without waiting for each
+        vector<RequestData> required;
+        for(const auto& r : get_req_result.value()) {
+            this->track_node_(r.link.substr(0, r.link.find_first_of('/')), false);
+
+            if(r.required) {
+                required.push_back(r);
+            }
+        }
+
+        // Subscribed to last and waited for, so that every subscription issued before it is made too
+        this->request_link_ = create_request_link(this->endpoint_);
+        auto cb = [this](const string& topic, string&& message) {this->dispatch_request_(topic, std::move(message));};
+        this->mqtt_client_.subscribe_with_callback(this->request_link_, std::move(cb));
+
+        {
+            std::lock_guard<std::mutex> lock(this->startup_signal_->mutex);
+            this->startup_signal_->connected = this->startup_signal_->connected || !options.connect_async || this->mqtt_client_.is_connected();
+        }
+
+        // Announce ourselves once we are ready to serve requests.  Without a connection yet, the MQTT client does it once there is one
+        this->announce_online_();
+
+        if(!options.connect_async && required.empty()) {
+            this->ready_promise_.set_value(true);
+        } else {
+            auto deadline = std::chrono::steady_clock::now() + options.startup_timeout;
+            this->startup_thread_ = std::thread(&VizierNode::start_, this, std::move(required), deadline);
+        }
+    }
+    
+    /*
+        Stops serving requests before the MQTT client is torn down, so that no worker publishes on a destroyed client
+    */
+    ~VizierNode() {
+        {
+            std::lock_guard<std::mutex> lock(this->startup_signal_->mutex);
+            this->startup_signal_->stop = true;
+        }
+
+        this->startup_signal_->cv.notify_all();
+        if(this->startup_thread_.joinable()) {
+            this->startup_thread_.join();
+        }
+
+        // Subscriptions made through subscribe outlive the node
+        this->mqtt_client_.set_trace_listener(nullptr);
+
+        {
+            std::lock_guard<std::mutex> lock(this->watch_signal_->mutex);
+            this->watch_signal_->stop = true;
+        }
+
+        this->watch_signal_->cv.notify_all();
+        if(this->watch_thread_.joinable()) {
+            this->watch_thread_.join();
+        }
+
+        // Callbacks refer to this node, so they must be gone before its members are
+        for(const auto& watch : this->watches_) {
+            this->mqtt_client_.unsubscribe(create_watch_link(watch.first.substr(0, watch.first.find_first_of('/')), watch.first));
+        }
+
+        // Copied, as the lock cannot be held while unsubscribing: status callbacks take it on the message thread
+        vector<string> tracked;
+        {
+            std::lock_guard<std::mutex> lock(this->node_status_mutex_);
+            for(const auto& status : this->node_online_) {
+                tracked.push_back(status.first);
+            }
+        }
+
+        for(const string& node : tracked) {
+            this->mqtt_client_.unsubscribe(create_status_link(node));
+        }
+
+        this->mqtt_client_.unsubscribe(this->request_link_);
+
+        // Announced here rather than left to the broker, as the last will is only published once the connection times out.  A reconnect
+        // must not announce us again afterwards
+        this->mqtt_client_.set_birth(string(), string());
+        PublishOptions retained;
+        retained.retain = true;
+        retained.priority = Priority::HIGH;
+        this->mqtt_client_.async_publish(create_status_link(this->endpoint_), NODE_OFFLINE, retained);
+
+        if(this->request_pool_) {
+            this->request_pool_->stop();
+        }
+    }
+
+    /*
+        TODO: Doc
+    */
+    bool publish(const string& link, string message) {
+        std::shared_lock<std::shared_mutex> lock(this->links_mutex_);
+        if(!this->links_.allows(link, LinkPermissions::PUBLISH)) {
+            VIZIER_LOG_ERROR_LIMITED("Cannot publish on link {0} because it has not been declared as a link of type STREAM", link);
+            return false;
+        }
+
+        return this->publish_payload_(link, std::move(message));
+    }
+
+    /*
+        Version of publish that overrides the priority declared for the link for this message only, e.g. to send a stop command ahead
+        of the telemetry already queued
+
+        Returns:
+            True if the link has been declared as a link of type STREAM
+    */
+    bool publish(const string& link, string message, const Priority priority) {
+        std::shared_lock<std::shared_mutex> lock(this->links_mutex_);
+        if(!this->links_.allows(link, LinkPermissions::PUBLISH)) {
+            VIZIER_LOG_ERROR_LIMITED("Cannot publish on link {0} because it has not been declared as a link of type STREAM", link);
+            return false;
+        }
+
+        return this->publish_payload_(link, std::move(message), priority);
+    }
+
+    /*
+        Gets the value of a DATA link of another node.  If NodeOptions::get_cache_ttl is set, values are served from the cache while
+        fresh, and concurrent gets of the same link share one request
+
+        Returns:
+            The value, or nothing if no valid response arrived
+    */
+    optional<string> get(const string& link, const size_t& retries, const std::chrono::milliseconds& timeout) {
+        if(!this->allows_(link, LinkPermissions::GET)) {
+            VIZIER_LOG_ERROR_LIMITED("Cannot get on link {0} because it has not been declared as a request of type DATA", link);
+            return std::nullopt;
+        }
+
+        if(this->get_cache_ttl_.count() == 0) {
+            optional<Fetched> fetched = this->fetch_(link, retries, timeout, string());
+            return fetched ? std::move(fetched->body) : std::nullopt;
+        }
+
+        std::promise<optional<string>> promise;
+        string etag;
+        std::unique_lock<std::mutex> lock(this->get_cache_mutex_);
+        auto cached_it = this->get_cache_.find(link);
+
+        if(cached_it != this->get_cache_.end()) {
+            if(std::chrono::steady_clock::now() - cached_it->second.fetched < this->get_cache_ttl_) {
+                return cached_it->second.body;
+            }
+
+            etag = cached_it->second.etag;
+        }
+
+        // Another thread is already fetching the link.  Share its result
+        auto inflight_it = this->inflight_gets_.find(link);
+        if(inflight_it != this->inflight_gets_.end()) {
+            std::shared_future<optional<string>> pending = inflight_it->second;
+            lock.unlock();
+
+            return pending.get();
+        }
+
+        this->inflight_gets_[link] = promise.get_future().share();
+        InflightGet inflight{*this, link, promise, lock};
+        lock.unlock();
+
+        optional<Fetched> fetched = this->fetch_(link, retries, timeout, etag);
+        optional<string> result;
+
+        lock.lock();
+        cached_it = this->get_cache_.find(link);
+
+        // Revalidated a value that was invalidated meanwhile.  Ask for it in full
+        if(fetched && !fetched->body && cached_it == this->get_cache_.end()) {
+            lock.unlock();
+            fetched = this->fetch_(link, retries, timeout, string());
+
+            lock.lock();
+            cached_it = this->get_cache_.find(link);
+        }
+
+        if(fetched && fetched->body) {
+            CachedValue& cached = this->get_cache_[link];
+            cached.body = fetched->body.value();
+            cached.etag = std::move(fetched->etag);
+            cached.fetched = std::chrono::steady_clock::now();
+            result = std::move(fetched->body);
+        } else if(fetched && cached_it != this->get_cache_.end()) {
+            // Revalidated.  The cached value is fresh again
+            cached_it->second.fetched = std::chrono::steady_clock::now();
+            result = cached_it->second.body;
+        }
+
+        this->inflight_gets_.erase(link);
+        lock.unlock();
+
+        inflight.settled = true;
+        promise.set_value(result);
+        return result;
+    }
+
+    /*
+        Removes a link from the cache of get, so that the next get asks the owning node.  Does nothing if the cache is disabled
+    */
+    void invalidate(const string& link) {
+        std::lock_guard<std::mutex> lock(this->get_cache_mutex_);
+        this->get_cache_.erase(link);
+    }
+
+    /*
+        Breaks down the latency of the traced messages received so far on a subscribed STREAM link.  Transit times are corrected by
+        the clock offset of the publishing node once one has been estimated, see sync_clock
+
+        Returns:
+            The breakdown, or nothing if no traced message has arrived on the link
+    */
+    optional<LatencyBreakdown> latency(const string& link) {
+        std::lock_guard<std::mutex> lock(this->trace_mutex_);
+
+        auto it = this->latency_.find(link);
+        if(it == this->latency_.end()) {
+            return std::nullopt;
+        }
+
+        return it->second;
+    }
+
+    /*
+        Returns:
+            The estimated offset of a remote node's clock from ours, or nothing if no traced request to the node has been answered
+    */
+    optional<ClockOffset> clock_offset(const string& node) {
+        std::lock_guard<std::mutex> lock(this->trace_mutex_);
+
+        auto it = this->clock_offsets_.find(node);
+        if(it == this->clock_offsets_.end()) {
+            return std::nullopt;
+        }
+
+        return it->second.estimate();
+    }
+
+    /*
+        Estimates the offset of a remote node's clock from ours, with traced GETs of its node descriptor.  Traced nodes refine the
+        estimate with every request they make anyway
+
+        Args:
+            node: the remote node
+            exchanges: number of requests to make.  The estimate uses the one with the shortest round trip
+            timeout: how long to wait for each response
+
+        Returns:
+            The estimate, or nothing if no request was answered
+    */
+    optional<ClockOffset> sync_clock(const string& node, const size_t exchanges = 4, const std::chrono::milliseconds& timeout = std::chrono::milliseconds(1000)) {
+        for(size_t i = 0; i < exchanges; ++i) {
+            this->make_request(json::object(), Methods::GET, node + "/node_descriptor", 1, timeout, true);
+        }
+
+        return this->clock_offset(node);
+    }
+
+    /*
+        Feeds a traffic log recorded with NodeOptions::record_path back through this node, at the pace it was recorded or faster, e.g. to
+        reproduce a problem or as a load for benchmarks.  Only messages of STREAM links this node publishes or subscribes to are
+        replayed, so a node with the same descriptor as the recording one replays its streams and skips its requests and responses.
+        Messages that were sent through a shared-memory ring are skipped too, as the ring has moved on since.  Blocks until done
+
+        Args:
+            path: the log.  Not the one this node is recording to
+            options: which messages to replay, and how fast
+
+        Returns:
+            The number of messages replayed
+
+        Throws:
+            std::runtime_error if the log cannot be read
+    */
+    size_t replay(const string& path, const ReplayOptions& options = ReplayOptions()) {
+        TrafficLogReader log(path);
+        uint64_t position = (options.from > 0) ? log.seek(options.from) : 0;
+
+        size_t replayed = 0;
+        int64_t first = 0;
+        std::chrono::steady_clock::time_point start;
+
+        while(auto record = log.next(position)) {
+            if(options.until > 0 && record->timestamp > options.until) {
+                break;
+            }
+
+            bool published = record->direction == TrafficDirection::PUBLISHED;
+            bool wanted = published
+                ? options.published && this->allows_(record->topic, LinkPermissions::PUBLISH) && !is_shm_frame(record->payload)
+                : options.received && this->allows_(record->topic, LinkPermissions::SUBSCRIBE);
+
+            if(!wanted) {
+                continue;
+            }
+
+            if(replayed == 0) {
+                first = record->timestamp;
+                start = std::chrono::steady_clock::now();
+            } else if(options.speed > 0) {
+                auto offset = std::chrono::nanoseconds(static_cast<int64_t>((record->timestamp - first) / options.speed));
+                std::this_thread::sleep_until(start + offset);
+            }
+
+            string topic(record->topic);
+            if(published) {
+                std::shared_lock<std::shared_mutex> lock(this->links_mutex_);
+                this->publish_payload_(topic, string(record->payload));
+            } else {
+                this->mqtt_client_.inject(topic, record->payload);
+            }
+
+            ++replayed;
+        }
+
+        spdlog::info("Replayed {0} messages from {1}", replayed, path);
+        return replayed;
+    }
+
+    /*
+        TODO: Doc
+    */
+    optional<shared_ptr<ThreadSafeQueue<string>>> subscribe(const string& link) {
+        if(!this->allows_(link, LinkPermissions::SUBSCRIBE)) {
+            VIZIER_LOG_ERROR_LIMITED("Cannot get on link {0} because it has not been declared as a request of type STREAM", link);
+            return std::nullopt;
+        }
+
+        auto q = std::make_shared<ThreadSafeQueue<string>>();
+        auto f = [q](const string& topic, string&& message) {q->enqueue(std::move(message));};
+
+        if(!this->mqtt_client_.subscribe_with_callback(link, this->shm_aware_(std::move(f)))) {
+            return std::nullopt;
+        }
+
+        return q;
+    }
+
+    /*
+        Subscribes to several STREAM links and aligns their messages by key.  Alignment runs on the MQTT client's message thread as
+        messages arrive, so no consumer thread per link is needed.  Links joined here should not also be subscribed to individually.
+
+        Args:
+            links: STREAM links to join.  Each must have been declared as a request of type STREAM
+            options: key extraction, slop and buffering.  See JoinOptions and json_number_field
+
+        Returns:
+            A queue receiving one message per link, in the order of links, for every aligned tuple
+    */
+    optional<shared_ptr<ThreadSafeQueue<vector<string>>>> subscribe_synchronized(const vector<string>& links, const JoinOptions& options) {
+        for(const auto& link : links) {
+            if(!this->allows_(link, LinkPermissions::SUBSCRIBE)) {
+                VIZIER_LOG_ERROR_LIMITED("Cannot get on link {0} because it has not been declared as a request of type STREAM", link);
+                return std::nullopt;
+            }
+        }
+
+        if(!options.key) {
+            VIZIER_LOG_ERROR_LIMITED("Synchronized subscription requires a key function");
+            return std::nullopt;
+        }
+
+        auto q = std::make_shared<ThreadSafeQueue<vector<string>>>();
+        auto join = std::make_shared<StreamJoin>(links.size(), options, [q](vector<string>&& tuple) {q->enqueue(std::move(tuple));});
+
+        for(size_t i = 0; i < links.size(); ++i) {
+            auto f = [join, i](const string& topic, string&& message) {join->push(i, std::move(message));};
+
+            if(!this->mqtt_client_.subscribe_with_callback(links[i], this->shm_aware_(std::move(f)))) {
+                return std::nullopt;
+            }
+        }
+
+        return q;
+    }
+
+    /*
+        TODO: Doc
+    */
+    bool put(const string& link, string data) {
+        // Held until the value is stored, so that a value put on a link being removed does not outlive it
+        std::shared_lock<std::shared_mutex> lock(this->links_mutex_);
+        if(!this->links_.allows(link, LinkPermissions::PUT)) {
+           VIZIER_LOG_ERROR_LIMITED("Cannot put on link {0} because it has not been declared as a link of type DATA", link);
+           return false; 
+        }
+
+        this->store_(link, std::move(data));
+        return true;
+    }
+
+    /*
+        Watches a DATA link of another node.  The owning node pushes every new value of the link, so watching replaces polling it with
+        GETs.  Watches are renewed in the background, including after the connection to the broker is lost and re-established
+
+        Args:
+            link: link to watch.  Must have been declared as a request of type DATA
+            retries: number of attempts of each WATCH request
+            timeout: time to wait for each response
+
+        Returns:
+            A queue receiving the current value of the link and then each new value, or nothing if the watch could not be registered.
+            Watching a link twice returns the same queue
+    */
+    optional<shared_ptr<ThreadSafeQueue<string>>> watch(const string& link, const size_t& retries, const std::chrono::milliseconds& timeout) {
+        if(!this->allows_(link, LinkPermissions::GET)) {
+            VIZIER_LOG_ERROR_LIMITED("Cannot watch link {0} because it has not been declared as a request of type DATA", link);
+            return std::nullopt;
+        }
+
+        size_t found = link.find_first_of('/');
+        if(found == string::npos) {
+            VIZIER_LOG_ERROR_LIMITED("Invalid link {0}. Structure should be node_name/link/link...", link);
+            return std::nullopt;
+        }
+
+        shared_ptr<ThreadSafeQueue<string>> q;
+        {
+            std::lock_guard<std::mutex> lock(this->watch_signal_->mutex);
+            auto it = this->watches_.find(link);
+            if(it != this->watches_.end()) {
+                return it->second.queue;
+            }
+
+            Watch& watch = this->watches_[link];
+            watch.queue = q = std::make_shared<ThreadSafeQueue<string>>();
+            watch.retries = retries;
+            watch.timeout = timeout;
+
+            if(!this->watch_thread_.joinable()) {
+                this->watch_thread_ = std::thread(&VizierNode::watch_loop_, this);
+            }
+        }
+
+        // Subscribed before registering, so that no value put after the registration is missed
+        string watch_link = create_watch_link(link.substr(0, found), link);
+        auto f = [this, link](const string& topic, string&& message) {this->deliver_watch_(link, std::move(message));};
+
+        if(!this->mqtt_client_.subscribe_with_callback(watch_link, std::move(f)) || !this->register_watch_(link, retries, timeout)) {
+            this->mqtt_client_.unsubscribe(watch_link);
+
+            std::lock_guard<std::mutex> lock(this->watch_signal_->mutex);
+            this->watches_.erase(link);
+            return std::nullopt;
+        }
+
+        return q;
+    }
+
+    /*
+        Stops watching a DATA link of another node.  The owning node stops pushing values once the watch's lease runs out
+
+        Returns:
+            True if the link was watched
+    */
+    bool unwatch(const string& link) {
+        {
+            std::lock_guard<std::mutex> lock(this->watch_signal_->mutex);
+            if(this->watches_.erase(link) == 0) {
+                return false;
+            }
+        }
+
+        this->mqtt_client_.unsubscribe(create_watch_link(link.substr(0, link.find_first_of('/')), link));
+        return true;
+    }
+
+    /*
+        Returns:
+            Whether a node that this node makes requests to is online, or nothing if it is not one of them.  Nodes that have not
+            announced their status are reported as online
+    */
+    optional<bool> is_online(const string& node) {
+        std::lock_guard<std::mutex> lock(this->node_status_mutex_);
+        auto it = this->node_online_.find(node);
+
+        if(it == this->node_online_.end()) {
+            return std::nullopt;
+        }
+
+        return it->second;
+    }
+
+    /*
+        Returns:
+            A future that becomes true once this node is connected to the broker and has announced itself, and the node owning each
+            required request has confirmed that it declares the link with the requested type.  It becomes false if a required link is
+            missing, or if startup takes longer than startup_timeout.  Requests that are not required are not checked
+    */
+    std::shared_future<bool> ready() const {
+        return this->ready_;
+    }
+
+    /*
+        Returns:
+            The current descriptor of this node, including links and requests added since it was constructed
+    */
+    json descriptor() {
+        std::shared_lock<std::shared_mutex> lock(this->links_mutex_);
+        return this->descriptor_;
+    }
+
+    /*
+        Declares a new link of this node while it runs.  Requests for the link are answered as soon as this returns, and
+        endpoint/node_descriptor is updated, so that nodes fetching it afterwards see the link.
+
+        Args:
+            link: absolute path of the link, beneath the endpoint of this node
+            leaf: descriptor of the link, e.g. {"type": "STREAM", "compression": {"codec": "DEFLATE"}}
+
+        Returns:
+            False if the link is already declared or reserved, or if its descriptor is invalid
+    */
+    bool add_link(const string& link, const json& leaf) {
+        if(link.size() <= this->endpoint_.size() + 1 || link.compare(0, this->endpoint_.size() + 1, this->endpoint_ + "/") != 0) {
+            spdlog::error("Cannot add link {0}: it must lie beneath endpoint {1}", link, this->endpoint_);
+            return false;
+        }
+
+        auto type_it = leaf.is_object() ? leaf.find("type") : leaf.end();
+        if(type_it == leaf.end() || (*type_it != "STREAM" && *type_it != "DATA") || leaf.count("links") == 1) {
+            spdlog::error("Cannot add link {0}: its descriptor must be a leaf of type STREAM or DATA", link);
+            return false;
+        }
+
+        LinkType type = (*type_it == "DATA") ? LinkType::DATA : LinkType::STREAM;
+        string key = link.substr(this->endpoint_.size());
+
+        std::unique_lock<std::shared_mutex> lock(this->links_mutex_);
+        auto links_it = this->descriptor_.find("links");
+        bool collides = links_it != this->descriptor_.end() && (!links_it->is_object() || links_it->count(key) == 1);
+
+        // A link that this node only requests from itself already has a record, which is given the new leaf
+        const LinkRecord* existing = this->links_.find(link);
+        bool declared = existing != nullptr && ((existing->permissions & LinkPermissions::SERVE) != 0 || existing->type != type);
+
+        if(collides || declared || link == create_status_link(this->endpoint_)) {
+            spdlog::error("Cannot add link {0}: it is already declared or reserved", link);
+            return false;
+        }
+
+        try {
+            this->configure_link_(link, type, leaf);
+        } catch(const std::runtime_error&) {
+            return false;
+        }
+
+        // Leaves are map nodes, so the records of other links keep pointing at theirs
+        json& stored = this->descriptor_["links"][key];
+        stored = leaf;
+
+        uint8_t permissions = LinkPermissions::SERVE | ((type == LinkType::DATA) ? LinkPermissions::PUT : LinkPermissions::PUBLISH);
+        this->links_.insert(link, type, permissions, &stored);
+        this->links_.set_descriptor(link, &stored);
+
+        this->store_(this->endpoint_ + "/node_descriptor", this->descriptor_.dump());
+        return true;
+    }
+
+    /*
+        Withdraws a link of this node while it runs.  Requests for the link are no longer answered, and its value, history and
+        watches are dropped.  Subscribers of a STREAM link simply stop receiving messages
+
+        Returns:
+            False if the link is not declared by this node
+    */
+    bool remove_link(const string& link) {
+        std::unique_lock<std::shared_mutex> lock(this->links_mutex_);
+        const LinkRecord* record = this->links_.find(link);
+
+        if(record == nullptr || record->descriptor == nullptr || !erase_descriptor_link(this->descriptor_, link)) {
+            spdlog::error("Cannot remove link {0}: it is not declared by this node", link);
+            return false;
+        }
+
+        // The record is gone with the leaf it points at, unless this node also requests the link.  Then it no longer points at the leaf
+        this->links_.revoke(link, LinkPermissions::SERVE | LinkPermissions::PUT | LinkPermissions::PUBLISH);
+        if(!this->links_.allows(link, LinkPermissions::GET) && !this->links_.allows(link, LinkPermissions::SUBSCRIBE)) {
+            this->links_.erase(link);
+        } else {
+            this->links_.set_descriptor(link, nullptr);
+        }
+
+        this->unconfigure_link_(link);
+
+        {
+            std::unique_lock<std::shared_mutex> data_lock(this->link_data_mutex_);
+            this->link_data_.erase(link);
+            this->link_history_.erase(link);
+            this->watched_links_.erase(link);
+        }
+
+        this->store_(this->endpoint_ + "/node_descriptor", this->descriptor_.dump());
+        return true;
+    }
+
+    /*
+        Requests a link of another node while this node runs.  The node owning the link is tracked as for requests of the descriptor
+
+        Returns:
+            False if the link is already requested, or is a link of this node
+    */
+    bool add_request(const RequestData& request) {
+        string node = request.link.substr(0, request.link.find_first_of('/'));
+
+        {
+            std::unique_lock<std::shared_mutex> lock(this->links_mutex_);
+            if(node == this->endpoint_ || this->links_.find(request.link) != nullptr) {
+                spdlog::error("Cannot request link {0}: it is already requested, or is a link of this node", request.link);
+                return false;
+            }
+
+            auto entry = [](const RequestData& r) {
+                return json{{"link", r.link}, {"type", (r.type == LinkType::DATA) ? "DATA" : "STREAM"}, {"required", r.required}};
+            };
+
+            // Descriptors may declare no requests as an empty object.  The parsed requests are all it held
+            json& requests = this->descriptor_["requests"];
+            if(!requests.is_array()) {
+                requests = json::array();
+                for(const auto& r : this->requests_) {
+                    requests.push_back(entry(r));
+                }
+            }
+
+            requests.push_back(entry(request));
+            this->requests_.push_back(request);
+
+            this->links_.insert(request.link, request.type, (request.type == LinkType::DATA) ? LinkPermissions::GET : LinkPermissions::SUBSCRIBE);
+            this->store_(this->endpoint_ + "/node_descriptor", this->descriptor_.dump());
+        }
+
+        this->track_node_(node);
+        return true;
+    }
+
+    /*
+        Withdraws a request of this node while it runs.  A STREAM link is unsubscribed from and a DATA link is no longer watched or
+        cached.  The owning node stops being tracked once no request targets it
+
+        Returns:
+            False if the link is not requested
+    */
+    bool remove_request(const string& link) {
+        string node = link.substr(0, link.find_first_of('/'));
+        LinkType type;
+        bool targeted = false;
+
+        {
+            std::unique_lock<std::shared_mutex> lock(this->links_mutex_);
+            auto it = std::find_if(this->requests_.begin(), this->requests_.end(), [&link](const RequestData& r) {return r.link == link;});
+
+            if(it == this->requests_.end()) {
+                spdlog::error("Cannot remove request {0}: it is not requested by this node", link);
+                return false;
+            }
+
+            type = it->type;
+            this->requests_.erase(it);
+
+            json& requests = this->descriptor_["requests"];
+            for(auto request_it = requests.begin(); request_it != requests.end(); ++request_it) {
+                if(request_it->is_object() && request_it->value("link", "") == link) {
+                    requests.erase(request_it);
+                    break;
+                }
+            }
+
+            this->links_.revoke(link, LinkPermissions::GET | LinkPermissions::SUBSCRIBE);
+            const LinkRecord* record = this->links_.find(link);
+            if(record != nullptr && record->permissions == 0) {
+                this->links_.erase(link);
+            }
+
+            for(const auto& r : this->requests_) {
+                targeted = targeted || r.link.compare(0, node.size() + 1, node + "/") == 0;
+            }
+
+            this->store_(this->endpoint_ + "/node_descriptor", this->descriptor_.dump());
+        }
+
+        // Unsubscribing waits for the MQTT client's message thread, so it happens once the table is unlocked
+        if(type == LinkType::STREAM) {
+            this->mqtt_client_.unsubscribe(link);
+        } else {
+            this->unwatch(link);
+            this->invalidate(link);
+        }
+
+        if(!targeted) {
+            {
+                std::lock_guard<std::mutex> lock(this->node_status_mutex_);
+                this->node_online_.erase(node);
+            }
+
+            this->mqtt_client_.unsubscribe(create_status_link(node));
+        }
+
+        return true;
+    }
+
+    /*
+        Publishes a value on a typed STREAM link.  A BINARY link copies the value into the payload with a single memcpy
+
+        Returns:
+            True if the link has been declared as a link of type STREAM
+    */
+    template <class T, Encoding E>
+    bool publish(const Link<T, LinkType::STREAM, E>& link, const T& value) {
+        string payload;
+        LinkSerializer<T, E>::encode(value, payload);
+
+        std::shared_lock<std::shared_mutex> lock(this->links_mutex_);
+        if(!this->links_.allows(link.path(), LinkPermissions::PUBLISH)) {
+            VIZIER_LOG_ERROR_LIMITED("Cannot publish on link {0} because it has not been declared as a link of type STREAM", link.path());
+            return false;
+        }
+
+        return this->publish_payload_(string(link.path()), std::move(payload));
+    }
+
+    /*
+        Subscribes to a typed STREAM link.  Messages are decoded on the MQTT client's message thread, and malformed messages are dropped
+
+        Returns:
+            A queue of decoded values, or nothing if the link has not been declared as a request of type STREAM
+    */
+    template <class T, Encoding E>
+    optional<shared_ptr<ThreadSafeQueue<T>>> subscribe(const Link<T, LinkType::STREAM, E>& link) {
+        if(!this->allows_(link.path(), LinkPermissions::SUBSCRIBE)) {
+            VIZIER_LOG_ERROR_LIMITED("Cannot get on link {0} because it has not been declared as a request of type STREAM", link.path());
+            return std::nullopt;
+        }
+
+        auto q = std::make_shared<ThreadSafeQueue<T>>();
+        auto f = [q](const string& topic, string&& message) {
+            optional<T> value = LinkSerializer<T, E>::decode(message);
+
+            if(!value) {
+                VIZIER_LOG_ERROR_LIMITED("Dropping malformed message on link {0}", topic);
+                return;
+            }
+
+            q->enqueue(std::move(value.value()));
+        };
+
+        if(!this->mqtt_client_.subscribe_with_callback(string(link.path()), this->shm_aware_(std::move(f)))) {
+            return std::nullopt;
+        }
+
+        return q;
+    }
+
+    /*
+        Gets the value of a typed DATA link from the node owning it
+
+        Returns:
+            The decoded value, or nothing if the request failed or the value does not decode as T
+    */
+    template <class T, Encoding E>
+    optional<T> get(const Link<T, LinkType::DATA, E>& link, const size_t& retries, const std::chrono::milliseconds& timeout) {
+        static_assert(E == Encoding::JSON, "DATA links must be JSON-encoded, as their values are embedded in JSON responses");
+
+        optional<string> body = this->get(string(link.path()), retries, timeout);
+        if(!body) {
+            return std::nullopt;
+        }
+
+        optional<T> value = LinkSerializer<T, E>::decode(body.value());
+        if(!value) {
+            VIZIER_LOG_ERROR_LIMITED("Value of link {0} does not decode as the link's type", link.path());
+        }
+
+        return value;
+    }
+
+    /*
+        Sets the value of a typed DATA link of this node
+
+        Returns:
+            True if the link has been declared as a link of type DATA
+    */
+    template <class T, Encoding E>
+    bool put(const Link<T, LinkType::DATA, E>& link, const T& value) {
+        static_assert(E == Encoding::JSON, "DATA links must be JSON-encoded, as their values are embedded in JSON responses");
+
+        string data;
+        LinkSerializer<T, E>::encode(value, data);
+
+        return this->put(string(link.path()), std::move(data));
     }
 };
 
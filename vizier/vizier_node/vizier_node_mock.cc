@@ -1,31 +1,592 @@
 #include "vizier/vizier_node/vizier_node.h"
 #include "nlohmann/json.hpp"
-#include <string>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
 #include <thread>
+#include <vector>
+
+/*
+Load generator.  Starts a number of simulated nodes in one process and drives traffic between them, reporting throughput, latency
+percentiles and drops, so that the capacity of a broker can be planned before robots are added.
+
+Node i is "load_<i>".  It publishes on its STREAM links at a fixed rate, and subscribes to the STREAM links and requests the DATA links of
+node i + 1, so that every node both produces and consumes.  Requests are GETs of the next node's DATA links, mixed with local puts that
+update the node's own DATA links.  Local puts do not cross the broker, as nodes do not answer PUT requests; they change the values that
+the GETs of the previous node fetch.
+
+Usage:
+    vizier_node_mock [--option=value ...]
+
+    --host=localhost        broker host
+    --port=1883             broker port
+    --spawn-broker          start mosquitto on the port for the duration of the run
+    --nodes=4               number of simulated nodes
+    --streams=2             STREAM links per node
+    --data=1                DATA links per node
+    --rate=10               messages per second on each STREAM link
+    --payload=fixed:256     payload sizes in bytes: fixed:N, uniform:MIN:MAX or exponential:MEAN
+    --requests=5            GETs and local puts per second per node
+    --get-fraction=0.8      fraction of them that are GETs.  The rest are local puts
+    --duration=30           seconds to run.  Zero runs until interrupted
+    --report=5              seconds between reports
+*/
 
 using json = nlohmann::json;
 
-int main() {
-    std::string host = "192.168.1.8";
-    int port = 1884;
-    
-    json descriptor = {
-        {"endpoint", "dummy"},
-        {
-            "links", 
-            {
-                {"/0", {{"type", "STREAM"}}},
-                {"/1", {{"type", "DATA"}}}
-            } 
-        },
-        {"requests", {}}
+namespace {
+    struct LoadOptions {
+        std::string host = "localhost";
+        int port = 1883;
+        bool spawn_broker = false;
+        size_t nodes = 4;
+        size_t streams = 2;
+        size_t data = 1;
+        double rate = 10;
+        std::string payload = "fixed:256";
+        double requests = 5;
+        double get_fraction = 0.8;
+        double duration = 30;
+        double report = 5;
+    };
+
+    // Sequence number and send time, at the start of every stream payload
+    constexpr size_t HEADER_SIZE = 16;
+
+    std::atomic<bool> interrupted{false};
+
+    /*
+    Distribution of payload sizes
+    */
+    class PayloadSizes {
+    private:
+        enum class Kind {FIXED, UNIFORM, EXPONENTIAL};
+
+        Kind kind = Kind::FIXED;
+        double a = 0;
+        double b = 0;
+
+    public:
+        /*
+        Args:
+            spec: fixed:N, uniform:MIN:MAX or exponential:MEAN
+
+        Throws:
+            std::invalid_argument if the spec is malformed
+        */
+        explicit PayloadSizes(const std::string& spec) {
+            auto colon = spec.find(':');
+            std::string name = spec.substr(0, colon);
+            std::string rest = (colon == std::string::npos) ? std::string() : spec.substr(colon + 1);
+
+            if (name == "fixed") {
+                this->kind = Kind::FIXED;
+                this->a = std::stod(rest);
+            } else if (name == "uniform") {
+                auto second = rest.find(':');
+                if (second == std::string::npos) {
+                    throw std::invalid_argument("uniform needs MIN:MAX");
+                }
+
+                this->kind = Kind::UNIFORM;
+                this->a = std::stod(rest.substr(0, second));
+                this->b = std::stod(rest.substr(second + 1));
+            } else if (name == "exponential") {
+                this->kind = Kind::EXPONENTIAL;
+                this->a = std::stod(rest);
+            } else {
+                throw std::invalid_argument("Unknown payload distribution " + name);
+            }
+
+            if (this->a < 0 || this->b < 0 || (this->kind == Kind::UNIFORM && this->b < this->a)) {
+                throw std::invalid_argument("Invalid payload sizes " + spec);
+            }
+        }
+
+        size_t operator()(std::mt19937_64& rng) const {
+            double size = this->a;
+
+            if (this->kind == Kind::UNIFORM) {
+                size = std::uniform_real_distribution<double>(this->a, this->b)(rng);
+            } else if (this->kind == Kind::EXPONENTIAL && this->a > 0) {
+                size = std::exponential_distribution<double>(1 / this->a)(rng);
+            }
+
+            return std::max<size_t>(static_cast<size_t>(size), HEADER_SIZE);
+        }
+    };
+
+    /*
+    Histogram of latencies with buckets of microseconds, SUBBUCKETS per power of two, so that percentiles are within 1 / SUBBUCKETS of
+    the truth however long the run.  Lock free
+    */
+    class LatencyHistogram {
+    private:
+        static constexpr size_t SUBBUCKETS = 16;
+        static constexpr size_t BUCKETS = SUBBUCKETS * 61;
+
+        std::array<std::atomic<uint64_t>, BUCKETS> counts{};
+
+    public:
+        static size_t bucket(const uint64_t us) {
+            if (us < SUBBUCKETS) {
+                return us;
+            }
+
+            // 2^exponent <= us < 2^(exponent + 1), split into SUBBUCKETS
+            const size_t exponent = 63 - __builtin_clzll(us);
+            const size_t shift = exponent - 4;
+            return std::min(SUBBUCKETS + shift * SUBBUCKETS + ((us >> shift) & (SUBBUCKETS - 1)), BUCKETS - 1);
+        }
+
+        // Smallest latency in microseconds that falls in a bucket
+        static uint64_t lowest(const size_t bucket) {
+            if (bucket < SUBBUCKETS) {
+                return bucket;
+            }
+
+            const size_t shift = (bucket - SUBBUCKETS) / SUBBUCKETS;
+            return (SUBBUCKETS + (bucket % SUBBUCKETS)) << shift;
+        }
+
+        void add(const int64_t ns) {
+            this->counts[bucket(static_cast<uint64_t>(std::max<int64_t>(ns, 0)) / 1000)].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        std::vector<uint64_t> snapshot() const {
+            std::vector<uint64_t> out(BUCKETS);
+            for (size_t b = 0; b < BUCKETS; ++b) {
+                out[b] = this->counts[b].load(std::memory_order_relaxed);
+            }
+            return out;
+        }
+    };
+
+    /*
+    Everything the report is made of.  Counters only grow
+    */
+    struct Stats {
+        std::atomic<uint64_t> published{0};
+        std::atomic<uint64_t> rejected{0};
+        std::atomic<uint64_t> received{0};
+        std::atomic<uint64_t> lost{0};
+        std::atomic<uint64_t> gets{0};
+        std::atomic<uint64_t> failed_gets{0};
+        // Local puts on the node's own DATA links, which send nothing over the broker
+        std::atomic<uint64_t> puts{0};
+        std::atomic<uint64_t> failed_puts{0};
+        LatencyHistogram stream_latency;
+        LatencyHistogram get_latency;
+    };
+
+    int64_t steady_now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    std::string node_name(const size_t i) {
+        return "load_" + std::to_string(i);
+    }
+
+    /*
+    Descriptor of node i.  With a single node there is no one to request from
+    */
+    json make_descriptor(const size_t i, const LoadOptions& options) {
+        json links = json::object();
+        json requests = json::array();
+
+        for (size_t k = 0; k < options.streams; ++k) {
+            links["/stream_" + std::to_string(k)] = {{"type", "STREAM"}};
+        }
+
+        for (size_t k = 0; k < options.data; ++k) {
+            links["/data_" + std::to_string(k)] = {{"type", "DATA"}};
+        }
+
+        if (options.nodes > 1) {
+            std::string peer = node_name((i + 1) % options.nodes);
+
+            for (size_t k = 0; k < options.streams; ++k) {
+                requests.push_back({{"link", peer + "/stream_" + std::to_string(k)}, {"type", "STREAM"}, {"required", false}});
+            }
+
+            for (size_t k = 0; k < options.data; ++k) {
+                requests.push_back({{"link", peer + "/data_" + std::to_string(k)}, {"type", "DATA"}, {"required", false}});
+            }
+        }
+
+        return {{"endpoint", node_name(i)}, {"links", links}, {"requests", requests}};
+    }
+
+    std::string make_payload(const size_t size, const uint64_t sequence) {
+        std::string payload(size, 'x');
+        const int64_t sent = steady_now();
+        std::memcpy(&payload[0], &sequence, 8);
+        std::memcpy(&payload[8], &sent, 8);
+        return payload;
+    }
+
+    bool running(const std::chrono::steady_clock::time_point& deadline, const bool forever) {
+        return !interrupted && (forever || std::chrono::steady_clock::now() < deadline);
+    }
+
+    /*
+    Publishes on every STREAM link of a node at the configured rate
+    */
+    void publish_streams(vizier::VizierNode& node, const size_t i, const LoadOptions& options, const PayloadSizes& sizes, Stats& stats,
+                         const std::chrono::steady_clock::time_point deadline, const bool forever) {
+        if (options.rate <= 0 || options.streams == 0) {
+            return;
+        }
+
+        std::mt19937_64 rng(i);
+        // Links are published round robin, spread evenly over each period
+        const auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1 / (options.rate * options.streams)));
+
+        std::vector<uint64_t> sequences(options.streams, 0);
+        auto next = std::chrono::steady_clock::now();
+
+        for (size_t turn = 0; running(deadline, forever); ++turn) {
+            std::this_thread::sleep_until(next);
+            next += interval;
+
+            const size_t k = turn % options.streams;
+            std::string link = node_name(i) + "/stream_" + std::to_string(k);
+
+            if (node.publish(link, make_payload(sizes(rng), sequences[k]++))) {
+                ++stats.published;
+            } else {
+                ++stats.rejected;
+            }
+
+            // Falling behind shows as a lower achieved rate, not as bursts to catch up
+            next = std::max(next, std::chrono::steady_clock::now());
+        }
+    }
+
+    /*
+    Drains one subscription, measuring latency and counting gaps in the sequence
+    */
+    void consume_stream(std::shared_ptr<ThreadSafeQueue<std::string>> queue, Stats& stats, const std::chrono::steady_clock::time_point deadline,
+                        const bool forever) {
+        uint64_t expected = 0;
+
+        while (running(deadline, forever)) {
+            auto message = queue->dequeue(std::chrono::milliseconds(100));
+            if (!message || message->size() < HEADER_SIZE) {
+                continue;
+            }
+
+            uint64_t sequence;
+            int64_t sent;
+            std::memcpy(&sequence, message->data(), 8);
+            std::memcpy(&sent, message->data() + 8, 8);
+
+            stats.stream_latency.add(steady_now() - sent);
+            ++stats.received;
+
+            if (sequence > expected) {
+                stats.lost += sequence - expected;
+            }
+
+            expected = std::max(expected, sequence + 1);
+        }
+    }
+
+    /*
+    Makes a node's mix of GETs and local puts at the configured rate
+    */
+    void make_requests(vizier::VizierNode& node, const size_t i, const LoadOptions& options, const PayloadSizes& sizes, Stats& stats,
+                       const std::chrono::steady_clock::time_point deadline, const bool forever) {
+        if (options.requests <= 0 || options.data == 0) {
+            return;
+        }
+
+        std::mt19937_64 rng(i + 1000003);
+        std::bernoulli_distribution is_get(options.nodes > 1 ? options.get_fraction : 0);
+        std::uniform_int_distribution<size_t> pick(0, options.data - 1);
+
+        const auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1 / options.requests));
+        auto next = std::chrono::steady_clock::now();
+
+        while (running(deadline, forever)) {
+            std::this_thread::sleep_until(next);
+            next += interval;
+
+            std::string link = "/data_" + std::to_string(pick(rng));
+
+            if (is_get(rng)) {
+                const int64_t start = steady_now();
+                auto value = node.get(node_name((i + 1) % options.nodes) + link, 1, std::chrono::milliseconds(1000));
+
+                ++stats.gets;
+                if (value) {
+                    stats.get_latency.add(steady_now() - start);
+                } else {
+                    ++stats.failed_gets;
+                }
+            } else {
+                ++stats.puts;
+                if (!node.put(node_name(i) + link, std::string(sizes(rng), 'd'))) {
+                    ++stats.failed_puts;
+                }
+            }
+
+            // A slow broker makes requests fall behind.  Skip the missed ones rather than bursting to catch up
+            next = std::max(next, std::chrono::steady_clock::now());
+        }
+    }
+
+    /*
+    Percentiles of the latencies added to a histogram between two snapshots of it
+    */
+    std::string percentiles(const std::vector<uint64_t>& now, const std::vector<uint64_t>& before) {
+        std::vector<uint64_t> counts(now.size());
+        uint64_t total = 0;
+
+        for (size_t b = 0; b < now.size(); ++b) {
+            counts[b] = now[b] - (before.empty() ? 0 : before[b]);
+            total += counts[b];
+        }
+
+        if (total == 0) {
+            return "-";
+        }
+
+        auto ms = [&counts, total](const double q) {
+            const uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(q * total + 0.5), 1);
+            uint64_t seen = 0;
+            size_t b = 0;
+
+            while (b + 1 < counts.size() && (seen += counts[b]) < rank) {
+                ++b;
+            }
+
+            char out[32];
+            std::snprintf(out, sizeof(out), "%.2f", LatencyHistogram::lowest(b) / 1e3);
+            return std::string(out);
+        };
+
+        return "p50 " + ms(0.5) + " ms, p90 " + ms(0.9) + " ms, p99 " + ms(0.99) + " ms, max " + ms(1.0) + " ms";
+    }
+
+    /*
+    Counters at the time of a report
+    */
+    struct Snapshot {
+        uint64_t published = 0;
+        uint64_t received = 0;
+        uint64_t gets = 0;
+        uint64_t puts = 0;
+        std::vector<uint64_t> stream_latency;
+        std::vector<uint64_t> get_latency;
     };
 
-    vizier::VizierNode node(host, port, descriptor);
-    node.put("dummy/1", "data");
-    
-    while(true) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+    void report(const Stats& stats, Snapshot& last, const double seconds, const char* label) {
+        Snapshot now{stats.published, stats.received, stats.gets, stats.puts, stats.stream_latency.snapshot(), stats.get_latency.snapshot()};
+
+        spdlog::info("{0}: published {1:.0f}/s, received {2:.0f}/s, lost {3}, rejected {4}", label, (now.published - last.published) / seconds,
+                     (now.received - last.received) / seconds, stats.lost.load(), stats.rejected.load());
+        spdlog::info("{0}: stream latency {1}", label, percentiles(now.stream_latency, last.stream_latency));
+        spdlog::info("{0}: GETs {1:.1f}/s ({2} failed), {3}", label, (now.gets - last.gets) / seconds, stats.failed_gets.load(),
+                     percentiles(now.get_latency, last.get_latency));
+        spdlog::info("{0}: local puts {1:.1f}/s ({2} failed)", label, (now.puts - last.puts) / seconds, stats.failed_puts.load());
+
+        last = std::move(now);
     }
-}
\ No newline at end of file
+
+    bool parse_args(const int argc, char** argv, LoadOptions& options) {
+        for (int a = 1; a < argc; ++a) {
+            std::string arg = argv[a];
+            if (arg.rfind("--", 0) != 0) {
+                std::cerr << "Unexpected argument " << arg << std::endl;
+                return false;
+            }
+
+            auto eq = arg.find('=');
+            std::string key = arg.substr(2, eq - 2);
+            std::string value = (eq == std::string::npos) ? std::string() : arg.substr(eq + 1);
+
+            try {
+                if (key == "host") {
+                    options.host = value;
+                } else if (key == "port") {
+                    options.port = std::stoi(value);
+                } else if (key == "spawn-broker") {
+                    options.spawn_broker = true;
+                } else if (key == "nodes") {
+                    options.nodes = std::stoul(value);
+                } else if (key == "streams") {
+                    options.streams = std::stoul(value);
+                } else if (key == "data") {
+                    options.data = std::stoul(value);
+                } else if (key == "rate") {
+                    options.rate = std::stod(value);
+                } else if (key == "payload") {
+                    options.payload = value;
+                } else if (key == "requests") {
+                    options.requests = std::stod(value);
+                } else if (key == "get-fraction") {
+                    options.get_fraction = std::clamp(std::stod(value), 0.0, 1.0);
+                } else if (key == "duration") {
+                    options.duration = std::stod(value);
+                } else if (key == "report") {
+                    options.report = std::stod(value);
+                } else {
+                    std::cerr << "Unknown option " << arg << std::endl;
+                    return false;
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Invalid value for " << arg << std::endl;
+                return false;
+            }
+        }
+
+        if (options.nodes == 0 || options.report <= 0) {
+            std::cerr << "Need at least one node and a positive report interval" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    /*
+    Starts mosquitto on a port
+
+    Returns:
+        Its pid, or 0 if it could not be started
+    */
+    pid_t spawn_broker(const int port) {
+        std::string port_arg = std::to_string(port);
+        char* const args[] = {const_cast<char*>("mosquitto"), const_cast<char*>("-p"), &port_arg[0], nullptr};
+
+        pid_t pid = 0;
+        if (posix_spawnp(&pid, "mosquitto", nullptr, nullptr, args, environ) != 0) {
+            return 0;
+        }
+
+        // Give it time to listen
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        return pid;
+    }
+}
+
+int main(int argc, char** argv) {
+    LoadOptions options;
+    if (!parse_args(argc, argv, options)) {
+        return 1;
+    }
+
+    std::unique_ptr<PayloadSizes> sizes;
+    try {
+        sizes = std::make_unique<PayloadSizes>(options.payload);
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid --payload: " << e.what() << std::endl;
+        return 1;
+    }
+
+    // Keeps the nodes' logging off the threads that handle messages
+    configure_logging();
+
+    signal(SIGINT, [](int) { interrupted = true; });
+
+    pid_t broker = 0;
+    if (options.spawn_broker) {
+        broker = spawn_broker(options.port);
+        if (broker == 0) {
+            spdlog::error("Could not start mosquitto");
+            return 1;
+        }
+    }
+
+    int status = 0;
+
+    try {
+        std::vector<std::unique_ptr<vizier::VizierNode>> nodes;
+        for (size_t i = 0; i < options.nodes; ++i) {
+            nodes.push_back(std::make_unique<vizier::VizierNode>(options.host, options.port, make_descriptor(i, options)));
+        }
+
+        // GETs find a value from the start
+        std::mt19937_64 rng(0);
+        for (size_t i = 0; i < options.nodes; ++i) {
+            for (size_t k = 0; k < options.data; ++k) {
+                nodes[i]->put(node_name(i) + "/data_" + std::to_string(k), std::string((*sizes)(rng), 'd'));
+            }
+        }
+
+        std::vector<std::shared_ptr<ThreadSafeQueue<std::string>>> queues;
+        if (options.nodes > 1) {
+            for (size_t i = 0; i < options.nodes; ++i) {
+                for (size_t k = 0; k < options.streams; ++k) {
+                    auto queue = nodes[i]->subscribe(node_name((i + 1) % options.nodes) + "/stream_" + std::to_string(k));
+                    if (queue) {
+                        queues.push_back(queue.value());
+                    }
+                }
+            }
+        }
+
+        spdlog::info("Started {0} nodes with {1} STREAM and {2} DATA links each against {3}:{4}", options.nodes, options.streams, options.data,
+                     options.host, options.port);
+
+        Stats stats;
+        const bool forever = options.duration <= 0;
+        const auto start = std::chrono::steady_clock::now();
+        const auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options.duration));
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < options.nodes; ++i) {
+            threads.emplace_back(publish_streams, std::ref(*nodes[i]), i, std::cref(options), std::cref(*sizes), std::ref(stats), deadline, forever);
+            threads.emplace_back(make_requests, std::ref(*nodes[i]), i, std::cref(options), std::cref(*sizes), std::ref(stats), deadline, forever);
+        }
+
+        for (auto& queue : queues) {
+            threads.emplace_back(consume_stream, queue, std::ref(stats), deadline, forever);
+        }
+
+        const auto report_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options.report));
+        auto next_report = start + report_interval;
+        auto last_report = start;
+        Snapshot last;
+        Snapshot first;
+
+        while (running(deadline, forever)) {
+            std::this_thread::sleep_until(forever ? next_report : std::min(next_report, deadline));
+
+            auto now = std::chrono::steady_clock::now();
+            if (now >= next_report) {
+                report(stats, last, std::chrono::duration<double>(now - last_report).count(), "interval");
+                last_report = now;
+                next_report += report_interval;
+            }
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        report(stats, first, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), "total");
+    } catch (const std::exception& e) {
+        spdlog::error("Load generator failed: {0}", e.what());
+        status = 1;
+    }
+
+    if (broker != 0) {
+        kill(broker, SIGTERM);
+        waitpid(broker, nullptr, 0);
+    }
+
+    spdlog::shutdown();
+    return status;
+}
@@ -1,7 +1,14 @@
 #include "nlohmann/json.hpp"
+#include "vizier/utils/spool/spool.h"
 #include "vizier/vizier_node/vizier_node.h"
 #include "gtest/gtest.h"
+#include <atomic>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <thread>
+#include <vector>
 
 using json = nlohmann::json;
 
@@ -93,4 +100,1588 @@ TEST(VizierNode, Get) {
     /*if(result) {
         std::cout << json::parse(result.value()) << std::endl;
     }*/
-}
\ No newline at end of file
+}
+
+TEST(VizierNode, ConcurrentGet) {
+    json server_descriptor = {
+        {"endpoint", "server"},
+        {
+            "links",
+            {
+                {"/data", {{"type", "DATA"}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "server/data"},
+                    {"type", "DATA"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::NodeOptions options;
+    options.request_workers = 4;
+
+    vizier::VizierNode server(host, 1884, server_descriptor, options);
+    vizier::VizierNode client(host, 1884, client_descriptor);
+
+    server.put("server/data", "payload");
+
+    std::vector<std::thread> threads;
+    std::atomic<int> successes(0);
+    for (int i = 0; i < 8; ++i) {
+        threads.emplace_back([&client, &successes]() {
+            for (int j = 0; j < 25; ++j) {
+                auto result = client.get("server/data", 10, std::chrono::milliseconds(500));
+                if (result && result.value() == "payload") {
+                    ++successes;
+                }
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    EXPECT_EQ(200, successes);
+}
+
+TEST(VizierNode, DeltaGet) {
+    json server_descriptor = {
+        {"endpoint", "delta_server"},
+        {
+            "links",
+            {
+                {"/map", {{"type", "DATA"}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "delta_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "delta_server/map"},
+                    {"type", "DATA"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::NodeOptions options;
+    options.data_history = 4;
+
+    vizier::VizierNode server(host, 1884, server_descriptor, options);
+    vizier::VizierNode client(host, 1884, client_descriptor);
+
+    json map = {{"cells", std::vector<int>(1000, 0)}, {"frame", 0}};
+    server.put("delta_server/map", map.dump());
+
+    auto result = client.get("delta_server/map", 10, std::chrono::milliseconds(500));
+    ASSERT_TRUE(bool(result));
+    EXPECT_EQ(map, json::parse(result.value()));
+
+    // Changes within the history are served as patches
+    for (int i = 1; i < 10; ++i) {
+        map["cells"][i] = i;
+        map["frame"] = i;
+        server.put("delta_server/map", map.dump());
+
+        result = client.get("delta_server/map", 10, std::chrono::milliseconds(500));
+        ASSERT_TRUE(bool(result));
+        EXPECT_EQ(map, json::parse(result.value()));
+    }
+
+    // Falling further behind than the history falls back to the full body
+    for (int i = 10; i < 20; ++i) {
+        map["cells"][i] = i;
+        server.put("delta_server/map", map.dump());
+    }
+
+    result = client.get("delta_server/map", 10, std::chrono::milliseconds(500));
+    ASSERT_TRUE(bool(result));
+    EXPECT_EQ(map, json::parse(result.value()));
+}
+
+TEST(VizierNode, CompressedLinks) {
+    std::string dictionary = "{\"battery\": , \"pose\": [], \"status\": \"nominal\"}";
+
+    json server_descriptor = {
+        {"endpoint", "compressed_server"},
+        {
+            "links",
+            {
+                {"/status", {{"type", "STREAM"}, {"compression", {{"codec", "DEFLATE"}, {"threshold", 0}, {"dictionary", dictionary}}}}},
+                {"/map", {{"type", "DATA"}, {"compression", {{"codec", "deflate"}}}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "compressed_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "compressed_server/status"},
+                    {"type", "STREAM"},
+                    {"required", false}
+                },
+                {
+                    {"link", "compressed_server/map"},
+                    {"type", "DATA"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::NodeOptions options;
+    options.compression_dictionaries = {dictionary};
+
+    vizier::VizierNode server(host, 1884, server_descriptor);
+    vizier::VizierNode client(host, 1884, client_descriptor, options);
+
+    std::string map(100000, '0');
+    server.put("compressed_server/map", map);
+
+    auto result = client.get("compressed_server/map", 10, std::chrono::milliseconds(500));
+    ASSERT_TRUE(bool(result));
+    EXPECT_EQ(map, result.value());
+
+    auto q = client.subscribe("compressed_server/status");
+    ASSERT_TRUE(bool(q));
+
+    std::string status = "{\"battery\": 50, \"pose\": [0.1, 0.2, 0.3], \"status\": \"nominal\"}";
+    server.publish("compressed_server/status", status);
+
+    auto received = q.value()->dequeue(std::chrono::milliseconds(1000));
+    ASSERT_TRUE(bool(received));
+    EXPECT_EQ(status, received.value());
+
+    // Binary payloads that do not compress are sent as is, even when they start like a compressed one
+    std::string binary("\0VZ\x01\xff\xfe\xfd\xfc\xfb\xfa\xf9\xf8\xf7\xf6", 16);
+    server.publish("compressed_server/status", binary);
+
+    received = q.value()->dequeue(std::chrono::milliseconds(1000));
+    ASSERT_TRUE(bool(received));
+    EXPECT_EQ(binary, received.value());
+}
+
+TEST(VizierNode, PublishPolicies) {
+    json server_descriptor = {
+        {"endpoint", "policy_server"},
+        {
+            "links",
+            {
+                {"/decimated", {{"type", "STREAM"}, {"policy", {{"decimation", 3}}}}},
+                {"/pose", {{"type", "STREAM"}, {"policy", {{"max_rate", 10}, {"conflate", true}}}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "policy_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "policy_server/decimated"},
+                    {"type", "STREAM"},
+                    {"required", false}
+                },
+                {
+                    {"link", "policy_server/pose"},
+                    {"type", "STREAM"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::VizierNode server(host, 1884, server_descriptor);
+    vizier::VizierNode client(host, 1884, client_descriptor);
+
+    auto decimated = client.subscribe("policy_server/decimated").value();
+    auto pose = client.subscribe("policy_server/pose").value();
+
+    for (int i = 0; i < 30; ++i) {
+        server.publish("policy_server/decimated", std::to_string(i));
+        server.publish("policy_server/pose", std::to_string(i));
+    }
+
+    // Every third message gets through
+    for (int i = 0; i < 30; i += 3) {
+        auto received = decimated->dequeue(std::chrono::milliseconds(1000));
+        ASSERT_TRUE(bool(received));
+        EXPECT_EQ(std::to_string(i), received.value());
+    }
+    EXPECT_FALSE(bool(decimated->dequeue(std::chrono::milliseconds(200))));
+
+    // The rate limit lets one message through immediately and holds back only the latest of the others
+    std::vector<std::string> poses;
+    while (auto received = pose->dequeue(std::chrono::milliseconds(500))) {
+        poses.push_back(received.value());
+    }
+
+    ASSERT_GE(poses.size(), 1);
+    EXPECT_LE(poses.size(), 2);
+    EXPECT_EQ("29", poses.back());
+}
+
+TEST(VizierNode, SynchronizedSubscribe) {
+    json robot_descriptor = {
+        {"endpoint", "sync_robot"},
+        {
+            "links",
+            {
+                {"/a", {{"type", "STREAM"}}},
+                {"/b", {{"type", "STREAM"}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json controller_descriptor = {
+        {"endpoint", "sync_controller"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "sync_robot/a"},
+                    {"type", "STREAM"},
+                    {"required", false}
+                },
+                {
+                    {"link", "sync_robot/b"},
+                    {"type", "STREAM"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::VizierNode robot(host, 1884, robot_descriptor);
+    vizier::VizierNode controller(host, 1884, controller_descriptor);
+
+    JoinOptions options;
+    options.key = vizier::json_number_field("stamp");
+    options.slop = 0.01;
+
+    auto q = controller.subscribe_synchronized({"sync_robot/a", "sync_robot/b"}, options);
+    ASSERT_TRUE(bool(q));
+
+    robot.publish("sync_robot/a", json({{"stamp", 1.0}}).dump());
+    robot.publish("sync_robot/a", json({{"stamp", 2.0}}).dump());
+    robot.publish("sync_robot/b", json({{"stamp", 2.005}}).dump());
+
+    auto tuple = q.value()->dequeue(std::chrono::milliseconds(1000));
+    ASSERT_TRUE(bool(tuple));
+    ASSERT_EQ(2, tuple->size());
+    EXPECT_EQ(2.0, json::parse(tuple->at(0))["stamp"]);
+    EXPECT_EQ(2.005, json::parse(tuple->at(1))["stamp"]);
+}
+
+TEST(VizierNode, RawJsonBodies) {
+    json server_descriptor = {
+        {"endpoint", "raw_server"},
+        {
+            "links",
+            {
+                {"/config", {{"type", "DATA"}}},
+                {"/text", {{"type", "DATA"}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "raw_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "raw_server/config"},
+                    {"type", "DATA"},
+                    {"required", false}
+                },
+                {
+                    {"link", "raw_server/text"},
+                    {"type", "DATA"},
+                    {"required", false}
+                },
+                {
+                    {"link", "raw_server/node_descriptor"},
+                    {"type", "DATA"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::VizierNode server(host, 1884, server_descriptor);
+    vizier::VizierNode client(host, 1884, client_descriptor);
+
+    // JSON bodies come back byte for byte, non-JSON bodies are still escaped
+    std::string config = "{\"gains\": [1.5, 2.5], \"name\": \"robot \\\"1\\\"\"}";
+    std::string text = "not {json";
+    server.put("raw_server/config", config);
+    server.put("raw_server/text", text);
+
+    EXPECT_EQ(config, client.get("raw_server/config", 10, std::chrono::milliseconds(500)).value());
+    EXPECT_EQ(text, client.get("raw_server/text", 10, std::chrono::milliseconds(500)).value());
+    EXPECT_EQ(server_descriptor, json::parse(client.get("raw_server/node_descriptor", 10, std::chrono::milliseconds(500)).value()));
+
+    // Valid JSON that is not an object or array is escaped too, so that a JSON string is not taken for an escaped body
+    auto watched = client.watch("raw_server/text", 10, std::chrono::milliseconds(500)).value();
+    EXPECT_EQ(text, watched->dequeue(std::chrono::milliseconds(1000)).value());
+
+    for(const std::string& value : {std::string("\"abc\""), std::string("\"a \\\"b\\\"\""), std::string("42")}) {
+        server.put("raw_server/text", value);
+        EXPECT_EQ(value, watched->dequeue(std::chrono::milliseconds(1000)).value());
+        EXPECT_EQ(value, client.get("raw_server/text", 10, std::chrono::milliseconds(500)).value());
+    }
+}
+
+struct TypedPose {
+    double x;
+    double y;
+    double theta;
+};
+
+struct TypedGains {
+    std::vector<double> values;
+    std::string name;
+};
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(TypedGains, values, name)
+
+constexpr vizier::Link<TypedPose, vizier::LinkType::STREAM> typed_pose("typed_server/pose");
+constexpr vizier::Link<TypedGains, vizier::LinkType::DATA> typed_gains("typed_server/gains");
+constexpr vizier::Link<std::string, vizier::LinkType::DATA> typed_label("typed_server/label");
+
+TEST(VizierNode, TypedLinks) {
+    json server_descriptor = {
+        {"endpoint", "typed_server"},
+        {
+            "links",
+            {
+                {"/pose", {{"type", "STREAM"}}},
+                {"/gains", {{"type", "DATA"}}},
+                {"/label", {{"type", "DATA"}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "typed_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "typed_server/pose"},
+                    {"type", "STREAM"},
+                    {"required", false}
+                },
+                {
+                    {"link", "typed_server/gains"},
+                    {"type", "DATA"},
+                    {"required", false}
+                },
+                {
+                    {"link", "typed_server/label"},
+                    {"type", "DATA"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::VizierNode server(host, 1884, server_descriptor);
+    vizier::VizierNode client(host, 1884, client_descriptor);
+
+    auto q = client.subscribe(typed_pose);
+    ASSERT_TRUE(bool(q));
+
+    EXPECT_TRUE(server.publish(typed_pose, {1.0, -2.0, 0.5}));
+    auto pose = q.value()->dequeue(std::chrono::milliseconds(1000));
+    ASSERT_TRUE(bool(pose));
+    EXPECT_EQ(1.0, pose->x);
+    EXPECT_EQ(-2.0, pose->y);
+    EXPECT_EQ(0.5, pose->theta);
+
+    // The client does not own the link
+    EXPECT_FALSE(client.publish(typed_pose, {0, 0, 0}));
+
+    EXPECT_TRUE(server.put(typed_gains, {{1.5, 2.5}, "pd"}));
+    auto gains = client.get(typed_gains, 10, std::chrono::milliseconds(500));
+    ASSERT_TRUE(bool(gains));
+    EXPECT_EQ(std::vector<double>({1.5, 2.5}), gains->values);
+    EXPECT_EQ("pd", gains->name);
+
+    // Strings are stored as JSON strings
+    EXPECT_TRUE(server.put(typed_label, std::string("arm \"left\"")));
+    EXPECT_EQ("arm \"left\"", client.get(typed_label, 10, std::chrono::milliseconds(500)).value());
+}
+
+TEST(VizierNode, Watch) {
+    json server_descriptor = {
+        {"endpoint", "watch_server"},
+        {
+            "links",
+            {
+                {"/config", {{"type", "DATA"}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "watch_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "watch_server/config"},
+                    {"type", "DATA"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    // A short lease, so that the watch has to be renewed during the test
+    vizier::NodeOptions server_options;
+    server_options.watch_lease = std::chrono::milliseconds(200);
+
+    vizier::VizierNode server(host, 1884, server_descriptor, server_options);
+    vizier::VizierNode client(host, 1884, client_descriptor);
+
+    server.put("watch_server/config", "{\"gain\": 0}");
+
+    auto q = client.watch("watch_server/config", 10, std::chrono::milliseconds(500));
+    ASSERT_TRUE(bool(q));
+    EXPECT_EQ("{\"gain\": 0}", q.value()->dequeue(std::chrono::milliseconds(1000)).value());
+
+    for(int i = 1; i <= 5; ++i) {
+        server.put("watch_server/config", "{\"gain\": " + std::to_string(i) + "}");
+    }
+
+    // Every put is pushed, in order
+    for(int i = 1; i <= 5; ++i) {
+        EXPECT_EQ("{\"gain\": " + std::to_string(i) + "}", q.value()->dequeue(std::chrono::milliseconds(1000)).value());
+    }
+
+    // Outlive the lease several times over.  The client renews the watch, so puts are still pushed
+    std::this_thread::sleep_for(std::chrono::milliseconds(700));
+    server.put("watch_server/config", "not json");
+    EXPECT_EQ("not json", q.value()->dequeue(std::chrono::milliseconds(1000)).value());
+
+    // Watching again returns the same queue
+    EXPECT_EQ(q.value(), client.watch("watch_server/config", 10, std::chrono::milliseconds(500)).value());
+
+    EXPECT_TRUE(client.unwatch("watch_server/config"));
+    EXPECT_FALSE(client.unwatch("watch_server/config"));
+    server.put("watch_server/config", "{\"gain\": 6}");
+    EXPECT_FALSE(bool(q.value()->dequeue(std::chrono::milliseconds(200))));
+
+    // Only requested DATA links can be watched
+    EXPECT_FALSE(bool(client.watch("watch_server/other", 1, std::chrono::milliseconds(100))));
+}
+
+TEST(VizierNode, CachedGet) {
+    json server_descriptor = {
+        {"endpoint", "cache_server"},
+        {
+            "links",
+            {
+                {"/calibration", {{"type", "DATA"}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "cache_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "cache_server/calibration"},
+                    {"type", "DATA"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::NodeOptions client_options;
+    client_options.get_cache_ttl = std::chrono::milliseconds(300);
+
+    vizier::VizierNode server(host, 1884, server_descriptor);
+    vizier::VizierNode client(host, 1884, client_descriptor, client_options);
+
+    server.put("cache_server/calibration", "{\"offset\": 1}");
+
+    // Concurrent gets share one request and all see the same value
+    std::vector<std::thread> threads;
+    std::atomic<int> correct(0);
+    for(int i = 0; i < 8; ++i) {
+        threads.emplace_back([&client, &correct]() {
+            auto value = client.get("cache_server/calibration", 10, std::chrono::milliseconds(500));
+            if(value && value.value() == "{\"offset\": 1}") {
+                ++correct;
+            }
+        });
+    }
+    for(auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(8, correct.load());
+
+    // Served from the cache while fresh, even though the value changed
+    server.put("cache_server/calibration", "{\"offset\": 2}");
+    EXPECT_EQ("{\"offset\": 1}", client.get("cache_server/calibration", 10, std::chrono::milliseconds(500)).value());
+
+    // Revalidated once expired
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    EXPECT_EQ("{\"offset\": 2}", client.get("cache_server/calibration", 10, std::chrono::milliseconds(500)).value());
+
+    // Unchanged values are confirmed by etag
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    EXPECT_EQ("{\"offset\": 2}", client.get("cache_server/calibration", 10, std::chrono::milliseconds(500)).value());
+
+    server.put("cache_server/calibration", "{\"offset\": 3}");
+    client.invalidate("cache_server/calibration");
+    EXPECT_EQ("{\"offset\": 3}", client.get("cache_server/calibration", 10, std::chrono::milliseconds(500)).value());
+}
+
+TEST(VizierNode, CachedGetInvalidatedWhileRevalidating) {
+    json client_descriptor = {
+        {"endpoint", "stale_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "stale_owner/value"},
+                    {"type", "DATA"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::NodeOptions client_options;
+    client_options.get_cache_ttl = std::chrono::milliseconds(100);
+    vizier::VizierNode client(host, 1884, client_descriptor, client_options);
+
+    // Stands in for the owning node, so that a revalidation can be held up until the value is invalidated
+    MqttClientAsync owner(host, 1884);
+    std::promise<void> revalidating;
+    std::promise<void> invalidated;
+    std::shared_future<void> invalidated_future = invalidated.get_future().share();
+    std::atomic<int> full_fetches(0);
+
+    owner.subscribe_with_callback(vizier::create_request_link("stale_owner"), [&](const std::string& topic, std::string&& message) {
+        json request = json::parse(message);
+        std::string response_link = vizier::create_response_link("stale_owner", request["id"]);
+
+        if(request["body"].count("if_none_match") == 1) {
+            revalidating.set_value();
+            invalidated_future.wait();
+            owner.async_publish(response_link, vizier::dump_response("304", std::string(), false, vizier::LinkType::DATA, {{"etag", "e1"}}));
+            return;
+        }
+
+        std::string value = "v" + std::to_string(++full_fetches);
+        owner.async_publish(response_link, vizier::dump_response("200", value, false, vizier::LinkType::DATA, {{"etag", "e" + std::to_string(full_fetches)}}));
+    });
+
+    EXPECT_EQ("v1", client.get("stale_owner/value", 5, std::chrono::milliseconds(500)).value());
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+
+    // The owner confirms the cached value, but it was invalidated meanwhile and is fetched in full
+    auto revalidated = std::async(std::launch::async, [&client]() {
+        return client.get("stale_owner/value", 1, std::chrono::milliseconds(2000));
+    });
+
+    revalidating.get_future().wait();
+    client.invalidate("stale_owner/value");
+    invalidated.set_value();
+
+    auto value = revalidated.get();
+    ASSERT_TRUE(bool(value));
+    EXPECT_EQ("v2", value.value());
+}
+
+TEST(VizierNode, OfflineNodesFailFast) {
+    json server_descriptor = {
+        {"endpoint", "live_server"},
+        {
+            "links",
+            {
+                {"/data", {{"type", "DATA"}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "live_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "live_server/data"},
+                    {"type", "DATA"},
+                    {"required", false}
+                },
+                {
+                    {"link", "live_server/node_descriptor"},
+                    {"type", "DATA"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::VizierNode client(host, 1884, client_descriptor);
+    EXPECT_FALSE(bool(client.is_online("unknown_node")));
+
+    {
+        vizier::VizierNode server(host, 1884, server_descriptor);
+        server.put("live_server/data", "1");
+
+        EXPECT_EQ("1", client.get("live_server/data", 10, std::chrono::milliseconds(500)).value());
+        EXPECT_TRUE(client.is_online("live_server").value());
+    }
+
+    // The server announced that it went offline, so the request does not wait out its retries
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(2000);
+    while(client.is_online("live_server").value() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_FALSE(client.is_online("live_server").value());
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(bool(client.get("live_server/data", 10, std::chrono::milliseconds(500))));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(500));
+
+    // A node that waits for offline nodes is answered once the server is back
+    vizier::NodeOptions waiting;
+    waiting.wait_for_offline_nodes = true;
+    json waiting_descriptor = client_descriptor;
+    waiting_descriptor["endpoint"] = "live_waiting_client";
+
+    vizier::VizierNode waiting_client(host, 1884, waiting_descriptor, waiting);
+    auto result = std::async(std::launch::async, [&waiting_client]() {
+        return waiting_client.get("live_server/node_descriptor", 10, std::chrono::milliseconds(500));
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    vizier::VizierNode server(host, 1884, server_descriptor);
+
+    EXPECT_EQ(server_descriptor, json::parse(result.get().value()));
+}
+
+TEST(VizierNode, SpooledLinks) {
+    json server_descriptor = {
+        {"endpoint", "spool_server"},
+        {
+            "links",
+            {
+                {"/pose", {{"type", "STREAM"}, {"spool", {{"max_age", 60}, {"on_full", "DROP_OLDEST"}}}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "spool_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "spool_server/pose"},
+                    {"type", "STREAM"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+    std::string spool_path = "/tmp/vizier_node_test.spool";
+    std::remove(spool_path.c_str());
+
+    vizier::NodeOptions options;
+    options.spool_path = spool_path;
+    options.spool_capacity = 4096;
+
+    // A backlog left behind by a previous run of the server, one message of which has gone stale
+    {
+        RingSpool spool(spool_path, options.spool_capacity);
+        spool.push("spool_server/pose", "backlog_0", 0, true);
+        spool.push("spool_server/pose", "stale", 1, true);
+        spool.push("spool_server/pose", "backlog_1", 0, true);
+        spool.push("spool_server/status", "retained", 0, true, 0, true);
+    }
+
+    vizier::VizierNode client(host, 1884, client_descriptor);
+    auto pose = client.subscribe("spool_server/pose").value();
+
+    vizier::VizierNode server(host, 1884, server_descriptor, options);
+    server.publish("spool_server/pose", "live");
+
+    // The backlog is sent first, and new messages queue up behind it
+    for (const char* expected : {"backlog_0", "backlog_1", "live"}) {
+        auto received = pose->dequeue(std::chrono::milliseconds(1000));
+        ASSERT_TRUE(bool(received));
+        EXPECT_EQ(expected, received.value());
+    }
+
+    // Sent from the spool with the retain flag it was spooled with
+    MqttClientAsync late(host, 1884);
+    auto status = late.subscribe("spool_server/status").value();
+    auto retained = status->dequeue(std::chrono::milliseconds(1000));
+    ASSERT_TRUE(bool(retained));
+    EXPECT_EQ("retained", retained.value());
+
+    std::remove(spool_path.c_str());
+}
+
+TEST(VizierNode, PersistentSession) {
+    json server_descriptor = {
+        {"endpoint", "session_server"},
+        {
+            "links",
+            {
+                {"/data", {{"type", "DATA"}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "session_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "session_server/data"},
+                    {"type", "DATA"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::NodeOptions options;
+    options.persistent_session = true;
+
+    vizier::VizierNode server(host, 1884, server_descriptor, options);
+    server.put("session_server/data", "1");
+
+    // A restarted node picks up the session its previous instance left behind
+    for (int i = 0; i < 2; ++i) {
+        vizier::VizierNode client(host, 1884, client_descriptor, options);
+
+        for (int j = 0; j < 10; ++j) {
+            auto result = client.get("session_server/data", 3, std::chrono::milliseconds(500));
+            ASSERT_TRUE(bool(result));
+            EXPECT_EQ("1", result.value());
+        }
+    }
+}
+
+TEST(VizierNode, SharedMemoryLinks) {
+    json server_descriptor = {
+        {"endpoint", "shm_server"},
+        {
+            "links",
+            {
+                {"/frames", {{"type", "STREAM"}, {"shm", {{"size", 1 << 20}}}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "shm_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "shm_server/frames"},
+                    {"type", "STREAM"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::VizierNode server(host, 1884, server_descriptor);
+    vizier::VizierNode client(host, 1884, client_descriptor);
+
+    auto frames = client.subscribe("shm_server/frames").value();
+
+    for (char c = 'a'; c < 'e'; ++c) {
+        std::string frame(300 * 1024, c);
+        EXPECT_TRUE(server.publish("shm_server/frames", frame));
+
+        auto received = frames->dequeue(std::chrono::milliseconds(1000));
+        ASSERT_TRUE(bool(received));
+        EXPECT_EQ(frame, received.value());
+    }
+
+    // Larger than the ring
+    EXPECT_FALSE(server.publish("shm_server/frames", std::string(2 << 20, 'x')));
+}
+
+TEST(VizierNode, SharedMemorySubscriberTeardown) {
+    json server_descriptor = {
+        {"endpoint", "shm_teardown_server"},
+        {
+            "links",
+            {
+                {"/frames", {{"type", "STREAM"}, {"shm", {{"size", 1 << 20}}}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "shm_teardown_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "shm_teardown_server/frames"},
+                    {"type", "STREAM"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::VizierNode server(host, 1884, server_descriptor);
+
+    std::atomic<bool> stop(false);
+    std::thread publisher([&server, &stop]() {
+        while (!stop) {
+            server.publish("shm_teardown_server/frames", std::string(1024, 'x'));
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    });
+
+    // Frames keep arriving while each client is destroyed, and its subscription outlives it
+    for (int i = 0; i < 5; ++i) {
+        vizier::VizierNode client(host, 1884, client_descriptor);
+        auto frames = client.subscribe("shm_teardown_server/frames").value();
+
+        auto received = frames->dequeue(std::chrono::milliseconds(1000));
+        ASSERT_TRUE(bool(received));
+        EXPECT_EQ(std::string(1024, 'x'), received.value());
+    }
+
+    stop = true;
+    publisher.join();
+}
+
+TEST(VizierNode, ChunkedGet) {
+    json server_descriptor = {
+        {"endpoint", "chunk_server"},
+        {
+            "links",
+            {
+                {"/map", {{"type", "DATA"}}},
+                {"/pose", {{"type", "STREAM"}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "chunk_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "chunk_server/map"},
+                    {"type", "DATA"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::NodeOptions options;
+    options.response_chunk_size = 64 << 10;
+
+    vizier::VizierNode server(host, 1884, server_descriptor, options);
+    vizier::VizierNode client(host, 1884, client_descriptor);
+
+    // Not valid JSON, so it is sent as an escaped string
+    std::string map(1 << 20, '\0');
+    for (size_t i = 0; i < map.size(); ++i) {
+        map[i] = static_cast<char>('a' + i % 26);
+    }
+    map[0] = '{';
+    server.put("chunk_server/map", map);
+
+    for (int i = 0; i < 3; ++i) {
+        auto result = client.get("chunk_server/map", 3, std::chrono::milliseconds(1000));
+        ASSERT_TRUE(bool(result));
+        EXPECT_EQ(map, result.value());
+    }
+
+    // Small values are not chunked
+    server.put("chunk_server/map", "{}");
+    EXPECT_EQ("{}", client.get("chunk_server/map", 3, std::chrono::milliseconds(1000)).value());
+}
+
+TEST(VizierNode, PriorityLanes) {
+    json server_descriptor = {
+        {"endpoint", "lane_server"},
+        {
+            "links",
+            {
+                {"/telemetry", {{"type", "STREAM"}, {"priority", "LOW"}}},
+                {"/stop", {{"type", "STREAM"}, {"priority", "CRITICAL"}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "lane_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "lane_server/telemetry"},
+                    {"type", "STREAM"},
+                    {"required", false}
+                },
+                {
+                    {"link", "lane_server/stop"},
+                    {"type", "STREAM"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::VizierNode server(host, 1884, server_descriptor);
+    vizier::VizierNode client(host, 1884, client_descriptor);
+
+    auto telemetry = client.subscribe("lane_server/telemetry").value();
+    auto stop = client.subscribe("lane_server/stop").value();
+
+    const size_t backlog = 5000;
+    for (size_t i = 0; i < backlog; ++i) {
+        server.publish("lane_server/telemetry", std::string(1024, 't'));
+    }
+
+    EXPECT_TRUE(server.publish("lane_server/stop", "stop"));
+
+    // The stop command overtakes the telemetry still queued
+    ASSERT_TRUE(bool(stop->dequeue(std::chrono::milliseconds(5000))));
+    EXPECT_LT(telemetry->size(), backlog);
+
+    // A per-call priority overrides the link's
+    EXPECT_TRUE(server.publish("lane_server/telemetry", "urgent", Priority::CRITICAL));
+
+    json invalid_descriptor = {
+        {"endpoint", "lane_invalid"},
+        {"links", {{"/telemetry", {{"type", "STREAM"}, {"priority", "URGENT"}}}}},
+        {"requests", {}}
+    };
+
+    EXPECT_THROW(vizier::VizierNode(host, 1884, invalid_descriptor), std::runtime_error);
+}
+
+TEST(VizierNode, TracedLinks) {
+    json server_descriptor = {
+        {"endpoint", "trace_server"},
+        {
+            "links",
+            {
+                {"/pose", {{"type", "STREAM"}}},
+                {"/scan", {{"type", "STREAM"}, {"compression", {{"codec", "DEFLATE"}, {"threshold", 0}}}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "trace_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "trace_server/pose"},
+                    {"type", "STREAM"},
+                    {"required", false}
+                },
+                {
+                    {"link", "trace_server/scan"},
+                    {"type", "STREAM"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::NodeOptions options;
+    options.trace = true;
+
+    vizier::VizierNode server(host, 1884, server_descriptor, options);
+    vizier::VizierNode client(host, 1884, client_descriptor);
+
+    // Both nodes share a clock, so the estimate is off by at most half a round trip
+    auto offset = client.sync_clock("trace_server");
+    ASSERT_TRUE(bool(offset));
+    EXPECT_EQ(4, offset->samples);
+    EXPECT_LE(std::abs(offset->offset), offset->delay / 2 + 1);
+
+    auto pose = client.subscribe("trace_server/pose").value();
+    auto scan = client.subscribe("trace_server/scan").value();
+
+    for (int i = 0; i < 5; ++i) {
+        server.publish("trace_server/pose", "pose " + std::to_string(i));
+        server.publish("trace_server/scan", std::string(1000, 's'));
+
+        // Subscribers see the payload without the trace header
+        EXPECT_EQ("pose " + std::to_string(i), pose->dequeue(std::chrono::milliseconds(1000)).value());
+        EXPECT_EQ(std::string(1000, 's'), scan->dequeue(std::chrono::milliseconds(1000)).value());
+    }
+
+    auto latency = client.latency("trace_server/pose");
+    ASSERT_TRUE(bool(latency));
+    EXPECT_EQ(5, latency->messages);
+    EXPECT_EQ(0, latency->lost);
+    EXPECT_EQ(0, latency->uncorrected);
+    EXPECT_GE(latency->queue.min, 0);
+    EXPECT_GE(latency->dispatch.min, 0);
+    EXPECT_GE(latency->total.max, latency->dispatch.max);
+
+    EXPECT_EQ(5, client.latency("trace_server/scan")->messages);
+
+    // Nothing traced was sent to the server, and nothing was requested of the client
+    EXPECT_FALSE(bool(server.latency("trace_client/0")));
+    EXPECT_FALSE(bool(server.clock_offset("trace_client")));
+}
+
+TEST(VizierNode, RecordAndReplay) {
+    json server_descriptor = {
+        {"endpoint", "replay_server"},
+        {
+            "links",
+            {
+                {"/pose", {{"type", "STREAM"}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "replay_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "replay_server/pose"},
+                    {"type", "STREAM"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+    std::string server_log = "/tmp/vizier_node_test_server.vzlog";
+    std::string client_log = "/tmp/vizier_node_test_client.vzlog";
+
+    {
+        vizier::NodeOptions server_options;
+        server_options.record_path = server_log;
+        vizier::NodeOptions client_options;
+        client_options.record_path = client_log;
+
+        vizier::VizierNode server(host, 1884, server_descriptor, server_options);
+        vizier::VizierNode client(host, 1884, client_descriptor, client_options);
+
+        auto pose = client.subscribe("replay_server/pose").value();
+
+        for (int i = 0; i < 5; ++i) {
+            server.publish("replay_server/pose", "pose " + std::to_string(i));
+            EXPECT_EQ("pose " + std::to_string(i), pose->dequeue(std::chrono::milliseconds(1000)).value());
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+
+    // A node with the same descriptor republishes what the server published, at the recorded pace
+    {
+        vizier::VizierNode server(host, 1884, server_descriptor);
+        vizier::VizierNode client(host, 1884, client_descriptor);
+
+        auto pose = client.subscribe("replay_server/pose").value();
+
+        auto start = std::chrono::steady_clock::now();
+        EXPECT_EQ(5, server.replay(server_log));
+        EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(80));
+
+        for (int i = 0; i < 5; ++i) {
+            EXPECT_EQ("pose " + std::to_string(i), pose->dequeue(std::chrono::milliseconds(1000)).value());
+        }
+
+        // The client's own log feeds its subscribers without the server, as fast as possible
+        vizier::ReplayOptions options;
+        options.speed = 0;
+        options.published = false;
+        options.received = true;
+
+        start = std::chrono::steady_clock::now();
+        EXPECT_EQ(5, client.replay(client_log, options));
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(80));
+
+        for (int i = 0; i < 5; ++i) {
+            EXPECT_EQ("pose " + std::to_string(i), pose->dequeue(std::chrono::milliseconds(1000)).value());
+        }
+
+        // Nothing the client received is published by the server
+        EXPECT_EQ(0, server.replay(client_log, options));
+    }
+
+    std::remove(server_log.c_str());
+    std::remove(client_log.c_str());
+}
+
+TEST(VizierNode, RuntimeLinks) {
+    json server_descriptor = {
+        {"endpoint", "runtime_server"},
+        {
+            "links",
+            {
+                {"/data", {{"type", "DATA"}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "runtime_client"},
+        {
+            "links",
+            {
+                {"/0", {{"type", "STREAM"}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::VizierNode server(host, 1884, server_descriptor);
+    vizier::VizierNode client(host, 1884, client_descriptor);
+
+    // Nothing is requested yet
+    EXPECT_FALSE(client.subscribe("runtime_server/pose"));
+    EXPECT_FALSE(server.publish("runtime_server/pose", "pose"));
+
+    // Links must be leaves beneath the endpoint, and must not be declared twice
+    EXPECT_FALSE(server.add_link("runtime_client/pose", {{"type", "STREAM"}}));
+    EXPECT_FALSE(server.add_link("runtime_server/pose", {{"type", "EVENT"}}));
+    EXPECT_FALSE(server.add_link("runtime_server/data", {{"type", "DATA"}}));
+    EXPECT_FALSE(server.add_link("runtime_server/node_descriptor", {{"type", "DATA"}}));
+
+    EXPECT_TRUE(server.add_link("runtime_server/pose", {{"type", "STREAM"}, {"compression", {{"codec", "DEFLATE"}}}}));
+    EXPECT_TRUE(server.add_link("runtime_server/map", {{"type", "DATA"}}));
+    EXPECT_TRUE(server.put("runtime_server/map", "map"));
+
+    vizier::RequestData pose_request;
+    pose_request.link = "runtime_server/pose";
+    pose_request.type = vizier::LinkType::STREAM;
+
+    vizier::RequestData map_request;
+    map_request.link = "runtime_server/map";
+    map_request.type = vizier::LinkType::DATA;
+
+    EXPECT_TRUE(client.add_request(pose_request));
+    EXPECT_TRUE(client.add_request(map_request));
+    EXPECT_FALSE(client.add_request(pose_request));
+    EXPECT_TRUE(client.is_online("runtime_server"));
+
+    auto pose = client.subscribe("runtime_server/pose").value();
+    EXPECT_TRUE(server.publish("runtime_server/pose", "pose"));
+    EXPECT_EQ("pose", pose->dequeue(std::chrono::milliseconds(1000)).value());
+    EXPECT_EQ("map", client.get("runtime_server/map", 5, std::chrono::milliseconds(500)).value());
+
+    // The published descriptor follows the node's links and requests
+    vizier::RequestData descriptor_request;
+    descriptor_request.link = "runtime_server/node_descriptor";
+    descriptor_request.type = vizier::LinkType::DATA;
+    EXPECT_TRUE(client.add_request(descriptor_request));
+
+    auto descriptor = json::parse(client.get("runtime_server/node_descriptor", 5, std::chrono::milliseconds(500)).value());
+    EXPECT_EQ(server.descriptor(), descriptor);
+    EXPECT_EQ(1, descriptor["links"].count("/pose"));
+    EXPECT_EQ(3, client.descriptor()["requests"].size());
+
+    // Removed links are no longer served, while the others are
+    EXPECT_TRUE(server.remove_link("runtime_server/map"));
+    EXPECT_FALSE(server.remove_link("runtime_server/map"));
+    EXPECT_FALSE(server.put("runtime_server/map", "map"));
+    EXPECT_FALSE(client.get("runtime_server/map", 1, std::chrono::milliseconds(200)));
+
+    descriptor = json::parse(client.get("runtime_server/node_descriptor", 5, std::chrono::milliseconds(500)).value());
+    EXPECT_EQ(0, descriptor["links"].count("/map"));
+    EXPECT_EQ(1, descriptor["links"].count("/data"));
+
+    EXPECT_TRUE(server.remove_link("runtime_server/pose"));
+    EXPECT_FALSE(server.publish("runtime_server/pose", "pose"));
+
+    EXPECT_TRUE(client.remove_request("runtime_server/pose"));
+    EXPECT_FALSE(client.remove_request("runtime_server/pose"));
+    EXPECT_FALSE(client.subscribe("runtime_server/pose"));
+    EXPECT_EQ(2, client.descriptor()["requests"].size());
+
+    // The server stays tracked until its last request is removed
+    EXPECT_TRUE(client.remove_request("runtime_server/map"));
+    EXPECT_TRUE(client.is_online("runtime_server"));
+    EXPECT_TRUE(client.remove_request("runtime_server/node_descriptor"));
+    EXPECT_FALSE(client.is_online("runtime_server"));
+}
+
+TEST(VizierNode, RuntimeLinksRequestedBySelf) {
+    json descriptor = {
+        {"endpoint", "self_server"},
+        {
+            "links",
+            {
+                {"/pose", {{"type", "STREAM"}}}
+            }
+        },
+        {
+            "requests",
+            {
+                {
+                    {"link", "self_server/pose"},
+                    {"type", "STREAM"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::VizierNode node(host, 1884, descriptor);
+
+    // The link stays requested once removed, and can be declared again
+    EXPECT_TRUE(node.remove_link("self_server/pose"));
+    EXPECT_FALSE(node.remove_link("self_server/pose"));
+    EXPECT_FALSE(node.publish("self_server/pose", "pose"));
+    EXPECT_FALSE(node.add_link("self_server/pose", {{"type", "DATA"}}));
+
+    EXPECT_TRUE(node.add_link("self_server/pose", {{"type", "STREAM"}}));
+    EXPECT_FALSE(node.add_link("self_server/pose", {{"type", "STREAM"}}));
+    EXPECT_EQ(1, node.descriptor()["links"].count("/pose"));
+
+    auto pose = node.subscribe("self_server/pose").value();
+    EXPECT_TRUE(node.publish("self_server/pose", "pose"));
+    EXPECT_EQ("pose", pose->dequeue(std::chrono::milliseconds(1000)).value());
+}
+
+TEST(VizierNode, RequiredLinks) {
+    json server_descriptor = {
+        {"endpoint", "required_server"},
+        {
+            "links",
+            {
+                {"/data", {{"type", "DATA"}}},
+                {"/pose", {{"type", "STREAM"}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    auto client_descriptor = [](const std::string& endpoint, const std::string& link, const std::string& type) {
+        return json{
+            {"endpoint", endpoint},
+            {
+                "requests",
+                {
+                    {{"link", "required_server/pose"}, {"type", "STREAM"}, {"required", false}},
+                    {{"link", link}, {"type", type}, {"required", true}}
+                }
+            }
+        };
+    };
+
+    std::string host = "192.168.1.8";
+
+    vizier::NodeOptions options;
+    options.connect_async = true;
+    options.startup_timeout = std::chrono::milliseconds(1000);
+
+    // Nodes may start in any order.  Required links are checked once their node answers
+    vizier::VizierNode client(host, 1884, client_descriptor("required_client", "required_server/data", "DATA"), options);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    vizier::VizierNode server(host, 1884, server_descriptor, options);
+    EXPECT_TRUE(server.ready().get());
+    EXPECT_TRUE(client.ready().get());
+
+    // A ready node answers requests at the first attempt
+    EXPECT_TRUE(server.put("required_server/data", "1"));
+    EXPECT_EQ("1", client.get("required_server/data", 1, std::chrono::milliseconds(500)).value());
+
+    // Missing links, links of another type and nodes that never answer fail startup
+    auto start = std::chrono::steady_clock::now();
+    vizier::VizierNode missing(host, 1884, client_descriptor("required_missing", "required_server/map", "DATA"), options);
+    vizier::VizierNode mistyped(host, 1884, client_descriptor("required_mistyped", "required_server/pose", "DATA"), options);
+    vizier::VizierNode orphan(host, 1884, client_descriptor("required_orphan", "required_nobody/data", "DATA"), options);
+
+    EXPECT_FALSE(missing.ready().get());
+    EXPECT_FALSE(mistyped.ready().get());
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(500));
+
+    EXPECT_FALSE(orphan.ready().get());
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1000));
+
+    // A failed startup leaves the node running
+    EXPECT_EQ(std::future_status::ready, missing.ready().wait_for(std::chrono::seconds(0)));
+    EXPECT_TRUE(missing.is_online("required_server").value());
+}
+
+TEST(VizierNode, ReannouncesAfterReconnect) {
+    json server_descriptor = {
+        {"endpoint", "reconnect_server"},
+        {
+            "links",
+            {
+                {"/data", {{"type", "DATA"}}}
+            }
+        },
+        {"requests", {}}
+    };
+
+    json client_descriptor = {
+        {"endpoint", "reconnect_client"},
+        {
+            "requests",
+            {
+                {
+                    {"link", "reconnect_server/data"},
+                    {"type", "DATA"},
+                    {"required", false}
+                }
+            }
+        }
+    };
+
+    std::string host = "192.168.1.8";
+
+    // The endpoint is the client id, so that another client can take over the server's connection
+    vizier::NodeOptions options;
+    options.persistent_session = true;
+
+    vizier::VizierNode server(host, 1884, server_descriptor, options);
+    vizier::VizierNode client(host, 1884, client_descriptor);
+    server.put("reconnect_server/data", "1");
+
+    auto wait_for_status = [&client](const bool online) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while(client.is_online("reconnect_server").value() != online && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        return client.is_online("reconnect_server").value() == online;
+    };
+
+    EXPECT_TRUE(wait_for_status(true));
+
+    // The server loses its connection, and the broker publishes its last will
+    {
+        MqttClientOptions impostor_options;
+        impostor_options.client_id = "reconnect_server";
+        MqttClientAsync impostor(host, 1884, impostor_options);
+
+        PublishOptions retained;
+        retained.retain = true;
+        impostor.async_publish(vizier::create_status_link("reconnect_server"), std::string(vizier::NODE_OFFLINE), retained);
+
+        EXPECT_TRUE(wait_for_status(false));
+    }
+
+    // Once reconnected, the server announces itself again
+    EXPECT_TRUE(wait_for_status(true));
+    EXPECT_EQ("1", client.get("reconnect_server/data", 10, std::chrono::milliseconds(500)).value());
+}